@@ -32,6 +32,7 @@
 #include <chrono>
 #include <thread>
 #include <interfaces/atomic_ops.h>
+#include <filesystem/file.h>
 #include <tscpp/buffer.h>
 #include "Logger.h"
 
@@ -72,6 +73,13 @@ void Logger::start()
         throw runtime_error("Error opening log file");
     setbuf(file, NULL);
 
+    // Reserve contiguous space past the end of the log, so that writes do
+    // not need to allocate clusters, which causes write latency spikes.
+    // Not an error if it fails, e.g. if the filesystem does not support it
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0)
+        fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, st.st_size, preallocSize);
+
     // The boring part, start threads one by one and if they fail, undo
     // Perhaps excessive defensive programming as thread creation failure is
     // highly unlikely (only if ram is full)
@@ -163,6 +163,7 @@ private:
     static const unsigned int numRecords       = 128; ///< Size of record queues
     static const unsigned int bufferSize       = 4096;///< Size of each buffer
     static const unsigned int numBuffers       = 4;   ///< Number of buffers
+    static const off_t preallocSize = 64*1024*1024;   ///< Log space to reserve
     static constexpr bool logStatsEnabled      = true;///< Log logger stats?
 
     /**
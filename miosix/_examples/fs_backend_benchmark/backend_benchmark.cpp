@@ -9,6 +9,10 @@
  * 
  * NOTE: this program assumes the SD is larger than 1GByte, and you have
  * 32KByte available in your microcontroller for the disk buffer.
+ *
+ * The test can also be run on a file in the filesystem mounted as /sd, which
+ * is safe also for writing and measures the filesystem overhead, such as
+ * the time to seek in large files when doing random access.
  */
 
 #include <cstdio>
@@ -16,6 +20,8 @@
 #include <cassert>
 #include <chrono>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <miosix.h>
 
 using namespace std;
@@ -24,6 +30,41 @@ using namespace miosix;
 
 static bool randomAccess; ///< Random or sequential access?
 static bool writeAccess;  ///< Read or write access?
+static bool fileAccess;   ///< File or raw device access?
+
+static const char benchFile[]="/sd/benchmark.bin"; ///< File for file access
+static const int benchFileSize=256*1024*1024;      ///< Size of the file
+
+/**
+ * Create the file used for file access, if it does not already exist
+ * \return true on success
+ */
+static bool createBenchFile()
+{
+    struct stat st;
+    if(stat(benchFile,&st)==0 && st.st_size>=benchFileSize) return true;
+    puts("Creating test file, this may take a while...");
+    int fd=open(benchFile,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd<0)
+    {
+        perror("open");
+        return false;
+    }
+    const int size=32*1024;
+    char *data=new char[size];
+    memset(data,0xaa,size);
+    bool ok=true;
+    for(int i=0;i<benchFileSize;i+=size)
+    {
+        if(write(fd,data,size)==size) continue;
+        perror("write");
+        ok=false;
+        break;
+    }
+    delete[] data;
+    close(fd);
+    return ok;
+}
 
 void testThread(void *)
 {
@@ -32,10 +73,11 @@ void testThread(void *)
     const int sizei=sizeb/sizeof(int); ///< Block write size in integers
     int *data=new int[sizei];
     memset(data,0xaa,sizeb);
-    const int startAddr=10240; ///< Start address, skip first sectors
-    const int endAddr=2000000; ///< End address ~1GB card
-    int addr=startAddr;
-    int fd=open("/dev/sda",O_RDWR,0);
+    //With raw device access skip the first sectors, and stay within ~1GB
+    const int startAddr=fileAccess ? 0 : 10240;         ///< Start sector
+    const int endAddr=fileAccess ? benchFileSize/512 : 2000000; ///< End sector
+    int addr=512*startAddr;
+    int fd=open(fileAccess ? benchFile : "/dev/sda",O_RDWR,0);
     if(fd<0)
     {
         perror("open");
@@ -47,11 +89,12 @@ void testThread(void *)
             addr=512*((rand() % (endAddr-startAddr-sizeb/512))+startAddr);
         else {
             addr+=sizeb;
-            if(addr>endAddr-sizeb) addr=startAddr;
+            if(addr>512*endAddr-sizeb) addr=512*startAddr;
         }
-        lseek(fd,addr,SEEK_SET);
+        //Seeking is timed too, as in files it may require reading the FAT
         auto t=system_clock::now();
         ledOn();
+        lseek(fd,addr,SEEK_SET);
         if(writeAccess) if(write(fd,data,sizeb)!=sizeb) assert(false);
         else; else if(read(fd,data,sizeb)!=sizeb) assert(false);
         ledOff();
@@ -68,8 +111,8 @@ void testThread(void *)
 int main()
 {
     puts("\n====================");
-    puts("Warning, the write test will destroy the formatting of the SD.");
-    puts("After running that test, format your SD card!");
+    puts("Warning, the raw device write test will destroy the formatting of");
+    puts("the SD. After running that test, format your SD card!");
     for(;;)
     {
         writeAccess=false;
@@ -85,6 +128,16 @@ int main()
             puts("Error: insert 'r' or 'w' or 'q'");
         }
         for(;;)
+        {
+            puts("Raw device or file access (d/f)?");
+            char line[64];
+            fgets(line,sizeof(line),stdin);
+            fileAccess=line[0]=='f';
+            if(line[0]=='d' || line[0]=='f') break;
+            puts("Error: insert 'd' or 'f'");
+        }
+        if(fileAccess && createBenchFile()==false) continue;
+        for(;;)
         {
             puts("Random or sequential access (r/s)?");
             char line[64];
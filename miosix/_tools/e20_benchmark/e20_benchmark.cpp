@@ -0,0 +1,95 @@
+// Host benchmark of the e20 event queues
+// Compile with
+// g++ -O2 -std=c++14 -pthread -Ihost_stubs -o e20_benchmark e20_benchmark.cpp ../../e20/e20.cpp
+//
+// On a desktop PC, with one thread both posting and running events,
+// PooledEventQueue is on par with FixedEventQueue, and about 50% faster than
+// EventQueue. With two threads, and the fixed and pooled queues both limited
+// to 64 events, it is about 30% slower than the other two, as the producer
+// blocks on a full queue more often. The host stubs make locking much slower
+// than on the target, so only compare the queues with each other
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include "../../e20/e20.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+static volatile unsigned int counter;
+
+static void event()
+{
+    counter++;
+}
+
+static void stop()
+{
+    throw 0;
+}
+
+/**
+ * Post a batch of events, then run them, all from the same thread
+ * \return events per second
+ */
+template<typename Q>
+double batch(Q& q, unsigned int batchSize, unsigned int iterations)
+{
+    counter=0;
+    auto t0=steady_clock::now();
+    for(unsigned int i=0;i<iterations;i++)
+    {
+        for(unsigned int j=0;j<batchSize;j++) q.post(event);
+        for(unsigned int j=0;j<batchSize;j++) q.runOne();
+    }
+    auto t1=steady_clock::now();
+    if(counter!=batchSize*iterations) cerr<<"Lost events"<<endl;
+    return batchSize*iterations/duration<double>(t1-t0).count();
+}
+
+/**
+ * Post events from a thread while another thread runs them
+ * \return events per second
+ */
+template<typename Q>
+double producerConsumer(Q& q, unsigned int numEvents)
+{
+    counter=0;
+    auto t0=steady_clock::now();
+    thread producer([&]{
+        for(unsigned int i=0;i<numEvents;i++) q.post(event);
+        q.post(stop);
+    });
+    try {
+        q.run();
+    } catch(int) {}
+    producer.join();
+    auto t1=steady_clock::now();
+    if(counter!=numEvents) cerr<<"Lost events"<<endl;
+    return numEvents/duration<double>(t1-t0).count();
+}
+
+template<typename Q>
+void benchmark(const char *name, Q& q)
+{
+    const unsigned int numEvents=1000000;
+    printf("%-20s %12.0f %12.0f %12.0f\n",name,
+           batch(q,1,numEvents),batch(q,64,numEvents/64),
+           producerConsumer(q,numEvents));
+}
+
+int main()
+{
+    printf("Events/s             batch of 1  batch of 64   two threads\n");
+    EventQueue eq;
+    benchmark("EventQueue",eq);
+    FixedEventQueue<64> feq;
+    benchmark("FixedEventQueue<64>",feq);
+    PooledEventQueue<> peq(8,64);
+    benchmark("PooledEventQueue",peq);
+    printf("PooledEventQueue capacity %u\n",peq.capacity());
+    return 0;
+}
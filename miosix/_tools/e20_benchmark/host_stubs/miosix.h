@@ -0,0 +1,228 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+// Minimal host implementation of the Miosix kernel API used by e20, to build
+// the e20 benchmark on a PC. Disabling interrupts is emulated with a global
+// recursive mutex, and waiting threads are woken through a single condition
+// variable, which is correct but slow, so only the uncontended case is
+// representative of the performance on the target.
+
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+namespace miosix {
+
+namespace host {
+inline std::recursive_mutex& irqMutex() { static std::recursive_mutex m; return m; }
+inline std::condition_variable_any& irqCv() { static std::condition_variable_any c; return c; }
+inline std::chrono::steady_clock::time_point toTimePoint(long long ns)
+{
+    return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(ns));
+}
+}
+
+inline long long getTime()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline long long IRQgetTime() { return getTime(); }
+
+enum class TimedWaitResult
+{
+    NoTimeout,
+    Timeout
+};
+
+class InterruptDisableLock
+{
+public:
+    InterruptDisableLock() { host::irqMutex().lock(); }
+    ~InterruptDisableLock() { host::irqMutex().unlock(); }
+};
+
+class FastInterruptDisableLock
+{
+public:
+    FastInterruptDisableLock() { host::irqMutex().lock(); }
+    ~FastInterruptDisableLock() { host::irqMutex().unlock(); }
+};
+
+class InterruptEnableLock
+{
+public:
+    InterruptEnableLock(InterruptDisableLock&) { host::irqMutex().unlock(); }
+    ~InterruptEnableLock() { host::irqMutex().lock(); }
+};
+
+class Thread
+{
+public:
+    static Thread *IRQgetCurrentThread()
+    {
+        static thread_local Thread t;
+        return &t;
+    }
+
+    void IRQwakeup()
+    {
+        awake=true;
+        host::irqCv().notify_all();
+    }
+
+    int IRQgetPriority() const { return 0; }
+
+    static void IRQenableIrqAndWait(InterruptDisableLock&) { waitImpl(); }
+    static void IRQenableIrqAndWait(FastInterruptDisableLock&) { waitImpl(); }
+
+    static TimedWaitResult IRQenableIrqAndTimedWait(InterruptDisableLock&,
+            long long absoluteTimeNs) { return timedWaitImpl(absoluteTimeNs); }
+    static TimedWaitResult IRQenableIrqAndTimedWait(FastInterruptDisableLock&,
+            long long absoluteTimeNs) { return timedWaitImpl(absoluteTimeNs); }
+
+private:
+    static void waitImpl()
+    {
+        Thread *t=IRQgetCurrentThread();
+        t->awake=false;
+        std::unique_lock<std::recursive_mutex> l(host::irqMutex(),std::adopt_lock);
+        host::irqCv().wait(l,[t]{ return t->awake; });
+        l.release(); //Still locked, as the caller expects
+    }
+
+    static TimedWaitResult timedWaitImpl(long long absoluteTimeNs)
+    {
+        Thread *t=IRQgetCurrentThread();
+        t->awake=false;
+        std::unique_lock<std::recursive_mutex> l(host::irqMutex(),std::adopt_lock);
+        bool woken=host::irqCv().wait_until(l,host::toTimePoint(absoluteTimeNs),
+                [t]{ return t->awake; });
+        l.release(); //Still locked, as the caller expects
+        return woken ? TimedWaitResult::NoTimeout : TimedWaitResult::Timeout;
+    }
+
+    bool awake=false;
+};
+
+class FastMutex
+{
+public:
+    void lock() { m.lock(); }
+    void unlock() { m.unlock(); }
+private:
+    std::mutex m;
+};
+
+template<typename T>
+class Lock
+{
+public:
+    explicit Lock(T& m) : m(m) { m.lock(); }
+    ~Lock() { m.unlock(); }
+    T& get() { return m; }
+private:
+    T& m;
+};
+
+template<typename T>
+class Unlock
+{
+public:
+    explicit Unlock(Lock<T>& l) : m(l.get()) { m.unlock(); }
+    ~Unlock() { m.lock(); }
+private:
+    T& m;
+};
+
+class ConditionVariable
+{
+public:
+    void wait(Lock<FastMutex>& l) { cv.wait(l.get()); }
+    TimedWaitResult timedWait(Lock<FastMutex>& l, long long absTime)
+    {
+        return cv.wait_until(l.get(),host::toTimePoint(absTime))==std::cv_status::timeout
+            ? TimedWaitResult::Timeout : TimedWaitResult::NoTimeout;
+    }
+    void signal() { cv.notify_one(); }
+private:
+    std::condition_variable_any cv;
+};
+
+class IntrusiveListItem
+{
+public:
+    IntrusiveListItem *prev=nullptr, *next=nullptr;
+};
+
+template<typename T>
+class IntrusiveList
+{
+public:
+    //e20 puts WaitTokens that are on the stack in the list, and removes them
+    //before they go out of scope, which GCC cannot see
+    #if defined(__GNUC__) && !defined(__clang__) && __GNUC__>=12
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wdangling-pointer"
+    #endif
+    void push_back(T *item)
+    {
+        item->prev=tail;
+        item->next=nullptr;
+        if(tail) tail->next=item;
+        else head=item;
+        tail=item;
+    }
+    #if defined(__GNUC__) && !defined(__clang__) && __GNUC__>=12
+    #pragma GCC diagnostic pop
+    #endif
+    void pop_front() { erase(head); }
+    bool removeFast(T *item)
+    {
+        if(item->prev==nullptr && head!=item) return false;
+        erase(item);
+        return true;
+    }
+    T *front() { return static_cast<T*>(head); }
+    bool empty() const { return head==nullptr; }
+private:
+    void erase(IntrusiveListItem *item)
+    {
+        if(item->prev) item->prev->next=item->next;
+        else head=item->next;
+        if(item->next) item->next->prev=item->prev;
+        else tail=item->prev;
+        item->prev=item->next=nullptr;
+    }
+
+    IntrusiveListItem *head=nullptr, *tail=nullptr;
+};
+
+} //namespace miosix
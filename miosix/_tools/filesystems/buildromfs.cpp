@@ -32,10 +32,31 @@ int main(int argc, char *argv[])
 {
     if(argc<4)
     {
-        cerr<<"Miosix buildromfs utility v2.00"<<endl
-            <<"use: buildromfs <target file> --from-directory <source directory>"<<endl;
+        cerr<<"Miosix buildromfs utility v2.03"<<endl
+            <<"use: buildromfs <target file> --from-directory <source directory>"
+            <<" [--compress <block size>] [--incremental]"<<endl;
         return 1;
     }
+    unsigned int blockSize=0;
+    bool incremental=false;
+    for(int i=4;i<argc;i++)
+    {
+        string option=argv[i];
+        if(option=="--compress" && i+1<argc)
+        {
+            blockSize=stoul(argv[++i]);
+            if(blockSize==0)
+            {
+                cerr<<"Compression block size can't be zero"<<endl;
+                return 1;
+            }
+        } else if(option=="--incremental") {
+            incremental=true;
+        } else {
+            cerr<<argv[i]<<": unsupported option"<<endl;
+            return 1;
+        }
+    }
 
     // Build the tree of files and directories that compose the image
     string mode=argv[2];
@@ -49,6 +70,10 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // In incremental mode, load the previous image before overwriting it
+    PreviousImage previous;
+    if(incremental) incremental=previous.load(argv[1]);
+
     // Open the output image
     fstream io(argv[1], ios::in | ios::out | ios::trunc | ios::binary);
     if(!io)
@@ -58,7 +83,10 @@ int main(int argc, char *argv[])
     }
 
     // Build the image and write it to file
-    MkRomFs img(io,root);
+    MkRomFs img(io,root,blockSize,incremental ? &previous : nullptr);
     cout<<"RomFs size "<<img.size()<<endl;
+    if(img.deduplicated()>0)
+        cout<<img.deduplicated()<<" duplicated files stored once"<<endl;
+    if(incremental) cout<<img.reused()<<" files reused from previous image"<<endl;
     return 0;
 }
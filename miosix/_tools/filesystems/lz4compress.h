@@ -0,0 +1,92 @@
+ /***************************************************************************
+  *   Copyright (C) 2026 by Terraneo Federico                               *
+  *                                                                         *
+  *   This program is free software; you can redistribute it and/or modify  *
+  *   it under the terms of the GNU General Public License as published by  *
+  *   the Free Software Foundation; either version 2 of the License, or     *
+  *   (at your option) any later version.                                   *
+  *                                                                         *
+  *   This program is distributed in the hope that it will be useful,       *
+  *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+  *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+  *   GNU General Public License for more details.                          *
+  *                                                                         *
+  *   You should have received a copy of the GNU General Public License     *
+  *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+  ***************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+
+/**
+ * Compress a buffer as an LZ4 block, as defined by the LZ4 block format
+ * specification. This is a simple greedy compressor, it does not achieve the
+ * compression ratio of the reference implementation, but the output can be
+ * decompressed by any LZ4 block decompressor.
+ * \param src data to compress
+ * \param size size of the data to compress
+ * \return the compressed data
+ */
+inline std::vector<unsigned char> lz4Compress(const unsigned char *src,
+                                              unsigned int size)
+{
+    using namespace std;
+    const unsigned int hashBits=12;
+    const unsigned int minMatch=4;
+    const unsigned int lastLiterals=5;  //The last 5 bytes must be literals
+    const unsigned int matchLimit=12;   //Last match must start before this
+    const unsigned int maxOffset=65535;
+
+    vector<unsigned char> result;
+    auto writeLength=[&](unsigned int length) {
+        for(;length>=255;length-=255) result.push_back(255);
+        result.push_back(length);
+    };
+    auto writeSequence=[&](unsigned int anchor, unsigned int literals,
+                           unsigned int offset, unsigned int match) {
+        unsigned char token=min(literals,15u)<<4;
+        if(offset) token|=min(match-minMatch,15u);
+        result.push_back(token);
+        if(literals>=15) writeLength(literals-15);
+        result.insert(result.end(),src+anchor,src+anchor+literals);
+        if(offset==0) return; //Last sequence, literals only
+        result.push_back(offset & 0xff);
+        result.push_back(offset>>8);
+        if(match-minMatch>=15) writeLength(match-minMatch-15);
+    };
+    auto read32=[&](unsigned int i) {
+        unsigned int x;
+        memcpy(&x,src+i,sizeof(x));
+        return x;
+    };
+    auto hash=[&](unsigned int x) { return (x*2654435761u)>>(32-hashBits); };
+
+    vector<int> table(1<<hashBits,-1);
+    unsigned int anchor=0;
+    if(size>matchLimit)
+    {
+        unsigned int i=0;
+        while(i<size-matchLimit)
+        {
+            unsigned int x=read32(i);
+            unsigned int h=hash(x);
+            int candidate=table[h];
+            table[h]=i;
+            if(candidate<0 || i-candidate>maxOffset || read32(candidate)!=x)
+            {
+                i++;
+                continue;
+            }
+            unsigned int match=minMatch;
+            while(i+match<size-lastLiterals && src[candidate+match]==src[i+match])
+                match++;
+            writeSequence(anchor,i-anchor,i-candidate,match);
+            i+=match;
+            anchor=i;
+        }
+    }
+    writeSequence(anchor,size-anchor,0,0);
+    return result;
+}
@@ -0,0 +1,78 @@
+// Host benchmark of the RomFs LZ4 decompression throughput versus block size
+// Compile with g++ -O2 -std=c++17 -o lz4_bench lz4_bench.cpp ../../../util/lz4.cpp
+// Run as ./lz4_bench <file>
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include "../lz4compress.h"
+#include "../../../util/lz4.h"
+
+using namespace std;
+using namespace std::chrono;
+
+int main(int argc, char *argv[])
+{
+    if(argc!=2)
+    {
+        cerr<<"use: lz4_bench <file>"<<endl;
+        return 1;
+    }
+    ifstream in(argv[1],ios::binary);
+    if(!in)
+    {
+        cerr<<argv[1]<<": file not found"<<endl;
+        return 1;
+    }
+    string content{istreambuf_iterator<char>(in),istreambuf_iterator<char>()};
+    auto data=reinterpret_cast<const unsigned char*>(content.data());
+    unsigned int size=content.size();
+    cout<<"File size "<<size<<endl
+        <<"block size  compressed  ratio  decompression MB/s"<<endl;
+    for(unsigned int blockSize=256;blockSize<=16384;blockSize*=2)
+    {
+        //Compress like buildromfs does, storing blocks that don't shrink
+        vector<vector<unsigned char>> blocks;
+        unsigned int compressedSize=0;
+        for(unsigned int start=0;start<size;start+=blockSize)
+        {
+            unsigned int len=min(blockSize,size-start);
+            auto b=lz4Compress(data+start,len);
+            if(b.size()>=len) b.assign(data+start,data+start+len);
+            compressedSize+=b.size();
+            blocks.push_back(move(b));
+        }
+
+        //Decompress block by block in a block sized window, like the kernel
+        vector<char> window(blockSize);
+        unsigned int iterations=max(1u,(64u<<20)/max(size,1u));
+        auto t0=steady_clock::now();
+        for(unsigned int i=0;i<iterations;i++)
+        {
+            for(unsigned int j=0;j<blocks.size();j++)
+            {
+                unsigned int start=j*blockSize;
+                unsigned int len=min(blockSize,size-start);
+                if(blocks[j].size()==len)
+                {
+                    memcpy(window.data(),blocks[j].data(),len);
+                } else if(miosix::lz4Decompress(blocks[j].data(),
+                    blocks[j].size(),window.data(),len)!=static_cast<int>(len)
+                    || memcmp(window.data(),data+start,len)!=0) {
+                    cerr<<"Decompression error"<<endl;
+                    return 1;
+                }
+            }
+        }
+        auto t1=steady_clock::now();
+        double seconds=duration<double>(t1-t0).count();
+        printf("%10u  %10u  %5.2f  %18.1f\n",blockSize,compressedSize,
+               static_cast<double>(compressedSize)/max(size,1u),
+               static_cast<double>(size)*iterations/seconds/1e6);
+    }
+    return 0;
+}
@@ -20,6 +20,11 @@
 #include <cstring>
 #include <fstream>
 #include <list>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <sstream>
+#include <filesystem>
 #include <cassert>
 #include <algorithm>
 #include <stdexcept>
@@ -27,6 +32,8 @@
 #include <sys/stat.h>
 #include "tree.h"
 #include "image.h"
+#include "lz4compress.h"
+#include "lz4.h"
 #include "romfs_types.h"
 #include "elf_types.h"
 
@@ -60,6 +67,34 @@ T toLittleEndian(T x)
 
 auto toLittleEndian16=toLittleEndian<unsigned short>;
 auto toLittleEndian32=toLittleEndian<unsigned int>;
+//Swapping bytes is its own inverse
+auto fromLittleEndian16=toLittleEndian<unsigned short>;
+auto fromLittleEndian32=toLittleEndian<unsigned int>;
+
+/**
+ * A previously built RomFs image, whose content can be reused by MkRomFs
+ * to speed up building a new image when only a few files changed
+ */
+struct PreviousImage
+{
+    /**
+     * Load a previously built image
+     * \param path image file path
+     * \return false if the image does not exist
+     */
+    bool load(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if(!in) return false;
+        data.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+        mtime=std::filesystem::last_write_time(path);
+        return true;
+    }
+
+    std::string data; ///< Image content
+    std::filesystem::file_time_type mtime; ///< Image modification time
+};
 
 /**
  * Create a RomFs image from a directory tree
@@ -71,14 +106,27 @@ public:
      * Everything is done in the constructor, the class exists as a convenience
      * \param io iostream where the image will be built
      * \param root root of the directory tree
+     * \param blockSize if nonzero, compress files that are not elf files using
+     * this block size. Files that would not shrink are stored uncompressed
+     * \param previous if not nullptr, files that are older than the previous
+     * image are not read again, but their content is taken from the previous
+     * image, avoiding also to compress them again. Must remain valid for the
+     * duration of the constructor call
      */
-    MkRomFs(std::iostream& io, const FilesystemEntry& root) : img(io)
+    MkRomFs(std::iostream& io, const FilesystemEntry& root,
+            unsigned int blockSize=0, const PreviousImage *previous=nullptr)
+            : img(io), blockSize(blockSize), previous(previous)
     {
+        if(blockSize>romFsMaxBlockSize)
+            throw std::runtime_error("compression block size exceeds "
+                +std::to_string(romFsMaxBlockSize)+"Byte");
+        if(previous) scanPreviousImage();
+
         // Construct the filesystem header
         RomFsHeader header;
         memset(&header,0,sizeof(RomFsHeader));
         strncpy(header.marker,"wwwww",6);
-        strncpy(header.fsName,"RomFs 2.01",11);
+        strncpy(header.fsName,"RomFs 2.03",11);
         strncpy(header.osName,"Miosix",7);
         //header.imageSize still unknown at this point
         auto headerOffset=img.append(header,romFsStructAlignment);
@@ -93,7 +141,7 @@ public:
         rootDir.gid=toLittleEndian16(root.gid);
         auto rootOffset=img.append(rootDir,romFsStructAlignment);
         img.appendString(""); //Root dir name is always empty
-        auto info=addDirectoryInode(root,0); //prevInode of root dir always 0
+        auto info=addDirectoryInode(root,0,""); //prevInode of root dir always 0
 
         // Go back and update rootDir
         rootDir.inode=toLittleEndian32(info.inode);
@@ -113,22 +161,51 @@ public:
      */
     unsigned int size() const { return img.size(); }
 
+    /**
+     * \return the number of files whose content was found to be identical to
+     * the one of another file, and thus share the same inode
+     */
+    unsigned int deduplicated() const { return numDeduplicated; }
+
+    /**
+     * \return the number of files whose content was taken from the previous
+     * image
+     */
+    unsigned int reused() const { return numReused; }
+
 private:
     struct InodeInfo
     {
-        InodeInfo(unsigned int inode=0, unsigned int size=0)
-                : inode(inode), size(size) {}
+        InodeInfo(unsigned int inode=0, unsigned int size=0,
+                  bool compressed=false)
+                : inode(inode), size(size), compressed(compressed) {}
         unsigned int inode;
         unsigned int size;
+        bool compressed;
     };
 
+    /**
+     * A file of the previous image
+     */
+    struct PreviousFile
+    {
+        unsigned int inode;
+        unsigned int size;
+        bool compressed;
+    };
+
+    /// Maximum directory nesting accepted when scanning the previous image
+    static const int maxPreviousDepth=64;
+
     /**
      * Add a directory inode to the image
      * \param dir directory to add
      * \param prevInode inode of the parent directory
+     * \param path path of the directory in the image, empty for the root
      * \return inode added
      */
-    InodeInfo addDirectoryInode(const FilesystemEntry& dir, unsigned int prevInode)
+    InodeInfo addDirectoryInode(const FilesystemEntry& dir,
+                                unsigned int prevInode, const std::string& path)
     {
         using namespace std;
 
@@ -162,6 +239,33 @@ private:
         // NOTE: Must be done before we recursively add the directory content!
         auto size=img.size()-inode; //inode is also address of first byte
 
+        // Write the name index, sorted by hash for binary search
+        vector<RomFsIndexEntry> index;
+        if(entryOffsets.size()>=romFsIndexMinEntries)
+        {
+            auto o=begin(entryOffsets);
+            for(auto& d : dir.directoryEntries)
+            {
+                RomFsIndexEntry ie;
+                ie.hash=romFsHash(d.name.c_str());
+                ie.offset=*o++;
+                index.push_back(ie);
+            }
+            sort(begin(index),end(index),
+                [](const RomFsIndexEntry& a, const RomFsIndexEntry& b){
+                    return a.hash<b.hash;
+                });
+        }
+        RomFsDirectoryIndex indexHeader;
+        indexHeader.numEntries=toLittleEndian32(index.size());
+        img.append(indexHeader,romFsStructAlignment);
+        for(auto& ie : index)
+        {
+            ie.hash=toLittleEndian32(ie.hash);
+            ie.offset=toLittleEndian32(ie.offset);
+            img.append(ie,romFsStructAlignment);
+        }
+
         // Then for each entry, recursively add the content
         list<InodeInfo> entryContent;
         for(auto& d : dir.directoryEntries)
@@ -169,10 +273,10 @@ private:
             switch(d.mode & S_IFMT)
             {
                 case S_IFDIR:
-                    entryContent.push_back(addDirectoryInode(d,inode));
+                    entryContent.push_back(addDirectoryInode(d,inode,path+"/"+d.name));
                     break;
                 case S_IFREG:
-                    entryContent.push_back(addFileInode(d));
+                    entryContent.push_back(addFileInode(d,path+"/"+d.name));
                     break;
                 case S_IFLNK:
                     entryContent.push_back(addSymlinkInode(d));
@@ -190,6 +294,12 @@ private:
             auto de=img.get<RomFsDirectoryEntry>(*o);
             de.inode=toLittleEndian32(c->inode);
             de.size=toLittleEndian32(c->size);
+            if(c->compressed)
+            {
+                unsigned short mode=fromLittleEndian16(de.mode);
+                mode=(mode & ~S_IFMT) | romFsCompressedFile;
+                de.mode=toLittleEndian16(mode);
+            }
             img.put(de,*o);
         }
         return InodeInfo(inode,size);
@@ -197,32 +307,279 @@ private:
 
     /**
      * Add a file inode to the image
-     * \param dir directory to add
+     * \param file file to add
+     * \param path path of the file in the image
      * \return inode added
      */
-    InodeInfo addFileInode(const FilesystemEntry& file)
+    InodeInfo addFileInode(const FilesystemEntry& file, const std::string& path)
     {
         assert(file.isFile());
+        if(previous)
+        {
+            auto info=reusePreviousFileInode(file,path);
+            if(info.size>0) return info;
+        }
         std::ifstream in(file.path, std::ios::binary);
         if(!in) throw std::runtime_error(file.path+": file not found");
-        unsigned int fileAlignment=getFileAlignment(file.path,in);
+        std::string content{std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>()};
+        return addFileContent(std::move(content),file.path);
+    }
+
+    /**
+     * Add a file inode to the image given the file content. If another file
+     * with the same content was already added, its inode is shared instead
+     * \param content file content
+     * \param name file name for error messages
+     * \return inode added
+     */
+    InodeInfo addFileContent(std::string content, const std::string& name)
+    {
+        // Empty files are never shared. One dummy extra byte is appended to the
+        // output stream to ensure the next file has a different inode
+        // regardless of its alignment.
+        if(content.empty())
+        {
+            img.align(romFsFileAlignment);
+            auto inode=img.append<unsigned char>(0xFE,1);
+            return InodeInfo(inode,0);
+        }
+
+        auto it=contents.find(content);
+        if(it!=contents.end())
+        {
+            numDeduplicated++;
+            return it->second;
+        }
+
+        std::istringstream in(content);
+        unsigned int fileAlignment=getFileAlignment(name,in);
         fileAlignment=std::max(fileAlignment,romFsFileAlignment);
         if(fileAlignment>romFsImageAlignment)
         {
-            throw std::runtime_error(file.path+" alignment ("
+            throw std::runtime_error(name+" alignment ("
                 +std::to_string(fileAlignment)
                 +"Byte) exceeds RomFs maximum configured alignment ("
                 +std::to_string(romFsImageAlignment)+"Byte)");
         }
-        in.seekg(0); //Make sure we write the whole file
-        auto inode=img.appendStream(in,fileAlignment);
+        InodeInfo info;
+        if(blockSize>0) info=addCompressedFileInode(content);
+        if(!info.compressed)
+        {
+            auto inode=img.appendString(content,false,fileAlignment);
+            info=InodeInfo(inode,content.size());
+        }
+        contents.emplace(std::move(content),info);
+        return info;
+    }
 
-        // Compute the file inode size. If it is zero, append one dummy extra
-        // byte to the output stream to ensure the next file has a different
-        // inode regardless of its alignment.
-        auto size=img.size()-inode; //inode is also address of first byte
-        if(size==0) img.append<unsigned char>(0xFE,1);
-        return InodeInfo(inode,size);
+    /**
+     * Add a compressed file inode to the image, if compressing the file makes
+     * it smaller
+     * \param content file content
+     * \return inode added, or an InodeInfo with compressed set to false if the
+     * file was not added because it would not shrink
+     */
+    InodeInfo addCompressedFileInode(const std::string& content)
+    {
+        using namespace std;
+        // Elf files are not compressed as they need to be executed in place
+        if(content.compare(0,4,"\x7f" "ELF")==0) return InodeInfo();
+        auto data=reinterpret_cast<const unsigned char*>(content.data());
+        unsigned int numBlocks=(content.size()+blockSize-1)/blockSize;
+        vector<unsigned int> offsets;
+        vector<unsigned char> blocks;
+        unsigned int offset=sizeof(RomFsCompressedFile)
+                           +(numBlocks+1)*sizeof(unsigned int);
+        for(unsigned int i=0;i<numBlocks;i++)
+        {
+            offsets.push_back(toLittleEndian32(offset+blocks.size()));
+            unsigned int start=i*blockSize;
+            unsigned int size=min<unsigned int>(blockSize,content.size()-start);
+            auto compressed=lz4Compress(data+start,size);
+            if(compressed.size()<size)
+                blocks.insert(blocks.end(),compressed.begin(),compressed.end());
+            else blocks.insert(blocks.end(),data+start,data+start+size);
+        }
+        offsets.push_back(toLittleEndian32(offset+blocks.size()));
+        if(offset+blocks.size()>=content.size()) return InodeInfo();
+
+        RomFsCompressedFile header;
+        header.blockSize=toLittleEndian32(blockSize);
+        auto inode=img.append(header,romFsFileAlignment);
+        for(auto o : offsets) img.append(o);
+        img.appendString(string(blocks.begin(),blocks.end()),false);
+        return InodeInfo(inode,content.size(),true);
+    }
+
+    /**
+     * Add a file inode to the image taking its content from the previous
+     * image, if the file is older than the previous image and has not changed
+     * size. Compressed files are copied without compressing them again if the
+     * block size did not change.
+     * \param file file to add
+     * \param path path of the file in the image
+     * \return inode added, or an InodeInfo with size 0 if the file was not
+     * found in the previous image or changed
+     */
+    InodeInfo reusePreviousFileInode(const FilesystemEntry& file,
+                                     const std::string& path)
+    {
+        using namespace std;
+        auto it=previousFiles.find(path);
+        if(it==previousFiles.end()) return InodeInfo();
+        const PreviousFile& old=it->second;
+        error_code ec;
+        auto mtime=filesystem::last_write_time(file.path,ec);
+        if(ec || mtime>=previous->mtime) return InodeInfo();
+        auto size=filesystem::file_size(file.path,ec);
+        if(ec || size!=old.size || size==0) return InodeInfo();
+        auto reused=reusedInodes.find(old.inode);
+        if(reused!=reusedInodes.end())
+        {
+            // The file was deduplicated also in the previous image
+            numReused++;
+            numDeduplicated++;
+            return reused->second;
+        }
+
+        string content;
+        InodeInfo info;
+        if(old.compressed)
+        {
+            unsigned int oldBlockSize;
+            if(!decompressPrevious(old,content,oldBlockSize)) return InodeInfo();
+            if(oldBlockSize==blockSize && contents.count(content)==0)
+            {
+                unsigned int numBlocks=(old.size+blockSize-1)/blockSize;
+                auto end=previousGet<unsigned int>(old.inode
+                    +sizeof(RomFsCompressedFile)+numBlocks*sizeof(unsigned int));
+                img.align(romFsFileAlignment);
+                auto inode=img.appendString(previous->data.substr(old.inode,
+                    fromLittleEndian32(end)),false);
+                info=InodeInfo(inode,old.size,true);
+                contents.emplace(std::move(content),info);
+            } else info=addFileContent(std::move(content),file.path);
+        } else {
+            content=previous->data.substr(old.inode,old.size);
+            info=addFileContent(std::move(content),file.path);
+        }
+        numReused++;
+        reusedInodes[old.inode]=info;
+        return info;
+    }
+
+    /**
+     * Decompress a compressed file of the previous image
+     * \param old file to decompress
+     * \param content the uncompressed file content is returned here
+     * \param oldBlockSize the compression block size is returned here
+     * \return true on success
+     */
+    bool decompressPrevious(const PreviousFile& old, std::string& content,
+                            unsigned int& oldBlockSize)
+    {
+        auto header=previousGet<RomFsCompressedFile>(old.inode);
+        oldBlockSize=fromLittleEndian32(header.blockSize);
+        if(oldBlockSize==0 || oldBlockSize>romFsMaxBlockSize) return false;
+        unsigned int numBlocks=(old.size+oldBlockSize-1)/oldBlockSize;
+        content.resize(old.size);
+        for(unsigned int i=0;i<numBlocks;i++)
+        {
+            unsigned int offsetsStart=old.inode+sizeof(RomFsCompressedFile);
+            unsigned int begin=fromLittleEndian32(previousGet<unsigned int>(
+                offsetsStart+i*sizeof(unsigned int)));
+            unsigned int end=fromLittleEndian32(previousGet<unsigned int>(
+                offsetsStart+(i+1)*sizeof(unsigned int)));
+            unsigned int start=i*oldBlockSize;
+            unsigned int size=std::min(oldBlockSize,old.size-start);
+            if(end<begin || old.inode+end>previous->data.size()) return false;
+            const char *src=previous->data.data()+old.inode+begin;
+            if(end-begin==size) memcpy(&content[start],src,size);
+            else if(miosix::lz4Decompress(src,end-begin,&content[start],size)
+                    !=static_cast<int>(size)) return false;
+        }
+        return true;
+    }
+
+    /**
+     * Build the list of files in the previous image. If the previous image
+     * is not valid, it is ignored.
+     */
+    void scanPreviousImage()
+    {
+        using namespace std;
+        try {
+            auto header=previousGet<RomFsHeader>(0);
+            if(strncmp(header.fsName,"RomFs 2.0",9)!=0)
+                throw runtime_error("unsupported version");
+            scanPreviousDirectory(sizeof(RomFsHeader),"",0);
+        } catch(exception& e) {
+            cerr<<"Previous image not valid ("<<e.what()<<"), ignoring it"<<endl;
+            previousFiles.clear();
+        }
+    }
+
+    /**
+     * Recursively add the files in a directory of the previous image to the
+     * list of files in the previous image
+     * \param entryOffset offset of the directory entry of the directory
+     * \param path path of the directory in the image, empty for the root
+     * \param depth recursion depth, to reject corrupted images
+     */
+    void scanPreviousDirectory(unsigned int entryOffset, const std::string& path,
+                               int depth)
+    {
+        using namespace std;
+        if(depth>maxPreviousDepth) throw runtime_error("too many nested dirs");
+        auto dir=previousGet<RomFsDirectoryEntry>(entryOffset);
+        unsigned int inode=fromLittleEndian32(dir.inode);
+        unsigned int end=inode+fromLittleEndian32(dir.size);
+        unsigned int offset=inode+sizeof(RomFsFirstEntry);
+        while(offset<end)
+        {
+            auto e=previousGet<RomFsDirectoryEntry>(offset);
+            unsigned int nameOffset=offset+sizeof(RomFsDirectoryEntry);
+            auto nameEnd=previous->data.find('\0',nameOffset);
+            if(nameEnd==string::npos) throw runtime_error("unterminated name");
+            string name=previous->data.substr(nameOffset,nameEnd-nameOffset);
+            unsigned short mode=fromLittleEndian16(e.mode);
+            switch(mode & S_IFMT)
+            {
+                case S_IFDIR:
+                    scanPreviousDirectory(offset,path+"/"+name,depth+1);
+                    break;
+                case S_IFREG:
+                case romFsCompressedFile:
+                {
+                    PreviousFile f;
+                    f.inode=fromLittleEndian32(e.inode);
+                    f.size=fromLittleEndian32(e.size);
+                    f.compressed=(mode & S_IFMT)==romFsCompressedFile;
+                    if(!f.compressed && f.inode+f.size>previous->data.size())
+                        throw runtime_error("file past image end");
+                    previousFiles[path+"/"+name]=f;
+                    break;
+                }
+            }
+            offset=(nameEnd+1+romFsStructAlignment-1) & (0-romFsStructAlignment);
+        }
+    }
+
+    /**
+     * Get a struct from the previous image
+     * \tparam U struct type
+     * \param offset offset in bytes from the image start
+     * \return struct read from the image
+     */
+    template<typename U>
+    U previousGet(unsigned int offset)
+    {
+        if(offset+sizeof(U)>previous->data.size())
+            throw std::runtime_error("read past image end");
+        U result;
+        memcpy(&result,previous->data.data()+offset,sizeof(U));
+        return result;
     }
 
     /**
@@ -276,4 +633,14 @@ private:
     }
 
     Image<unsigned int> img; ///< Backing storage
+    unsigned int blockSize;  ///< Compression block size, 0 if not compressing
+    const PreviousImage *previous; ///< Previous image, or nullptr
+    /// Files already added to the image, to share inodes of identical files
+    std::unordered_map<std::string,InodeInfo> contents;
+    /// Files of the previous image, by path
+    std::map<std::string,PreviousFile> previousFiles;
+    /// Inodes of the previous image already reused, and where they ended up
+    std::map<unsigned int,InodeInfo> reusedInodes;
+    unsigned int numDeduplicated=0; ///< Number of files sharing an inode
+    unsigned int numReused=0;       ///< Number of files from the previous image
 };
@@ -37,7 +37,27 @@ static void fs_test_4();
 static void fs_test_5();
 static void fs_test_6();
 static void fs_test_7();
+static void fs_test_8();
+static void fs_test_12();
+static void fs_test_13();
+#ifndef IN_PROCESS
+#if defined(WITH_FATFS) && defined(WITH_DEVFS)
+static void fs_test_13_fsinfo(unsigned long long freeBlocks);
+#endif
+static void fs_test_9();
+#ifdef FAT32_WRITE_BACK
+static void fs_test_10();
+#endif
+#ifdef WITH_FATFS
+static void fs_test_11();
+static void fs_bench_writers();
+#endif
+#endif
 static void sys_test_pipe();
+static void sys_test_poll();
+#ifndef IN_PROCESS
+static void sys_bench_pipe();
+#endif
 #endif //WITH_FILESYSTEM
 static void sys_test_time();
 static void sys_test_getpid();
@@ -46,6 +66,9 @@ static void sys_test_isatty();
 static void sys_test_spawn();
 #ifdef IN_PROCESS
 static void proc_test_global_ctor_dtor();
+static void proc_test_syscall_ring();
+#else
+static void sys_bench_spawn();
 #endif
 #endif
 
@@ -62,7 +85,24 @@ void test_syscalls()
     fs_test_5();
     fs_test_6();
     fs_test_7();
+    fs_test_8();
+    fs_test_12();
+    fs_test_13();
+    #ifndef IN_PROCESS
+    fs_test_9();
+    #ifdef FAT32_WRITE_BACK
+    fs_test_10();
+    #endif
+    #ifdef WITH_FATFS
+    fs_test_11();
+    fs_bench_writers();
+    #endif
+    #endif
     sys_test_pipe();
+    sys_test_poll();
+    #ifndef IN_PROCESS
+    sys_bench_pipe();
+    #endif
     #else //WITH_FILESYSTEM
     iprintf("Filesystem tests skipped, filesystem support is disabled\n");
     #endif //WITH_FILESYSTEM
@@ -73,6 +113,9 @@ void test_syscalls()
     sys_test_spawn();
     #ifdef IN_PROCESS
     proc_test_global_ctor_dtor();
+    proc_test_syscall_ring();
+    #else
+    sys_bench_spawn();
     #endif
     #endif
     #ifndef IN_PROCESS
@@ -980,6 +1023,460 @@ static void fs_test_7()
     pass();
 }
 
+//
+// Filesystem test 8
+//
+/*
+tests:
+pread
+pwrite
+readv
+writev
+*/
+
+static void fs_test_8()
+{
+    test_name("pread/pwrite/readv/writev");
+    const char name[]="/sd/preadtest.txt";
+    unlink(name);
+    int fd=open(name,O_RDWR|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    char buf[64];
+    for(unsigned int i=0;i<sizeof(buf);i++) buf[i]=i;
+    if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    //Positional I/O must not move the file pointer
+    if(lseek(fd,10,SEEK_SET)!=10) fail("lseek");
+    char c[4]={'a','b','c','d'};
+    if(pwrite(fd,c,sizeof(c),40)!=sizeof(c)) fail("pwrite");
+    char rd[8];
+    if(pread(fd,rd,sizeof(rd),38)!=sizeof(rd)) fail("pread");
+    if(rd[0]!=38 || rd[1]!=39 || memcmp(rd+2,c,sizeof(c))!=0 || rd[6]!=44)
+        fail("pread content");
+    if(lseek(fd,0,SEEK_CUR)!=10) fail("file pointer moved");
+    if(pread(fd,rd,sizeof(rd),sizeof(buf))!=0) fail("pread past end");
+    if(pread(fd,rd,sizeof(rd),-1)!=-1 || errno!=EINVAL) fail("pread negative");
+    #if __has_include(<sys/uio.h>)
+    //Vectored I/O does move the file pointer
+    char a[3], b[5];
+    struct iovec iov[]={{a,sizeof(a)},{b,sizeof(b)}};
+    if(readv(fd,iov,2)!=sizeof(a)+sizeof(b)) fail("readv");
+    if(a[0]!=10 || a[2]!=12 || b[0]!=13 || b[4]!=17) fail("readv content");
+    if(lseek(fd,0,SEEK_CUR)!=18) fail("readv file pointer");
+    a[0]=b[4]='x';
+    if(lseek(fd,0,SEEK_SET)!=0) fail("lseek");
+    if(writev(fd,iov,2)!=sizeof(a)+sizeof(b)) fail("writev");
+    if(pread(fd,rd,sizeof(rd),0)!=sizeof(rd)) fail("pread");
+    if(rd[0]!='x' || rd[1]!=11 || rd[3]!=13 || rd[7]!='x') fail("writev content");
+    #endif //__has_include(<sys/uio.h>)
+    close(fd);
+    //Pipes do not support positional I/O
+    int fds[2];
+    if(pipe(fds)!=0) fail("pipe");
+    if(pwrite(fds[1],c,sizeof(c),0)!=-1 || errno!=ESPIPE) fail("pwrite pipe");
+    close(fds[0]);
+    close(fds[1]);
+    pass();
+}
+
+//
+// fallocate test
+//
+/*
+tests:
+posix_fallocate
+fallocate
+*/
+
+static void fs_test_12()
+{
+    test_name("fallocate");
+    const char name[]="/sd/alloctest.bin";
+    unlink(name);
+    int fd=open(name,O_RDWR|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    char buf[64];
+    memset(buf,'a',sizeof(buf));
+    if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    int result=fallocate(fd,FALLOC_FL_KEEP_SIZE,0,65536);
+    //Not all filesystems support it, but if they do it has to work correctly
+    if(result==0)
+    {
+        struct stat st;
+        if(fstat(fd,&st)!=0 || st.st_size!=sizeof(buf)) fail("keep size");
+        for(int i=0;i<64;i++)
+            if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write reserved");
+        if(fstat(fd,&st)!=0 || st.st_size!=65*sizeof(buf)) fail("size");
+        //posix_fallocate extends the file with zeros
+        if(posix_fallocate(fd,0,8192)!=0) fail("posix_fallocate");
+        if(fstat(fd,&st)!=0 || st.st_size!=8192) fail("size");
+        if(pread(fd,buf,sizeof(buf),8192-sizeof(buf))!=sizeof(buf)) fail("pread");
+        for(unsigned int i=0;i<sizeof(buf);i++) if(buf[i]!=0) fail("zero fill");
+        if(pread(fd,buf,sizeof(buf),64*sizeof(buf))!=sizeof(buf)
+            || buf[0]!='a') fail("pread");
+        //Allocating storage that already exists does nothing
+        if(posix_fallocate(fd,0,100)!=0) fail("posix_fallocate");
+        if(fstat(fd,&st)!=0 || st.st_size!=8192) fail("size");
+    } else if(errno!=EOPNOTSUPP) fail("fallocate");
+    if(fallocate(fd,0x100,0,512)!=-1 || errno!=EOPNOTSUPP) fail("bad mode");
+    if(posix_fallocate(fd,-1,512)!=EINVAL) fail("negative offset");
+    if(posix_fallocate(fd,0,0)!=EINVAL) fail("zero len");
+    close(fd);
+    if(posix_fallocate(fd,0,512)!=EBADF) fail("closed fd");
+    if(unlink(name)!=0) fail("unlink");
+    pass();
+}
+
+//
+// statfs test
+//
+/*
+tests:
+statfs
+*/
+
+static void fs_test_13()
+{
+    test_name("statfs");
+    struct statfs sf;
+    if(statfs("/",&sf)!=0) fail("statfs (root)");
+    if(statfs("/sd/nonexistent",&sf)!=-1 || errno!=ENOENT) fail("ENOENT");
+    if(statfs("/sd",&sf)!=0) fail("statfs");
+    //Filesystems that do not track space return zero blocks
+    if(sf.f_blocks!=0)
+    {
+        if(sf.f_bsize<=0 || sf.f_bfree>sf.f_blocks || sf.f_bavail>sf.f_bfree)
+            fail("values");
+        //Free space has to follow allocations
+        const char name[]="/sd/statfstest.bin";
+        unlink(name);
+        unsigned long long freeBlocks=sf.f_bfree;
+        int fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0666);
+        if(fd<0) fail("open");
+        char buf[512];
+        memset(buf,0,sizeof(buf));
+        for(long i=0;i<2*sf.f_bsize;i+=sizeof(buf))
+            if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+        close(fd);
+        if(statfs(name,&sf)!=0 || sf.f_bfree!=freeBlocks-2) fail("allocate");
+        if(unlink(name)!=0) fail("unlink");
+        if(statfs("/sd",&sf)!=0 || sf.f_bfree!=freeBlocks) fail("free");
+        #if !defined(IN_PROCESS) && defined(WITH_FATFS) && defined(WITH_DEVFS)
+        if(FAT32_FSINFO_POLICY==1) fs_test_13_fsinfo(freeBlocks);
+        #endif
+    }
+    pass();
+}
+
+#if !defined(IN_PROCESS) && defined(WITH_FATFS) && defined(WITH_DEVFS)
+const unsigned int fs_t13_fat1Clean=0x08000000; //Clean shutdown flag in FAT[1]
+
+static unsigned int fs_t13_get(int fd, off_t offset)
+{
+    unsigned int x;
+    if(pread(fd,&x,sizeof(x),offset)!=sizeof(x)) fail("pread (disk)");
+    return fromLittleEndian32(x);
+}
+
+static void fs_t13_set(int fd, off_t offset, unsigned int x)
+{
+    x=toLittleEndian32(x);
+    if(pwrite(fd,&x,sizeof(x),offset)!=sizeof(x)) fail("pwrite (disk)");
+}
+
+static void fs_t13_mount(int fd)
+{
+    intrusive_ref_ptr<Fat32Fs> fs(new Fat32Fs(getFileDescriptorTable().getFile(fd)));
+    if(fs->mountFailed()) fail("mount");
+    if(FilesystemManager::instance().kmount("/sd",fs)!=0) fail("kmount");
+}
+
+/**
+ * Check that after an unclean shutdown the FSInfo free cluster count is
+ * not trusted, but it is trusted again after a clean unmount
+ * \param freeBlocks free clusters in /sd
+ */
+static void fs_test_13_fsinfo(unsigned long long freeBlocks)
+{
+    int fd=open("/dev/sda",O_RDWR);
+    if(fd<0) fail("open disk");
+    //Locate the volume, either at the start of the disk or in the first
+    //partition, and skip the test if it is not FAT32
+    unsigned char sector[512];
+    if(pread(fd,sector,sizeof(sector),0)!=sizeof(sector)) fail("pread (disk)");
+    off_t base=0;
+    if(memcmp(sector+82,"FAT",3)!=0 && memcmp(sector+54,"FAT",3)!=0)
+    {
+        base=sector[454] | sector[455]<<8 | sector[456]<<16 | sector[457]<<24;
+        if(pread(fd,sector,sizeof(sector),base*512)!=sizeof(sector))
+            fail("pread (disk)");
+    }
+    if(memcmp(sector+82,"FAT32",5)!=0) { close(fd); return; }
+    off_t fat1=(base+(sector[14] | sector[15]<<8))*512+4;
+    //FAT[1] in the second FAT copy, if any, which has to match the first one
+    off_t fatSize=sector[36] | sector[37]<<8 | sector[38]<<16 | sector[39]<<24;
+    off_t fat1Copy=sector[16]==2 ? fat1+fatSize*512 : fat1;
+    off_t freeCount=(base+1)*512+488; //FSInfo sector, free cluster count
+
+    //Simulate an unclean shutdown, with a wrong free count in FSInfo
+    FilesystemManager& fsm=FilesystemManager::instance();
+    if(fsm.umount("/sd")!=0) fail("umount");
+    unsigned int flags=fs_t13_get(fd,fat1);
+    if((flags & fs_t13_fat1Clean)==0) fail("clean flag");
+    if(fs_t13_get(fd,fat1Copy)!=flags) fail("clean flag (FAT copy)");
+    fs_t13_set(fd,fat1,flags & ~fs_t13_fat1Clean);
+    fs_t13_set(fd,fat1Copy,flags & ~fs_t13_fat1Clean);
+    fs_t13_set(fd,freeCount,0);
+    //The free count is not trusted, but it is fixed at the next unmount
+    fs_t13_mount(fd);
+    struct statfs sf;
+    if(statfs("/sd",&sf)!=0 || sf.f_bfree!=freeBlocks) fail("dirty mount");
+    if(fsm.umount("/sd")!=0) fail("umount");
+    if((fs_t13_get(fd,fat1) & fs_t13_fat1Clean)==0) fail("clean flag (dirty)");
+    if(fs_t13_get(fd,fat1Copy)!=fs_t13_get(fd,fat1)) fail("FAT copy (dirty)");
+    if(fs_t13_get(fd,freeCount)!=freeBlocks) fail("FSInfo not updated");
+    //Now it is trusted, and the clean flag is cleared until unmount
+    fs_t13_mount(fd);
+    if(fs_t13_get(fd,fat1) & fs_t13_fat1Clean) fail("FSInfo not trusted");
+    if(fs_t13_get(fd,fat1Copy) & fs_t13_fat1Clean) fail("FAT copy (clean)");
+    if(statfs("/sd",&sf)!=0 || sf.f_bfree!=freeBlocks) fail("clean mount");
+    close(fd);
+}
+#endif
+
+#ifndef IN_PROCESS
+//
+// Block cache test
+//
+/*
+tests:
+BlockCache
+*/
+
+static void fs_test_9()
+{
+    test_name("block cache");
+    const char name[]="/sd/cachetest.bin";
+    unlink(name);
+    int fd=open(name,O_RDWR|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    const int blocks=32;
+    char buf[512];
+    for(int i=0;i<blocks;i++)
+    {
+        memset(buf,i,sizeof(buf));
+        if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    }
+    {
+        //Any file can be used as the disk, with 8 blocks reads and writes are
+        //done two blocks at a time
+        intrusive_ref_ptr<FileBase> cache(
+            new BlockCache(getFileDescriptorTable().getFile(fd),8));
+        for(int i=0;i<blocks;i++)
+        {
+            if(cache->pread(buf,sizeof(buf),i*512)!=sizeof(buf)) fail("pread");
+            if(buf[0]!=i || buf[511]!=i) fail("pread content");
+        }
+        BlockCacheStats st;
+        if(cache->ioctl(IOCTL_BLOCK_CACHE_STATS,&st)!=0) fail("stats");
+        if(st.misses!=blocks/2 || st.readAhead!=blocks/2 || st.hits!=blocks/2
+            || st.diskReads!=blocks/2) fail("read-ahead");
+        //Writes reach the disk only when synced, coalesced
+        memset(buf,'x',sizeof(buf));
+        for(int i=4;i<8;i++)
+            if(cache->pwrite(buf,sizeof(buf),i*512)!=sizeof(buf)) fail("pwrite");
+        if(cache->pwrite(buf,1,20*512+100)!=1) fail("pwrite (partial)");
+        char rd[512];
+        if(pread(fd,rd,sizeof(rd),4*512)!=sizeof(rd) || rd[0]!=4)
+            fail("write-back");
+        if(cache->ioctl(IOCTL_SYNC,nullptr)!=0) fail("sync");
+        if(pread(fd,rd,sizeof(rd),4*512)!=sizeof(rd) || rd[0]!='x')
+            fail("sync content");
+        if(pread(fd,rd,sizeof(rd),20*512)!=sizeof(rd) || rd[99]!=20
+            || rd[100]!='x' || rd[101]!=20) fail("sync content (partial)");
+        if(cache->ioctl(IOCTL_BLOCK_CACHE_STATS,&st)!=0) fail("stats");
+        if(st.blocksWritten!=5 || st.diskWrites!=3) fail("coalescing");
+    }
+    close(fd);
+    if(unlink(name)!=0) fail("unlink");
+    pass();
+}
+
+#ifdef FAT32_WRITE_BACK
+//
+// Fat32 write-back test
+//
+/*
+tests:
+Fat32Fs write-back
+*/
+
+static void fs_test_10()
+{
+    test_name("Fat32 write-back");
+    const char name[]="/sd/wbtest.txt";
+    unlink(name);
+    int fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    //The size in the directory entry is updated only when the file is synced
+    char buf[512];
+    memset(buf,'w',sizeof(buf));
+    struct stat st;
+    if(write(fd,buf,16)!=16) fail("write");
+    if(stat(name,&st)!=0 || st.st_size!=0) fail("write-back");
+    if(getFileDescriptorTable().ioctl(fd,IOCTL_SYNC,nullptr)!=0) fail("ioctl");
+    if(stat(name,&st)!=0 || st.st_size!=16) fail("sync");
+    //The flusher syncs the file within the interval
+    if(write(fd,buf,16)!=16) fail("write");
+    long long deadline=getTime()+2*FAT32_WRITE_BACK_INTERVAL;
+    while(stat(name,&st)==0 && st.st_size!=32 && getTime()<deadline)
+        Thread::sleep(10);
+    if(st.st_size!=32) fail("interval");
+    //Or earlier if enough data is written
+    long long start=getTime();
+    for(unsigned int i=0;i<FAT32_WRITE_BACK_BYTES;i+=sizeof(buf))
+        if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    off_t size=32+(FAT32_WRITE_BACK_BYTES+sizeof(buf)-1)/sizeof(buf)*sizeof(buf);
+    while(stat(name,&st)==0 && st.st_size!=size
+        && getTime()-start<FAT32_WRITE_BACK_INTERVAL/2) Thread::sleep(10);
+    if(st.st_size!=size) fail("byte threshold");
+    close(fd);
+    if(unlink(name)!=0) fail("unlink");
+    pass();
+}
+#endif //FAT32_WRITE_BACK
+
+#ifdef WITH_FATFS
+//
+// Fat32 fast seek test
+//
+/*
+tests:
+Fat32File cluster map
+*/
+
+static void fs_test_11()
+{
+    test_name("Fat32 fast seek");
+    const char name[]="/sd/seektest.bin";
+    unlink(name);
+    int fd=open(name,O_RDWR|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    //Files spanning many clusters, each block filled with its number
+    const int blocks=256;
+    unsigned int buf[128];
+    for(int i=0;i<blocks;i++)
+    {
+        for(auto& x : buf) x=i;
+        if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    }
+    auto& fdt=getFileDescriptorTable();
+    int result=fdt.ioctl(fd,IOCTL_FAT32_FASTSEEK,nullptr);
+    //Skip if /sd is not a FATFS partition
+    if(result!=-ENOTTY)
+    {
+        if(result!=0) fail("cluster map");
+        for(int i=0;i<blocks;i++)
+        {
+            int j=(i*97)%blocks; //Jump back and forth
+            if(lseek(fd,j*sizeof(buf)+4,SEEK_SET)!=j*sizeof(buf)+4)
+                fail("lseek");
+            if(read(fd,buf,sizeof(buf[0]))!=sizeof(buf[0]) || buf[0]!=j)
+                fail("read");
+        }
+        //Overwriting does not invalidate the map, appending does
+        for(auto& x : buf) x=0xffffffff;
+        if(pwrite(fd,buf,sizeof(buf),10*sizeof(buf))!=sizeof(buf))
+            fail("pwrite");
+        if(lseek(fd,0,SEEK_END)!=blocks*sizeof(buf)) fail("lseek");
+        for(int i=0;i<64;i++)
+            if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("append");
+        if(pread(fd,buf,sizeof(buf),(blocks+63)*sizeof(buf))!=sizeof(buf)
+            || buf[0]!=0xffffffff) fail("read appended");
+        if(pread(fd,buf,sizeof(buf),10*sizeof(buf))!=sizeof(buf)
+            || buf[0]!=0xffffffff) fail("read overwritten");
+        if(pread(fd,buf,sizeof(buf),200*sizeof(buf))!=sizeof(buf)
+            || buf[0]!=200) fail("read after append");
+    }
+    close(fd);
+    if(unlink(name)!=0) fail("unlink");
+    pass();
+}
+
+//
+// Concurrent writers benchmark
+//
+/*
+tests:
+Fat32 per-file locking
+*/
+
+static void fs_bench_writers_thread(const char *name, char c, int blockSize,
+                                    int total)
+{
+    int fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd<0) fail("open");
+    char *buf=new char[blockSize];
+    memset(buf,c,blockSize);
+    for(int i=0;i<total;i+=blockSize)
+        if(write(fd,buf,blockSize)!=blockSize) fail("write");
+    delete[] buf;
+    if(close(fd)!=0) fail("close");
+}
+
+static void fs_bench_writers_check(const char *name, char c, int total)
+{
+    int fd=open(name,O_RDONLY);
+    if(fd<0) fail("open");
+    char buf[512];
+    for(int i=0;i<total;i+=sizeof(buf))
+    {
+        if(read(fd,buf,sizeof(buf))!=sizeof(buf)) fail("read");
+        for(auto x : buf) if(x!=c) fail("content");
+    }
+    close(fd);
+}
+
+static void fs_bench_writers()
+{
+    test_name("Fat32 concurrent writers");
+    const char name0[]="/sd/writer0.bin";
+    const char name1[]="/sd/writer1.bin";
+    const int total=1024*1024, blockSize=4096;
+    //Writing the two files one after the other, then at the same time
+    long long t=getTime();
+    fs_bench_writers_thread(name0,'a',blockSize,total);
+    fs_bench_writers_thread(name1,'b',blockSize,total);
+    long long serial=getTime()-t;
+    t=getTime();
+    std::thread th(fs_bench_writers_thread,name1,'d',blockSize,total);
+    fs_bench_writers_thread(name0,'c',blockSize,total);
+    th.join();
+    long long parallel=getTime()-t;
+    fs_bench_writers_check(name0,'c',total);
+    fs_bench_writers_check(name1,'d',total);
+    iprintf("Two writers, serial %lldKB/s concurrent %lldKB/s\n",
+        2LL*total*1000000000/serial/1024,2LL*total*1000000000/parallel/1024);
+    //Latency of small reads of a file while another is written in large blocks
+    int fd=open(name0,O_RDONLY);
+    if(fd<0) fail("open");
+    th=std::thread(fs_bench_writers_thread,name1,'e',64*1024,total);
+    long long maxLatency=0;
+    char buf[512];
+    for(int i=0;i<total;i+=sizeof(buf))
+    {
+        t=getTime();
+        if(read(fd,buf,sizeof(buf))!=sizeof(buf)) fail("read");
+        maxLatency=std::max(maxLatency,getTime()-t);
+    }
+    th.join();
+    close(fd);
+    iprintf("Max read latency during 64KB writes %lldus\n",maxLatency/1000);
+    if(unlink(name0)!=0 || unlink(name1)!=0) fail("unlink");
+    pass();
+}
+#endif //WITH_FATFS
+#endif //IN_PROCESS
+
 //
 // Pipe test
 //
@@ -1049,6 +1546,35 @@ static void sys_test_pipe_tryLargeReadAndWrite(size_t rdSz, size_t wrSz)
 }
 #endif
 
+static void sys_test_pipe_capacity()
+{
+    int fds[2];
+    if(pipe(fds)!=0) fail("pipe");
+    if(fcntl(fds[0],F_GETPIPE_SZ)<=0) fail("F_GETPIPE_SZ");
+    if(fcntl(fds[1],F_SETPIPE_SZ,1024)!=1024) fail("F_SETPIPE_SZ");
+    if(fcntl(fds[0],F_GETPIPE_SZ)!=1024) fail("F_GETPIPE_SZ (2)");
+    //Reads and writes crossing the end of the ring buffer
+    char buf[1024];
+    for(unsigned int i=0;i<sizeof(buf);i++) buf[i]=i;
+    if(write(fds[1],buf,700)!=700) fail("write (1)");
+    char rd[1024];
+    if(read(fds[0],rd,500)!=500 || memcmp(rd,buf,500)!=0) fail("read (1)");
+    if(write(fds[1],buf+700,324)!=324) fail("write (2)");
+    if(write(fds[1],buf,500)!=500) fail("write (3)");
+    //The pipe is full and cannot shrink below the data it contains
+    if(fcntl(fds[1],F_SETPIPE_SZ,512)!=-1 || errno!=EBUSY) fail("EBUSY");
+    if(read(fds[0],rd,sizeof(rd))!=1024) fail("read (2)");
+    if(memcmp(rd,buf+500,524)!=0 || memcmp(rd+524,buf,500)!=0)
+        fail("read data not matching");
+    if(fcntl(fds[1],F_SETPIPE_SZ,0)!=-1 || errno!=EINVAL) fail("EINVAL");
+    //Wrong direction
+    if(write(fds[0],buf,1)!=-1 || errno!=EBADF) fail("write to read end");
+    //Closing the write end causes end of file for the reader
+    if(close(fds[1])!=0) fail("close (write end)");
+    if(read(fds[0],rd,1)!=0) fail("end of file");
+    if(close(fds[0])!=0) fail("close (read end)");
+}
+
 static void sys_test_pipe()
 {
     test_name("pipes");
@@ -1091,6 +1617,138 @@ static void sys_test_pipe()
     sys_test_pipe_tryLargeReadAndWrite(512, 100);
     #endif
 
+    sys_test_pipe_capacity();
+
+    pass();
+}
+
+#ifndef IN_PROCESS
+static void sys_bench_pipe_source(int wrFd, int blockSize, int total)
+{
+    char *buf=new char[blockSize];
+    memset(buf,0,blockSize);
+    for(int i=0;i<total;i+=blockSize)
+        if(write(wrFd,buf,blockSize)!=blockSize) fail("write");
+    delete[] buf;
+    if(close(wrFd)!=0) fail("close (write end)");
+}
+
+static void sys_bench_pipe_echo(int rdFd, int wrFd)
+{
+    char c;
+    while(read(rdFd,&c,1)==1) if(write(wrFd,&c,1)!=1) fail("write");
+    if(close(rdFd)!=0 || close(wrFd)!=0) fail("close (echo)");
+}
+
+static void sys_bench_pipe()
+{
+    test_name("pipe throughput and latency");
+    const int total=256*1024;
+    for(int capacity : {256,4096})
+    {
+        for(int blockSize : {16,256,4096})
+        {
+            int fds[2];
+            if(pipe(fds)!=0) fail("pipe");
+            if(fcntl(fds[1],F_SETPIPE_SZ,capacity)!=capacity)
+                fail("F_SETPIPE_SZ");
+            char *buf=new char[blockSize];
+            long long t=getTime();
+            std::thread th(sys_bench_pipe_source,fds[1],blockSize,total);
+            int received=0;
+            for(;;)
+            {
+                ssize_t r=read(fds[0],buf,blockSize);
+                if(r<0) fail("read");
+                if(r==0) break;
+                received+=r;
+            }
+            th.join();
+            t=getTime()-t;
+            delete[] buf;
+            if(close(fds[0])!=0) fail("close (read end)");
+            if(received!=total) fail("received size");
+            iprintf("Capacity %4d block %4d: %lldKB/s\n",capacity,blockSize,
+                static_cast<long long>(total)*1000000000/t/1024);
+        }
+    }
+    //Round trip latency of a single byte between two threads
+    const int iterations=1000;
+    int ping[2], pong[2];
+    if(pipe(ping)!=0 || pipe(pong)!=0) fail("pipe");
+    std::thread th(sys_bench_pipe_echo,ping[0],pong[1]);
+    long long t=getTime();
+    for(int i=0;i<iterations;i++)
+    {
+        char c=i;
+        if(write(ping[1],&c,1)!=1) fail("write");
+        if(read(pong[0],&c,1)!=1 || c!=static_cast<char>(i)) fail("read");
+    }
+    t=getTime()-t;
+    if(close(ping[1])!=0) fail("close (ping)");
+    th.join();
+    if(close(pong[0])!=0) fail("close (pong)");
+    iprintf("Round trip latency %lldns\n",t/iterations);
+    pass();
+}
+#endif
+
+//
+// Poll test
+//
+/*
+tests:
+poll
+*/
+
+#ifndef IN_PROCESS
+static void sys_test_poll_thread(int wrFd)
+{
+    Thread::sleep(50);
+    if(write(wrFd,"x",1)!=1) fail("write");
+}
+#endif
+
+static void sys_test_poll()
+{
+    test_name("poll");
+    int fds[2];
+    if(pipe(fds)!=0) fail("pipe");
+    struct pollfd p[3];
+    p[0].fd=fds[0];
+    p[0].events=POLLIN;
+    p[1].fd=fds[1];
+    p[1].events=POLLOUT;
+    p[2].fd=-1; //Negative fds are ignored
+    p[2].events=POLLIN;
+    //An empty pipe is only writable
+    if(poll(p,3,0)!=1) fail("poll (1)");
+    if(p[0].revents!=0 || p[1].revents!=POLLOUT || p[2].revents!=0)
+        fail("revents (1)");
+    //Timeout
+    if(poll(p,1,20)!=0 || p[0].revents!=0) fail("poll timeout");
+    if(write(fds[1],"a",1)!=1) fail("write");
+    if(poll(p,3,-1)!=2) fail("poll (2)");
+    if(p[0].revents!=POLLIN || p[1].revents!=POLLOUT) fail("revents (2)");
+    char c;
+    if(read(fds[0],&c,1)!=1 || c!='a') fail("read");
+    #ifndef IN_PROCESS
+    //Blocking poll woken by a write from another thread
+    std::thread t(sys_test_poll_thread,fds[1]);
+    if(poll(p,1,1000)!=1 || p[0].revents!=POLLIN) fail("poll wakeup");
+    t.join();
+    if(read(fds[0],&c,1)!=1 || c!='x') fail("read");
+    #endif
+    //Closed file descriptors are reported as invalid
+    int closedFd=dup(fds[0]);
+    if(closedFd<0) fail("dup");
+    if(close(closedFd)!=0) fail("close (1)");
+    p[2].fd=closedFd;
+    if(poll(p+2,1,0)!=1 || p[2].revents!=POLLNVAL) fail("poll POLLNVAL");
+    //Closing the other end of the pipe causes a hangup
+    if(close(fds[1])!=0) fail("close (2)");
+    if(poll(p,1,0)!=1 || (p[0].revents & POLLHUP)==0) fail("poll POLLHUP");
+    if(close(fds[0])!=0) fail("close (3)");
     pass();
 }
 
@@ -1376,7 +2034,54 @@ static void sys_test_spawn()
     pass();
 }
 
-#ifdef IN_PROCESS
+#ifndef IN_PROCESS
+
+//
+// Process spawn latency benchmark
+//
+
+static void sys_bench_spawn()
+{
+    test_name("process spawn latency");
+    const char *arg[] = { "/bin/test_process", "exit_123", nullptr };
+    const char *env[] = { nullptr };
+    const int iterations=16;
+    long long spawnSum=0, validateSum=0, relocateSum=0, zeroSum=0;
+    //The first spawn may need to load and relocate the program from scratch,
+    //so it is reported separately
+    for(int i=0;i<=iterations;i++)
+    {
+        pid_t pid;
+        long long t=getTime();
+        int ec=posix_spawn(&pid,arg[0],NULL,NULL,(char* const*)arg,(char* const*)env);
+        long long spawnTime=getTime()-t;
+        if(ec!=0) fail("posix_spawn");
+        SpawnTimes times=getLastSpawnTimes();
+        int pstat;
+        if(waitpid(pid,&pstat,0)!=pid) fail("waitpid");
+        if(!WIFEXITED(pstat) || WEXITSTATUS(pstat)!=123) fail("exit status");
+        if(i==0)
+        {
+            iprintf("First spawn %lldus (validate %lldus relocate %lldus zero %lldus)\n",
+                spawnTime/1000,times.validate/1000,times.relocate/1000,
+                times.zero/1000);
+            continue;
+        }
+        spawnSum+=spawnTime;
+        validateSum+=times.validate;
+        relocateSum+=times.relocate;
+        zeroSum+=times.zero;
+    }
+    iprintf("Average spawn %lldus (validate %lldus relocate %lldus zero %lldus)\n",
+        spawnSum/iterations/1000,validateSum/iterations/1000,
+        relocateSum/iterations/1000,zeroSum/iterations/1000);
+    ProcessPoolZeroingStats zs=ProcessPool::instance().getZeroingStats();
+    iprintf("Zeroed process images: %u clean, %u zeroed synchronously\n",
+        zs.cleanHits,zs.syncZeroed);
+    pass();
+}
+
+#else // IN_PROCESS
 
 //
 // Process global constructor/destructor
@@ -1414,6 +2119,72 @@ static void proc_test_global_ctor_dtor()
     pass();
 }
 
+//
+// Batched syscalls
+//
+
+static long long proc_ring_time()
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return static_cast<long long>(tp.tv_sec)*1000000000LL+tp.tv_nsec;
+}
+
+static void proc_test_syscall_ring()
+{
+    using namespace miosix;
+    test_name("Batched syscalls");
+    int fd=open("/dev/null",O_RDWR);
+    if(fd<0) fail("open");
+    const int ringSize=32;
+    SyscallRingEntry entries[ringSize];
+    SyscallRing ring(entries,ringSize);
+    char buf[16]="0123456789abcde";
+    struct stat st;
+    SyscallRingEntry *e1=ring.queueWrite(fd,buf,sizeof(buf));
+    SyscallRingEntry *e2=ring.queueLseek(fd,0,SEEK_CUR);
+    SyscallRingEntry *e3=ring.queueFstat(fd,&st);
+    SyscallRingEntry *e4=ring.queueGetTime();
+    SyscallRingEntry *e5=ring.queueRead(-1,buf,sizeof(buf));
+    if(!e1 || !e2 || !e3 || !e4 || !e5) fail("queue");
+    if(ring.pending()!=5) fail("pending");
+    if(ring.submit()!=5) fail("submit");
+    if(ring.pending()!=0) fail("pending after submit");
+    if(e1->result!=sizeof(buf)) fail("write");
+    if(e2->result<0) fail("lseek");
+    if(e3->result!=0 || !S_ISCHR(st.st_mode)) fail("fstat");
+    if(e4->result<=0) fail("getTime");
+    if(e5->result!=-EBADF) fail("read from bad fd");
+    //Full ring
+    for(int i=0;i<ringSize;i++)
+        if(ring.queueWrite(fd,buf,sizeof(buf))==nullptr) fail("queue");
+    if(ring.queueWrite(fd,buf,sizeof(buf))!=nullptr) fail("ring overflow");
+    if(ring.submit()!=ringSize) fail("submit full ring");
+    for(int i=0;i<ringSize;i++)
+        if(entries[i].result!=sizeof(buf)) fail("write");
+    //Invalid ring size
+    SyscallRing badRing(entries,3);
+    badRing.queueGetTime();
+    if(badRing.submit()!=-1 || errno!=EINVAL) fail("bad ring size");
+
+    //Benchmark, per-call versus batched throughput
+    const int iterations=1024;
+    long long t1=proc_ring_time();
+    for(int i=0;i<iterations;i++)
+        if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    long long t2=proc_ring_time();
+    for(int i=0;i<iterations;i+=ringSize)
+    {
+        for(int j=0;j<ringSize;j++) ring.queueWrite(fd,buf,sizeof(buf));
+        if(ring.submit()!=ringSize) fail("submit");
+    }
+    long long t3=proc_ring_time();
+    iprintf("%d writes: per-call %lldns/op, batched %lldns/op\n",iterations,
+        (t2-t1)/iterations,(t3-t2)/iterations);
+    close(fd);
+    pass();
+}
+
 #endif // IN_PROCESS
 
 #endif // WITH_PROCESSES
@@ -46,8 +46,26 @@
 #include <sys/times.h>
 #include <spawn.h>
 #include <sys/wait.h>
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#endif
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031
+#endif
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ 1032
+#endif
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+extern "C" int posix_fallocate(int fd, off_t offset, off_t len);
+extern "C" int fallocate(int fd, int mode, off_t offset, off_t len);
+#include "../../libsyscalls/statfs.h"
+#include "../../libsyscalls/poll.h"
 #ifndef IN_PROCESS
 #include <thread>
+#else
+#include "../../libsyscalls/syscall_ring.h"
 #endif
 
 int spawnAndWait(const char *arg[]);
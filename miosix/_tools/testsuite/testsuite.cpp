@@ -59,7 +59,14 @@
 #include "interfaces/poweroff.h"
 #include "interfaces/bsp.h"
 #include "e20/e20.h"
+#include "e20/executor.h"
 #include "kernel/intrusive.h"
+#include "kernel/elf_program.h"
+#include "kernel/process_pool.h"
+#include "filesystem/file_access.h"
+#include "filesystem/ioctl.h"
+#include "filesystem/blockcache/block_cache.h"
+#include "filesystem/fat32/fat32.h"
 #include "util/crc16.h"
 
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
@@ -2706,6 +2713,8 @@ tests:
 class Callback
 class EventQueue
 class FixedEventQueue
+class PooledEventQueue
+class Executor
 */
 
 int t20_v1;
@@ -2782,8 +2791,122 @@ void t20_t2(void* arg)
     Thread::sleep(10);
     eq->post(thrower);
 }
+
+void t20_t3(void* arg)
+{
+    PooledEventQueue<> *eq=reinterpret_cast<PooledEventQueue<>*>(arg);
+    t20_v1=0;
+    eq->post(t20_f1);
+    Thread::sleep(10);
+    if(t20_v1!=1234) fail("Not called");
+
+    t20_v1=0;
+    eq->post(t20_f1);
+    {
+        FastInterruptDisableLock dLock;
+        if(eq->IRQpost(bind(t20_f2,5,6))==false) fail("IRQpost");
+    }
+    Thread::sleep(10);
+    if(t20_v1!=11) fail("Not called");
+
+    eq->post(thrower);
+}
+
+int t20_v2;
+
+void t20_f3()
+{
+    t20_v2++;
+}
+
+template<typename Q>
+void t20_timed(Q& eq)
+{
+    t20_v1=0;
+    t20_v2=0;
+    long long start=getTime();
+    //Posted out of order, to check they are run by deadline
+    eq.postAfter(20000000,t20_f1);
+    eq.postAt(start+10000000,bind(t20_f2,1,1));
+    eq.postPeriodic(5000000,t20_f3);
+    eq.postAt(start+50000000,thrower);
+    if(eq.timedSize()!=4 || eq.empty()==false) fail("timedSize");
+    eq.runOne(); //Nothing is due yet
+    if(t20_v1!=0 || t20_v2!=0) fail("Too early");
+    try {
+        eq.run();
+        fail("run() returned");
+    } catch(int i) {
+        if(i!=5) fail("Wrong");
+    }
+    long long elapsed=getTime()-start;
+    if(elapsed<50000000 || elapsed>60000000) fail("Timed event deadline");
+    if(t20_v1!=1234) fail("Timed event ordering");
+    if(t20_v2<8 || t20_v2>10) fail("Periodic event");
+    if(eq.timedSize()!=1) fail("Periodic event removed");
+}
+
+int t20_running;
+bool t20_overlap;
+
+void t20_f5()
+{
+    {
+        FastInterruptDisableLock dLock;
+        if(++t20_running>1) t20_overlap=true;
+    }
+    Thread::sleep(12); //Longer than the period
+    FastInterruptDisableLock dLock;
+    t20_running--;
+    t20_v2++;
+}
+
+template<typename Q>
+void t20_runner(void *arg)
+{
+    try {
+        reinterpret_cast<Q*>(arg)->run();
+    } catch(int) {}
+}
+
+template<typename Q>
+void t20_periodic(Q& eq)
+{
+    t20_v2=0;
+    t20_running=0;
+    t20_overlap=false;
+    long long start=getTime();
+    eq.postPeriodic(5000000,t20_f5);
+    //One thrower for each thread calling run()
+    eq.postAt(start+60000000,thrower);
+    eq.postAt(start+60000000,thrower);
+    //Throwing needs more stack
+    Thread *t=Thread::create(t20_runner<Q>,1024+512,0,&eq,Thread::JOINABLE);
+    t20_runner<Q>(&eq);
+    t->join();
+    //A slow periodic event is not run again by another thread until it ends
+    if(t20_overlap) fail("Periodic event overlap");
+    if(t20_v2<3) fail("Slow periodic event");
+    if(eq.timedSize()!=1) fail("Periodic event removed");
+}
 #endif //__NO_EXCEPTIONS
 
+void t20_t4(void* arg)
+{
+    PooledEventQueue<> *eq=reinterpret_cast<PooledEventQueue<>*>(arg);
+    Thread::sleep(50);
+    eq->runOne(); //This unblocks the post() in the other thread
+}
+
+volatile int t20_v3;
+
+void t20_f4()
+{
+    Thread::sleep(20); //Simulate a blocking job
+    FastInterruptDisableLock dLock;
+    t20_v3++;
+}
+
 static void test_20()
 {
     test_name("Event system");
@@ -2861,6 +2984,11 @@ static void test_20()
     }
     t->join();
     if(eq.empty()==false || eq.size()!=0) fail("Empty EventQueue");
+    t20_timed(eq);
+    {
+        EventQueue eq2;
+        t20_periodic(eq2);
+    }
     #endif //__NO_EXCEPTIONS
     
     //
@@ -2916,7 +3044,122 @@ static void test_20()
     t->join();
     if(feq.empty()==false || feq.size()!=0) fail("Empty EventQueue");
     #endif //__NO_EXCEPTIONS
-    
+
+    FixedEventQueue<2,20,4> teq;
+    if(teq.postAfter(1000000000,t20_f1)==false) fail("postAfter");
+    if(teq.postAfter(1000000000,t20_f1)==false) fail("postAfter");
+    if(teq.postAfter(1000000000,t20_f1)==false) fail("postAfter");
+    if(teq.postAfter(1000000000,t20_f1)==false) fail("postAfter");
+    if(teq.postAfter(1000000000,t20_f1)==true) fail("Timers full");
+    #ifndef __NO_EXCEPTIONS
+    {
+        FixedEventQueue<2,20,4> teq2;
+        t20_timed(teq2);
+    }
+    {
+        //The periodic event keeps its slot in the deadline heap
+        FixedEventQueue<2,20,3> teq3;
+        t20_periodic(teq3);
+        if(teq3.postAfter(1000000000,t20_f1)==false) fail("postAfter");
+        if(teq3.postAfter(1000000000,t20_f1)==false) fail("postAfter");
+        if(teq3.postAfter(1000000000,t20_f1)==true) fail("Timers full");
+    }
+    #endif //__NO_EXCEPTIONS
+
+    //
+    // Testing PooledEventQueue
+    //
+    PooledEventQueue<> peq(2);
+    if(peq.empty()==false || peq.size()!=0) fail("Empty PooledEventQueue");
+    if(peq.capacity()!=0) fail("Capacity");
+
+    peq.runOne(); //This tests that runOne() does not block
+    if(peq.postNonBlocking(t20_f1)==true) fail("PostNonBlocking 1");
+
+    t20_v1=0;
+    peq.post(t20_f1);
+    peq.post(bind(t20_f2,2,3));
+    peq.post(t20_f1); //This grows the queue
+    if(peq.capacity()!=4) fail("Capacity");
+    if(t20_v1!=0) fail("Too early");
+    if(peq.empty() || peq.size()!=3) fail("Not empty PooledEventQueue");
+    peq.runOne();
+    if(t20_v1!=1234) fail("Not called");
+    peq.runOne();
+    if(t20_v1!=5) fail("Not called");
+    peq.runOne();
+    if(t20_v1!=1234) fail("Not called");
+    if(peq.empty()==false || peq.size()!=0) fail("Empty PooledEventQueue");
+    if(peq.capacity()!=4) fail("Capacity");
+
+    peq.reserve(16);
+    if(peq.capacity()!=16) fail("Capacity");
+    for(int i=0;i<16;i++)
+        if(peq.postNonBlocking(bind(t20_f2,i,1))==false) fail("PostNonBlocking 2");
+    if(peq.postNonBlocking(t20_f1)==true) fail("PostNonBlocking 3");
+    for(int i=0;i<16;i++)
+    {
+        peq.runOne();
+        if(t20_v1!=i+1) fail("Event ordering");
+    }
+    if(peq.empty()==false || peq.size()!=0) fail("Empty PooledEventQueue");
+
+    //Past its maximum capacity the queue no longer grows, and post() blocks
+    PooledEventQueue<> leq(2,4);
+    for(int i=0;i<4;i++) leq.post(t20_f1);
+    if(leq.capacity()!=4) fail("Maximum capacity");
+    if(leq.postNonBlocking(t20_f1)==true) fail("PostNonBlocking 4");
+    leq.reserve(8);
+    if(leq.capacity()!=4) fail("Maximum capacity");
+    Thread *t4=Thread::create(t20_t4,STACK_SMALL,0,&leq,Thread::JOINABLE);
+    long long t1=getTime();
+    leq.post(bind(t20_f2,1,2)); //This should block
+    if(getTime()-t1<40000000) fail("Not blocked");
+    t4->join();
+    if(leq.size()!=4 || leq.capacity()!=4) fail("Maximum capacity");
+    for(int i=0;i<4;i++) leq.runOne();
+    if(t20_v1!=3) fail("Not called");
+
+    #ifndef __NO_EXCEPTIONS
+    t=Thread::create(t20_t3,STACK_SMALL,0,&peq,Thread::JOINABLE);
+    try {
+        peq.run();
+        fail("run() returned");
+    } catch(int i) {
+        if(i!=5) fail("Wrong");
+    }
+    t->join();
+    if(peq.empty()==false || peq.size()!=0) fail("Empty PooledEventQueue");
+    if(peq.capacity()!=16) fail("Capacity");
+    t20_timed(peq);
+    if(peq.capacity()!=16) fail("Capacity");
+    {
+        PooledEventQueue<> peq2;
+        t20_periodic(peq2);
+    }
+    #endif //__NO_EXCEPTIONS
+
+    //
+    // Testing Executor
+    //
+    {
+        Executor<4> ex(2,STACK_SMALL);
+        if(ex.workers()!=2) fail("Executor workers");
+        t20_v3=0;
+        //All posted to worker 0, worker 1 has to steal them
+        for(int i=0;i<4;i++) ex.post(0,t20_f4);
+        Thread::sleep(100);
+        if(t20_v3!=4) fail("Executor not called");
+        if(ex.size()!=0) fail("Executor not empty");
+        auto s0=ex.stats(0), s1=ex.stats(1);
+        if(s0.depth!=0 || s0.maxDepth==0) fail("Executor depth");
+        if(s1.steals==0 || s0.steals!=0) fail("Executor steals");
+        if(s0.executed+s1.executed!=unsigned(t20_v3)) fail("Executor executed");
+
+        t20_v3=0;
+        for(int i=0;i<6;i++) ex.post(t20_f4); //To the least loaded worker
+    } //The destructor runs the remaining events
+    if(t20_v3!=6) fail("Executor destructor");
     
     pass();
 }
@@ -4450,6 +4693,7 @@ void b4_t1(void *argv)
 static void benchmark_4()
 {
     Mutex m;
+    FastMutex fm;
     pthread_mutex_t m1=PTHREAD_MUTEX_INITIALIZER;
     b4_end=false;
     #ifndef SCHED_TYPE_EDF
@@ -4467,6 +4711,22 @@ static void benchmark_4()
     }
     iprintf("%d Mutex lock/unlock pairs per second\n",i);
 
+    b4_end=false;
+    #ifndef SCHED_TYPE_EDF
+    Thread::create(b4_t1,STACK_SMALL);
+    #else
+    Thread::create(b4_t1,STACK_SMALL,0);
+    #endif
+    Thread::yield();
+    i=0;
+    while(b4_end==false)
+    {
+        fm.lock();
+        fm.unlock();
+        i++;
+    }
+    iprintf("%d FastMutex lock/unlock pairs per second\n",i);
+
     b4_end=false;
     #ifndef SCHED_TYPE_EDF
     Thread::create(b4_t1,STACK_SMALL);
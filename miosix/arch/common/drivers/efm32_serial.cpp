@@ -183,6 +183,17 @@ int EFM32Serial::ioctl(int cmd, void* arg)
     }
 }
 
+#if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+int EFM32Serial::poll(int events)
+{
+    //Writes always complete, reads complete as soon as rxQueue has data
+    FastInterruptDisableLock dLock;
+    return rxQueue.isEmpty() ? POLLOUT : POLLIN | POLLOUT;
+}
+
+#endif //WITH_FILESYSTEM || WITH_DEVFS
+
 EFM32Serial::~EFM32Serial()
 {
     waitSerialTxFifoEmpty();
@@ -221,7 +232,9 @@ void EFM32Serial::IRQinterruptHandler()
             if(rxQueue.tryPut(c & 0xff)==false) /*fifo overflow*/;
         }
     }
-    if(atLeastOne && rxWaiting)
+    if(atLeastOne==false) return;
+    rxPollQueue.IRQwakeup();
+    if(rxWaiting)
     {
         rxWaiting->IRQwakeup();
         rxWaiting=nullptr;
@@ -96,6 +96,22 @@ public:
      * \return the exact return value depends on CMD, -1 is returned on error
      */
     int ioctl(int cmd, void *arg);
+
+    #if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+    /**
+     * Check whether the serial port is ready for I/O, used to implement poll()
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on the serial port
+     */
+    PollQueue *getPollQueue() { return &rxPollQueue; }
+
+    #endif //WITH_FILESYSTEM || WITH_DEVFS
     
     /**
      * Destructor
@@ -119,6 +135,7 @@ private:
     DynUnsyncQueue<char> rxQueue;     ///< Receiving queue
     static const unsigned int rxQueueMin=1; ///< Minimum queue size
     Thread *rxWaiting;                ///< Thread waiting for rx, or nullptr
+    PollQueue rxPollQueue;            ///< Threads polling for rx
     
     USART_TypeDef *port;              ///< Pointer to USART peripheral
     IRQn_Type irqn;                   ///< Interrupt number
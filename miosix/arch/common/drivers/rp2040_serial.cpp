@@ -160,6 +160,19 @@ int RP2040PL011Serial::ioctl(int cmd, void *arg)
     }
 }
 
+#if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+int RP2040PL011Serial::poll(int events)
+{
+    //Writes always complete, reads complete as soon as there is data either
+    //in the software queue or in the hardware FIFO
+    FastInterruptDisableLock dLock;
+    if(rxQueue.isEmpty() && (uart->fr & UART_UARTFR_RXFE_BITS)) return POLLOUT;
+    return POLLIN | POLLOUT;
+}
+
+#endif //WITH_FILESYSTEM || WITH_DEVFS
+
 RP2040PL011Serial::~RP2040PL011Serial()
 {
     //Disable UART operation
@@ -221,6 +234,7 @@ void RP2040PL011Serial::IRQhandleInterrupt()
         // without losing the line idle status information (which only exists
         // in the interrupt flags).
         if(rxQueue.isFull()) disableRXInterrupts();
+        rxPollQueue.IRQwakeup();
     }
 }
 
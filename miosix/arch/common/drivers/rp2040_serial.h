@@ -101,6 +101,22 @@ public:
      * \return the exact return value depends on CMD, -1 is returned on error
      */
     int ioctl(int cmd, void *arg);
+
+    #if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+    /**
+     * Check whether the serial port is ready for I/O, used to implement poll()
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on the serial port
+     */
+    PollQueue *getPollQueue() { return &rxPollQueue; }
+
+    #endif //WITH_FILESYSTEM || WITH_DEVFS
     
     /**
      * Destructor
@@ -139,6 +155,7 @@ private:
     Semaphore txLowWaterFlag;
     /// Software queue used for buffering bytes from the hardware RX FIFO
     DynQueue<unsigned char> rxQueue;
+    PollQueue rxPollQueue; ///< Threads polling for rx
 };
 
 } //namespace miosix
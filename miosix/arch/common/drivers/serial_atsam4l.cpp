@@ -186,13 +186,27 @@ void ATSAMSerial::IRQhandleInterrupt()
         idle=true;
     }
     
-    if(wake && rxWaiting)
+    if(wake==false) return;
+    rxPollQueue.IRQwakeup();
+    if(rxWaiting)
     {
         rxWaiting->IRQwakeup();
         rxWaiting=nullptr;
     }
 }
 
+#if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+int ATSAMSerial::poll(int events)
+{
+    //Writes always complete, reads complete once rxQueue has data and the
+    //line goes idle, which happens at most one character time later
+    FastInterruptDisableLock dLock;
+    return rxQueue.isEmpty() ? POLLOUT : POLLIN | POLLOUT;
+}
+
+#endif //WITH_FILESYSTEM || WITH_DEVFS
+
 ATSAMSerial::~ATSAMSerial()
 {
     waitSerialTxFifoEmpty();
@@ -97,6 +97,22 @@ public:
      */
     int ioctl(int cmd, void *arg);
 
+    #if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+    /**
+     * Check whether the serial port is ready for I/O, used to implement poll()
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on the serial port
+     */
+    PollQueue *getPollQueue() { return &rxPollQueue; }
+
+    #endif //WITH_FILESYSTEM || WITH_DEVFS
+
     /**
      * \internal the serial port interrupts call this member function.
      * Never call this from user code.
@@ -125,6 +141,7 @@ private:
     DynUnsyncQueue<char> rxQueue;     ///< Receiving queue
     static const unsigned int rxQueueMin=1; ///< Minimum queue size
     Thread *rxWaiting;                ///< Thread waiting for rx, or 0
+    PollQueue rxPollQueue;            ///< Threads polling for rx
     bool idle;                        ///< Receiver idle
     
     Usart *port;                      ///< Pointer to USART peripheral
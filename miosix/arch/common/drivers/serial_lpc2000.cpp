@@ -268,6 +268,7 @@ void LPC2000Serial::IRQhandleInterrupt()
             }
             break;
     }
+    if(wakeup) rxPollQueue.IRQwakeup();
     if(wakeup && rxWaiting)
     {
         rxWaiting->IRQwakeup();
@@ -278,6 +279,18 @@ void LPC2000Serial::IRQhandleInterrupt()
     if(hppw) Scheduler::IRQfindNextThread();
 }
 
+#if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+int LPC2000Serial::poll(int events)
+{
+    //Writes always complete, reads complete once rxQueue has data and the
+    //line goes idle, which happens at most one character time later
+    FastInterruptDisableLock dLock;
+    return rxQueue.isEmpty() ? POLLOUT : POLLIN | POLLOUT;
+}
+
+#endif //WITH_FILESYSTEM || WITH_DEVFS
+
 LPC2000Serial::~LPC2000Serial()
 {
     waitSerialTxFifoEmpty();
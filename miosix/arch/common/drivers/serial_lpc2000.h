@@ -93,6 +93,22 @@ public:
      * \return the exact return value depends on CMD, -1 is returned on error
      */
     int ioctl(int cmd, void *arg);
+
+    #if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+    /**
+     * Check whether the serial port is ready for I/O, used to implement poll()
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on the serial port
+     */
+    PollQueue *getPollQueue() { return &rxPollQueue; }
+
+    #endif //WITH_FILESYSTEM || WITH_DEVFS
     
     /**
      * \internal the serial port interrupts call this member function.
@@ -175,6 +191,7 @@ private:
     DynUnsyncQueue<char>  rxQueue;///< Rx software queue
     Thread *txWaiting;  ///< Thread waiting on rx queue
     Thread *rxWaiting;  ///< Thread waiting on rx queue
+    PollQueue rxPollQueue; ///< Threads polling for rx
     bool idle;          ///< Receiver idle
     
     Usart16550 *serial; ///< Serial port registers
@@ -129,6 +129,11 @@ private:
      */
     int ioctl(int cmd, void* arg);
 
+    /**
+     * Common implementation of poll() for the STM32 serial
+     */
+    int poll(int events);
+
     friend class STM32Serial;
     friend class STM32DMASerial;
 
@@ -140,6 +145,7 @@ private:
     DynUnsyncQueue<char> rxQueue;     ///< Receiving queue
     static const unsigned int rxQueueMin=16; ///< Minimum queue size
     Thread *rxWaiting=nullptr;        ///< Thread waiting for rx, or 0
+    PollQueue rxPollQueue;            ///< Threads polling for rx
     bool idle=true;                   ///< Receiver idle
 };
 
@@ -222,6 +228,25 @@ public:
     {
         return STM32SerialBase::ioctl(cmd, arg);
     }
+
+    #if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+    /**
+     * Check whether the serial port is ready for I/O, used to implement poll()
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(int events)
+    {
+        return STM32SerialBase::poll(events);
+    }
+
+    /**
+     * \return the queue of threads blocked in poll() on the serial port
+     */
+    PollQueue *getPollQueue() { return &rxPollQueue; }
+
+    #endif //WITH_FILESYSTEM || WITH_DEVFS
     
     /**
      * Destructor
@@ -326,6 +351,25 @@ public:
     {
         return STM32SerialBase::ioctl(cmd, arg);
     }
+
+    #if defined(WITH_FILESYSTEM) || defined(WITH_DEVFS)
+
+    /**
+     * Check whether the serial port is ready for I/O, used to implement poll()
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(int events)
+    {
+        return STM32SerialBase::poll(events);
+    }
+
+    /**
+     * \return the queue of threads blocked in poll() on the serial port
+     */
+    PollQueue *getPollQueue() { return &rxPollQueue; }
+
+    #endif //WITH_FILESYSTEM || WITH_DEVFS
     
     /**
      * Destructor
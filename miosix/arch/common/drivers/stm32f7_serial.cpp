@@ -488,6 +488,14 @@ void STM32SerialBase::rxWakeup()
         rxWaiting->IRQwakeup();
         rxWaiting=nullptr;
     }
+    rxPollQueue.IRQwakeup();
+}
+
+int STM32SerialBase::poll(int events)
+{
+    //Writes always complete, reads complete as soon as there is data
+    FastInterruptDisableLock dLock;
+    return rxQueue.isEmpty() ? POLLOUT : POLLIN | POLLOUT;
 }
 
 int STM32SerialBase::ioctl(int cmd, void* arg)
@@ -40,6 +40,7 @@ ExternalProject_Add(buildromfs
 #     KERNEL <kernel>
 #     DIR_NAME <dir_name>
 #     PROCESSES <process1> <process2> ...
+#     FLAGS <buildromfs options, e.g. --compress 4096>
 #   )
 #
 # What it does:
@@ -48,7 +49,7 @@ ExternalProject_Add(buildromfs
 # - Combines the kernel and the romfs image into a single binary image
 # - Registers a custom target (named <dir_name>) with to run the above steps
 function(miosix_add_romfs_image)
-    cmake_parse_arguments(ROMFS "" "IMAGE_NAME;KERNEL;DIR_NAME" "PROCESSES" ${ARGN})
+    cmake_parse_arguments(ROMFS "" "IMAGE_NAME;KERNEL;DIR_NAME" "PROCESSES;FLAGS" ${ARGN})
 
     # If the user did not provide a directory name, use "bin" as default
     if(NOT ROMFS_DIR_NAME)
@@ -75,7 +76,7 @@ function(miosix_add_romfs_image)
     add_custom_command(
         OUTPUT ${ROMFS_IMAGE_NAME}-romfs.bin
         DEPENDS ${MIOSIX_${ROMFS_DIR_NAME}_FILES} buildromfs
-        COMMAND ${MIOSIX_KPATH}/_tools/filesystems/buildromfs ${ROMFS_IMAGE_NAME}-romfs.bin --from-directory ${ROMFS_DIR_NAME}
+        COMMAND ${MIOSIX_KPATH}/_tools/filesystems/buildromfs ${ROMFS_IMAGE_NAME}-romfs.bin --from-directory ${ROMFS_DIR_NAME} ${ROMFS_FLAGS}
         COMMENT "Building ${ROMFS_IMAGE_NAME}-romfs.bin"
     )
 
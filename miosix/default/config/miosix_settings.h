@@ -111,6 +111,22 @@ constexpr unsigned char FATFS_MAX_OPEN_FILES=8;
 /// FATFS partition if one concurrent truncate/write past the end per partition
 /// occurs.
 constexpr unsigned int FATFS_EXTEND_BUFFER=512;
+/// Seeking far into a FATFS file requires following its cluster chain in the
+/// FAT, which takes time proportional to the file size. To avoid this, a map of
+/// the file fragments is built on the first far seek and kept until the file
+/// grows. This is the maximum number of fragments in a map, each costs 8 bytes
+/// per open file. Files with more fragments are seeked without a map.
+constexpr unsigned int FATFS_FASTSEEK_MAX_FRAGMENTS=16;
+/// FAT32 stores the number of free clusters and the last allocated cluster in
+/// its FSInfo sector. Trusting them avoids a scan of the whole FAT, which takes
+/// seconds on large SD cards, when free space is first queried, and lets
+/// cluster allocation continue where it left off before a remount. However,
+/// they are stale if the volume was not cleanly unmounted. Possible values:
+/// 0: never trust the free cluster count, the FAT is scanned at first statfs
+/// 1: trust it only if the volume was cleanly unmounted. This requires one
+///    write to the FAT when mounting and when unmounting the filesystem
+/// 2: always trust it, as long as it is within the volume bounds
+constexpr int FAT32_FSINFO_POLICY=1;
 
 /// \def WITH_LITTLEFS
 /// Allows to enable/disable LittleFS support to save code size
@@ -130,6 +146,28 @@ constexpr unsigned int FATFS_EXTEND_BUFFER=512;
 /// By default it is defined (slow but safe)
 //#define SYNC_AFTER_WRITE
 
+/// \def FAT32_WRITE_BACK
+/// Reduces filesystem write amplification for files written in small chunks,
+/// such as logs. Instead of syncing after each write, a flusher thread syncs
+/// Fat32 files FAT32_WRITE_BACK_INTERVAL nanoseconds after they were first
+/// modified, or as soon as FAT32_WRITE_BACK_BYTES have been written to them.
+/// IOCTL_SYNC still syncs a file immediately, and files are synced when the
+/// filesystem is unmounted. Takes precedence over SYNC_AFTER_WRITE.
+/// By default it is not defined
+//#define FAT32_WRITE_BACK
+constexpr long long FAT32_WRITE_BACK_INTERVAL=1000000000; //1s
+constexpr unsigned int FAT32_WRITE_BACK_BYTES=16384;
+
+/// \def WITH_BLOCK_CACHE
+/// Place a write-back block cache between the filesystem mounted as /sd and
+/// the disk. Reduces the number of disk transactions through multi-block reads
+/// and writes, but data reaches the disk only when the filesystem is synced or
+/// blocks are evicted from the cache.
+/// By default it is not defined (no block cache)
+//#define WITH_BLOCK_CACHE
+/// Number of 512 byte blocks in the block cache, allocated at boot
+constexpr unsigned int BLOCK_CACHE_BLOCKS=32;
+
 /// Maximum number of files a single process (or the kernel) can open. This
 /// constant is used to size file descriptor tables. Individual filesystems can
 /// introduce futher limitations. Cannot be less than 3, as the first three are
@@ -189,6 +227,14 @@ const unsigned char MAX_OPEN_FILES=8;
 #error Deep sleep requires sleep support
 #endif //defined(WITH_DEEP_SLEEP) && !defined(WITH_SLEEP)
 
+/// \def WITH_TLSF_HEAP
+/// Replace the malloc implementation of the C standard library with a Two-Level
+/// Segregated Fit allocator. Allocation and deallocation take a bounded amount
+/// of time regardless of the heap state, and the kernel is paused for a much
+/// shorter time, at the cost of a somewhat higher memory overhead.
+/// Useful if real-time threads need to allocate memory.
+//#define WITH_TLSF_HEAP
+
 /// Minimum stack size (MUST be divisible by 4)
 const unsigned int STACK_MIN=256;
 
@@ -234,7 +280,7 @@ static_assert(SYSTEM_MODE_PROCESS_STACK_SIZE>=STACK_MIN,"");
 /// the priority of the idle thread.
 /// The meaning of a thread's priority depends on the chosen scheduler.
 #ifdef SCHED_TYPE_PRIORITY
-//Can be modified, but a high value makes context switches more expensive
+//Can be modified up to 32, context switch time does not depend on this value
 const short int PRIORITY_MAX=4;
 #elif defined(SCHED_TYPE_CONTROL_BASED)
 //Don't touch, the limit is due to the fixed point implementation
@@ -47,26 +47,71 @@ void EventQueue::run()
     Lock<FastMutex> l(m);
     for(;;)
     {
-        while(events.empty()) cv.wait(l);
-        function<void ()> f=events.front();
-        events.pop_front();
-        {
-            Unlock<FastMutex> u(l);
-            f();
-        }
+        TimedEvent<function<void ()>> t;
+        getEvent(l,t,true);
+        Rearm r(*this,t);
+        Unlock<FastMutex> u(l);
+        t.event();
     }
 }
 
 void EventQueue::runOne()
 {
-    function<void ()> f;
+    TimedEvent<function<void ()>> t;
+    Lock<FastMutex> l(m);
+    if(getEvent(l,t,false)==false) return;
+    Rearm r(*this,t);
+    Unlock<FastMutex> u(l);
+    t.event();
+}
+
+void EventQueue::postTimed(long long when, long long period,
+                           const function<void ()>& event)
+{
+    Lock<FastMutex> l(m);
+    //Leave room for the running periodic events, so rearming never allocates
+    unsigned int needed=timers.size()+runningPeriodic+1;
+    if(timers.capacity()<needed) timers.reserve(2*needed);
+    timers.push_back({when,period,event});
+    push_heap(timers.begin(),timers.end(),TimedEventCompare());
+    //Wake a thread in run() as its deadline may no longer be the earliest one
+    cv.signal();
+}
+
+void EventQueue::rearm(TimedEvent<function<void ()>>& t)
+{
+    t.when=nextActivation(t.when,t.period,getTime());
+    timers.push_back(t);
+    push_heap(timers.begin(),timers.end(),TimedEventCompare());
+    runningPeriodic--;
+    //Wake a thread in run() as its deadline may no longer be the earliest one
+    cv.signal();
+}
+
+bool EventQueue::getEvent(Lock<FastMutex>& l, TimedEvent<function<void ()>>& t,
+                          bool block)
+{
+    for(;;)
     {
-        Lock<FastMutex> l(m);
-        if(events.empty()) return;
-        f=events.front();
-        events.pop_front();
+        if(timers.empty()==false && timers.front().when<=getTime())
+        {
+            unsigned int n=timers.size();
+            popTimedEvent(timers.data(),n,t);
+            timers.resize(n);
+            if(t.period>0) runningPeriodic++;
+            return true;
+        }
+        if(events.empty()==false)
+        {
+            t.period=0;
+            t.event=events.front();
+            events.pop_front();
+            return true;
+        }
+        if(block==false) return false;
+        if(timers.empty()) cv.wait(l);
+        else cv.timedWait(l,timers.front().when);
     }
-    f();
 }
 
 } //namespace miosix
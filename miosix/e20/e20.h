@@ -30,17 +30,104 @@
 #pragma once
 
 #include <list>
+#include <vector>
+#include <memory>
+#include <algorithm>
 #include <functional>
+#include <limits>
 #include <miosix.h>
 #include "callback.h"
 
 namespace miosix {
 
+/**
+ * \internal
+ * An event with a deadline, stored in the deadline heap of event queues
+ */
+template<typename E>
+struct TimedEvent
+{
+    long long when;   ///< Absolute time in nanoseconds when the event runs
+    long long period; ///< Period in nanoseconds, or 0 for non periodic events
+    E event;          ///< Event function
+};
+
+/**
+ * \internal
+ * Comparison for std::push_heap and std::pop_heap so that the first element
+ * of the deadline heap is the event with the earliest deadline
+ */
+struct TimedEventCompare
+{
+    template<typename E>
+    bool operator()(const TimedEvent<E>& a, const TimedEvent<E>& b) const
+    {
+        return a.when>b.when;
+    }
+};
+
+/**
+ * \internal
+ * Compute the next activation of a periodic event. If the event loop fell
+ * behind, missed activations are skipped instead of being run in a burst.
+ * \param when current activation time
+ * \param period event period
+ * \param now current time
+ * \return next activation time
+ */
+inline long long nextActivation(long long when, long long period, long long now)
+{
+    when+=period;
+    if(when<=now) when+=((now-when)/period+1)*period;
+    return when;
+}
+
+/**
+ * \internal
+ * Add an event to a deadline heap
+ * \param heap deadline heap, must have space for one more event
+ * \param n number of events in the heap, incremented
+ * \param when absolute time in nanoseconds when the event runs
+ * \param period period in nanoseconds, or 0 for non periodic events
+ * \param event event function
+ */
+template<typename E>
+void pushTimedEvent(TimedEvent<E> *heap, unsigned int& n, long long when,
+        long long period, const E& event)
+{
+    heap[n].when=when;
+    heap[n].period=period;
+    heap[n].event=event;
+    n++;
+    std::push_heap(heap,heap+n,TimedEventCompare());
+}
+
+/**
+ * \internal
+ * Remove the event with the earliest deadline from a deadline heap. Periodic
+ * events are put back in the heap by the caller only after they have run, so
+ * that they never run concurrently if more threads call run()
+ * \param heap deadline heap, must not be empty
+ * \param n number of events in the heap, decremented
+ * \param t the removed event is returned here
+ */
+template<typename E>
+void popTimedEvent(TimedEvent<E> *heap, unsigned int& n, TimedEvent<E>& t)
+{
+    std::pop_heap(heap,heap+n,TimedEventCompare());
+    n--;
+    t.when=heap[n].when;
+    t.period=heap[n].period;
+    t.event=heap[n].event;
+    heap[n].event=E();
+}
+
 /**
  * A variable sized event queue.
  * 
  * Makes use of heap allocations and as such it is not possible to post events
- * from within interrupt service routines. For this, use FixedEventQueue.
+ * from within interrupt service routines. For this, use FixedEventQueue or
+ * PooledEventQueue.
  * 
  * This class acts as a synchronization point, multiple threads can post
  * events, and multiple threads can call run() or runOne() (thread pooling).
@@ -66,23 +153,70 @@ public:
     void post(std::function<void ()> event);
 
     /**
-     * This function blocks waiting for events being posted, and when available
-     * it calls the event function. To return from this event loop an event
-     * function must throw an exception.
+     * Post an event to the queue, to be run at the given time.
+     * This function never blocks.
+     * 
+     * \param when absolute time in nanoseconds, as returned by getTime(), at
+     * which the event should be run. The event is run as soon as possible
+     * after that time, depending on how busy the threads calling run() are.
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void postAt(long long when, std::function<void ()> event)
+    {
+        postTimed(when,0,event);
+    }
+
+    /**
+     * Post an event to the queue, to be run after the given delay.
+     * This function never blocks.
+     * 
+     * \param delay delay in nanoseconds from now
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void postAfter(long long delay, std::function<void ()> event)
+    {
+        postTimed(getTime()+delay,0,event);
+    }
+
+    /**
+     * Post an event to the queue, to be run periodically, with the first run
+     * after one period. If the threads calling run() fall behind, missed
+     * activations are skipped. Periodic events remain in the queue until the
+     * queue is destroyed. This function never blocks.
+     * 
+     * \param period period in nanoseconds, must be greater than zero
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void postPeriodic(long long period, std::function<void ()> event)
+    {
+        postTimed(getTime()+period,period,event);
+    }
+
+    /**
+     * This function blocks waiting for events being posted or timed events
+     * becoming due, and when available it calls the event function. To return
+     * from this event loop an event function must throw an exception.
      * 
      * \throws any exception that is thrown by the event functions
      */
     void run();
 
     /**
-     * Run at most one event. This function does not block.
+     * Run at most one event, either posted or timed and due. This function
+     * does not block.
      * 
      * \throws any exception that is thrown by the event functions
      */
     void runOne();
 
     /**
-     * \return the number of events in the queue
+     * \return the number of events in the queue, not counting timed events
      */
     unsigned int size() const
     {
@@ -91,7 +225,7 @@ public:
     }
     
     /**
-     * \return true if the queue has no events
+     * \return true if the queue has no events, not counting timed events
      */
     bool empty() const
     {
@@ -99,11 +233,68 @@ public:
         return events.empty();
     }
 
+    /**
+     * \return the number of timed events in the queue, including periodic
+     * events
+     */
+    unsigned int timedSize() const
+    {
+        Lock<FastMutex> l(m);
+        return timers.size()+runningPeriodic;
+    }
+
     EventQueue(const EventQueue&) = delete;
     EventQueue& operator= (const EventQueue&) = delete;
 
 private:
+    /**
+     * Puts a periodic event back in the deadline heap when it has run, also
+     * if it throws. Must be destroyed with the mutex locked
+     */
+    class Rearm
+    {
+    public:
+        Rearm(EventQueue& q, TimedEvent<std::function<void ()>>& t)
+            : q(q), t(t) {}
+        ~Rearm() { if(t.period>0) q.rearm(t); }
+    private:
+        EventQueue& q;
+        TimedEvent<std::function<void ()>>& t;
+    };
+
+    /**
+     * Put a periodic event that has run back in the deadline heap, with its
+     * next deadline. Never allocates, as postTimed() leaves room for it.
+     * Must be called with the mutex locked
+     * \param t periodic event
+     */
+    void rearm(TimedEvent<std::function<void ()>>& t);
+
+    /**
+     * Add an event to the deadline heap
+     * \param when absolute time in nanoseconds when the event runs
+     * \param period period in nanoseconds, or 0 for non periodic events
+     * \param event event function
+     */
+    void postTimed(long long when, long long period,
+                   const std::function<void ()>& event);
+
+    /**
+     * Get the next event to run, either posted or timed and due
+     * \param l lock on the mutex, released while waiting
+     * \param t the event is returned here, with a period of zero if it is not
+     * periodic. Periodic events have to be rearmed once they have run
+     * \param block if true, wait until an event is available
+     * \return false if block is false and no event is available
+     */
+    bool getEvent(Lock<FastMutex>& l, TimedEvent<std::function<void ()>>& t,
+                  bool block);
+
     std::list<std::function<void ()>> events; ///< Event queue
+    /// Deadline heap of timed events
+    std::vector<TimedEvent<std::function<void ()>>> timers;
+    /// Periodic events that are running, and are not in the deadline heap
+    unsigned int runningPeriodic=0;
     mutable FastMutex m; ///< Mutex for synchronisation
     ConditionVariable cv; ///< Condition variable for synchronisation
 };
@@ -111,7 +302,7 @@ private:
 /**
  * \internal
  * This class is to extract from FixedEventQueue code that
- * does not depend on the NumSlots template parameters.
+ * does not depend on the NumSlots and NumTimers template parameters.
  */
 template<unsigned SlotSize>
 class FixedEventQueueBase
@@ -143,6 +334,19 @@ protected:
     bool IRQpostImpl(Callback<SlotSize>& event, Callback<SlotSize> *events,
             unsigned int size, bool *hppw=nullptr);
 
+    /**
+     * Post a timed event
+     * \param when absolute time in nanoseconds when the event runs
+     * \param period period in nanoseconds, or 0 for non periodic events
+     * \param event event to post
+     * \param timers pointer to deadline heap
+     * \param numTimers deadline heap size
+     * \return false if there was no space in the deadline heap
+     */
+    bool postTimedImpl(long long when, long long period,
+            Callback<SlotSize>& event, TimedEvent<Callback<SlotSize>> *timers,
+            unsigned int numTimers);
+
     /**
      * This function blocks waiting for events being posted, and when available
      * it calls the event function. To return from this event loop an event
@@ -150,18 +354,22 @@ protected:
      * 
      * \param events pointer to event queue
      * \param size event queue size
+     * \param timers pointer to deadline heap
      * \throws any exception that is thrown by the event functions
      */
-    void runImpl(Callback<SlotSize> *events, unsigned int size);
+    void runImpl(Callback<SlotSize> *events, unsigned int size,
+            TimedEvent<Callback<SlotSize>> *timers);
 
     /**
      * Run at most one event. This function does not block.
      * 
      * \param events pointer to event queue
      * \param size event queue size
+     * \param timers pointer to deadline heap
      * \throws any exception that is thrown by the event functions
      */
-    void runOneImpl(Callback<SlotSize> *events, unsigned int size);
+    void runOneImpl(Callback<SlotSize> *events, unsigned int size,
+            TimedEvent<Callback<SlotSize>> *timers);
 
     /**
      * \return the number of events in the queue
@@ -172,7 +380,66 @@ protected:
         return n;
     }
 
+    /**
+     * \return the number of timed events in the queue
+     */
+    unsigned int timedSizeImpl() const
+    {
+        FastInterruptDisableLock dLock;
+        return nTimers+runningPeriodic;
+    }
+
 private:
+    /**
+     * Puts a periodic event back in the deadline heap when it has run, also
+     * if it throws. Must be destroyed with interrupts disabled
+     */
+    class Rearm
+    {
+    public:
+        Rearm(FixedEventQueueBase& q, TimedEvent<Callback<SlotSize>>& t,
+                TimedEvent<Callback<SlotSize>> *timers)
+            : q(q), t(t), timers(timers) {}
+        ~Rearm() { if(t.period>0) q.IRQrearm(t,timers); }
+    private:
+        FixedEventQueueBase& q;
+        TimedEvent<Callback<SlotSize>>& t;
+        TimedEvent<Callback<SlotSize>> *timers;
+    };
+
+    /**
+     * Put a periodic event that has run back in the deadline heap, with its
+     * next deadline. There is always space, as postTimedImpl() counts running
+     * periodic events as occupying the heap
+     * \param t periodic event
+     * \param timers pointer to deadline heap
+     */
+    void IRQrearm(TimedEvent<Callback<SlotSize>>& t,
+            TimedEvent<Callback<SlotSize>> *timers);
+
+    /**
+     * Get the next event to run, either posted or timed and due
+     * \param dLock interrupts are enabled while waiting
+     * \param t the event is returned here, with a period of zero if it is not
+     * periodic. Periodic events have to be rearmed once they have run
+     * \param events pointer to event queue
+     * \param size event queue size
+     * \param timers pointer to deadline heap
+     * \param block if true, wait until an event is available
+     * \return false if block is false and no event is available
+     */
+    bool IRQgetEvent(InterruptDisableLock& dLock,
+            TimedEvent<Callback<SlotSize>>& t, Callback<SlotSize> *events,
+            unsigned int size, TimedEvent<Callback<SlotSize>> *timers,
+            bool block);
+
+    /**
+     * Wake a thread waiting in run(), if any
+     * \param hppw if not null set to true if a higher priority thread is
+     * awakened, otherwise the variable is not modified
+     */
+    void IRQwakeGetter(bool *hppw=nullptr);
+
     /**
      * \internal Element of a thread waiting list
      */
@@ -186,6 +453,8 @@ private:
     unsigned int put=0; ///< Put position into events
     unsigned int get=0; ///< Get position into events
     unsigned int n=0;   ///< Number of occupied event slots
+    unsigned int nTimers=0; ///< Number of timed events in the deadline heap
+    unsigned int runningPeriodic=0; ///< Periodic events out of the heap
     IntrusiveList<WaitToken> waitingGet, waitingPut; ///< Waiting on get/put
 };
 
@@ -213,73 +482,145 @@ bool FixedEventQueueBase<SlotSize>::IRQpostImpl(Callback<SlotSize>& event,
     events[put]=event; //This may allocate memory
     if(++put>=size) put=0;
     n++;
-    if(waitingGet.empty()==false)
-    {
-        Thread *t=waitingGet.front()->thread;
-        waitingGet.front()->thread=nullptr;
-        waitingGet.pop_front();
-        t->IRQwakeup();
-        if(hppw && t->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
-            *hppw=true;
-    }
+    IRQwakeGetter(hppw);
+    return true;
+}
+
+template<unsigned SlotSize>
+bool FixedEventQueueBase<SlotSize>::postTimedImpl(long long when,
+        long long period, Callback<SlotSize>& event,
+        TimedEvent<Callback<SlotSize>> *timers, unsigned int numTimers)
+{
+    //Not FastInterruptDisableLock as the operator= of the bound
+    //parameters of the Callback may allocate
+    InterruptDisableLock dLock;
+    if(nTimers+runningPeriodic>=numTimers) return false;
+    pushTimedEvent(timers,nTimers,when,period,event);
+    //Wake a thread in run() as its deadline may no longer be the earliest one
+    IRQwakeGetter();
     return true;
 }
 
 template<unsigned SlotSize>
 void FixedEventQueueBase<SlotSize>::runImpl(Callback<SlotSize> *events,
-        unsigned int size)
+        unsigned int size, TimedEvent<Callback<SlotSize>> *timers)
 {
     //Not FastInterruptDisableLock as the operator= of the bound
     //parameters of the Callback may allocate
     InterruptDisableLock dLock;
     for(;;)
     {
-        while(n<=0)
+        TimedEvent<Callback<SlotSize>> t;
+        IRQgetEvent(dLock,t,events,size,timers,true);
+        Rearm r(*this,t,timers);
+        InterruptEnableLock eLock(dLock);
+        t.event();
+    }
+}
+
+template<unsigned SlotSize>
+void FixedEventQueueBase<SlotSize>::runOneImpl(Callback<SlotSize> *events,
+        unsigned int size, TimedEvent<Callback<SlotSize>> *timers)
+{
+    TimedEvent<Callback<SlotSize>> t;
+    //Not FastInterruptDisableLock as the operator= of the bound
+    //parameters of the Callback may allocate
+    InterruptDisableLock dLock;
+    if(IRQgetEvent(dLock,t,events,size,timers,false)==false) return;
+    Rearm r(*this,t,timers);
+    InterruptEnableLock eLock(dLock);
+    t.event();
+}
+
+template<unsigned SlotSize>
+void FixedEventQueueBase<SlotSize>::IRQrearm(TimedEvent<Callback<SlotSize>>& t,
+        TimedEvent<Callback<SlotSize>> *timers)
+{
+    runningPeriodic--;
+    long long when=nextActivation(t.when,t.period,IRQgetTime());
+    pushTimedEvent(timers,nTimers,when,t.period,t.event); //This may allocate
+    //Wake a thread in run() as its deadline may no longer be the earliest one
+    IRQwakeGetter();
+}
+
+template<unsigned SlotSize>
+bool FixedEventQueueBase<SlotSize>::IRQgetEvent(InterruptDisableLock& dLock,
+        TimedEvent<Callback<SlotSize>>& t, Callback<SlotSize> *events,
+        unsigned int size, TimedEvent<Callback<SlotSize>> *timers, bool block)
+{
+    for(;;)
+    {
+        if(nTimers>0 && timers[0].when<=IRQgetTime())
         {
-            WaitToken w(Thread::IRQgetCurrentThread());
-            waitingGet.push_back(&w);
-            //w.thread must be set to nullptr to protect against spurious wakeups
-            while(w.thread) Thread::IRQenableIrqAndWait(dLock);
+            popTimedEvent(timers,nTimers,t); //This may allocate memory
+            if(t.period>0) runningPeriodic++;
+            return true;
         }
-        Callback<SlotSize> f=events[get]; //This may allocate memory
-        if(++get>=size) get=0;
-        n--;
-        if(waitingPut.empty()==false)
+        if(n>0)
         {
-            waitingPut.front()->thread->IRQwakeup();
-            waitingPut.front()->thread=nullptr;
-            waitingPut.pop_front();
+            t.period=0;
+            t.event=events[get]; //This may allocate memory
+            events[get].clear();
+            if(++get>=size) get=0;
+            n--;
+            if(waitingPut.empty()==false)
+            {
+                waitingPut.front()->thread->IRQwakeup();
+                waitingPut.front()->thread=nullptr;
+                waitingPut.pop_front();
+            }
+            return true;
         }
+        if(block==false) return false;
+        WaitToken w(Thread::IRQgetCurrentThread());
+        waitingGet.push_back(&w);
+        if(nTimers==0)
         {
-            InterruptEnableLock eLock(dLock);
-            f();
+            //w.thread must be set to nullptr to protect against spurious wakeups
+            while(w.thread) Thread::IRQenableIrqAndWait(dLock);
+        } else {
+            Thread::IRQenableIrqAndTimedWait(dLock,timers[0].when);
+            waitingGet.removeFast(&w); //In case of timeout or spurious wakeup
         }
     }
 }
 
 template<unsigned SlotSize>
-void FixedEventQueueBase<SlotSize>::runOneImpl(Callback<SlotSize> *events,
-        unsigned int size)
+void FixedEventQueueBase<SlotSize>::IRQwakeGetter(bool *hppw)
 {
-    Callback<SlotSize> f;
-    {
-        //Not FastInterruptDisableLock as the operator= of the bound
-        //parameters of the Callback may allocate
-        InterruptDisableLock dLock;
-        if(n<=0) return;
-        f=events[get]; //This may allocate memory
-        if(++get>=size) get=0;
-        n--;
-        if(waitingPut.empty()==false)
-        {
-            waitingPut.front()->thread->IRQwakeup();
-            waitingPut.front()->thread=nullptr;
-            waitingPut.pop_front();
-        }
-    }
-    f();
+    if(waitingGet.empty()) return;
+    Thread *t=waitingGet.front()->thread;
+    waitingGet.front()->thread=nullptr;
+    waitingGet.pop_front();
+    t->IRQwakeup();
+    if(hppw && t->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
+        *hppw=true;
 }
 
+/**
+ * \internal
+ * Storage for the deadline heap of FixedEventQueue
+ */
+template<unsigned SlotSize, unsigned NumTimers>
+class FixedEventQueueTimers
+{
+protected:
+    TimedEvent<Callback<SlotSize>> *timerStorage() { return timers; }
+private:
+    TimedEvent<Callback<SlotSize>> timers[NumTimers]; ///< Deadline heap
+};
+
+/**
+ * \internal
+ * FixedEventQueue without timed events takes no space for the deadline heap
+ */
+template<unsigned SlotSize>
+class FixedEventQueueTimers<SlotSize,0>
+{
+protected:
+    TimedEvent<Callback<SlotSize>> *timerStorage() { return nullptr; }
+};
+
 /**
  * A fixed size event queue.
  * 
@@ -300,9 +641,13 @@ void FixedEventQueueBase<SlotSize>::runOneImpl(Callback<SlotSize> *events,
  * errors in callback.h, consider increasing this value. The default is 20
  * bytes, which is enough to bind a member function pointer, a "this" pointer
  * and two byte or pointer sized parameters.
+ * \param NumTimers maximum number of timed events, posted with postAt(),
+ * postAfter() or postPeriodic(). The default is zero, which disables timed
+ * events and takes no space.
  */
-template<unsigned NumSlots, unsigned SlotSize=20>
-class FixedEventQueue : private FixedEventQueueBase<SlotSize>
+template<unsigned NumSlots, unsigned SlotSize=20, unsigned NumTimers=0>
+class FixedEventQueue : private FixedEventQueueBase<SlotSize>,
+                        private FixedEventQueueTimers<SlotSize,NumTimers>
 {
 public:
     /**
@@ -391,29 +736,80 @@ public:
     }
 
     /**
-     * This function blocks waiting for events being posted, and when available
-     * it calls the event function. To return from this event loop an event
-     * function must throw an exception.
+     * Post an event in the queue, to be run at the given time, or return if
+     * the deadline heap was full. This function never blocks.
+     * 
+     * \param when absolute time in nanoseconds, as returned by getTime(), at
+     * which the event should be run. The event is run as soon as possible
+     * after that time, depending on how busy the threads calling run() are.
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(), with the same restrictions as post()
+     * \return false if there was no space in the deadline heap
+     */
+    bool postAt(long long when, Callback<SlotSize> event)
+    {
+        static_assert(NumTimers>0,"FixedEventQueue has no space for timers");
+        return this->postTimedImpl(when,0,event,this->timerStorage(),NumTimers);
+    }
+
+    /**
+     * Post an event in the queue, to be run after the given delay, or return
+     * if the deadline heap was full. This function never blocks.
+     * 
+     * \param delay delay in nanoseconds from now
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(), with the same restrictions as post()
+     * \return false if there was no space in the deadline heap
+     */
+    bool postAfter(long long delay, Callback<SlotSize> event)
+    {
+        return postAt(getTime()+delay,event);
+    }
+
+    /**
+     * Post an event in the queue, to be run periodically, with the first run
+     * after one period, or return if the deadline heap was full. If the
+     * threads calling run() fall behind, missed activations are skipped.
+     * Periodic events permanently take a slot of the deadline heap.
+     * This function never blocks.
+     * 
+     * \param period period in nanoseconds, must be greater than zero
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(), with the same restrictions as post()
+     * \return false if there was no space in the deadline heap
+     */
+    bool postPeriodic(long long period, Callback<SlotSize> event)
+    {
+        static_assert(NumTimers>0,"FixedEventQueue has no space for timers");
+        return this->postTimedImpl(getTime()+period,period,event,
+                this->timerStorage(),NumTimers);
+    }
+
+    /**
+     * This function blocks waiting for events being posted or timed events
+     * becoming due, and when available it calls the event function. To return
+     * from this event loop an event function must throw an exception.
      * 
      * \throws any exception that is thrown by the event functions
      */
     void run()
     {
-        this->runImpl(events,NumSlots);
+        this->runImpl(events,NumSlots,this->timerStorage());
     }
 
     /**
-     * Run at most one event. This function does not block.
+     * Run at most one event, either posted or timed and due. This function
+     * does not block.
      * 
      * \throws any exception that is thrown by the event functions
      */
     void runOne()
     {
-        this->runOneImpl(events,NumSlots);
+        this->runOneImpl(events,NumSlots,this->timerStorage());
     }
     
     /**
-     * \return the number of events in the queue
+     * \return the number of events in the queue, not counting timed events
      */
     unsigned int size() const
     {
@@ -421,13 +817,22 @@ public:
     }
     
     /**
-     * \return true if the queue has no events
+     * \return true if the queue has no events, not counting timed events
      */
     unsigned int empty() const
     {
         return this->sizeImpl()==0;
     }
 
+    /**
+     * \return the number of timed events in the queue, including periodic
+     * events
+     */
+    unsigned int timedSize() const
+    {
+        return this->timedSizeImpl();
+    }
+
     FixedEventQueue(const FixedEventQueue&) = delete;
     FixedEventQueue& operator= (const FixedEventQueue&) = delete;
 
@@ -435,4 +840,523 @@ private:
     Callback<SlotSize> events[NumSlots]; ///< Fixed size queue of events
 };
 
+/**
+ * A variable sized event queue that does not allocate memory when posting
+ * events, once it has grown to the needed size.
+ * 
+ * Events are stored in nodes taken from a free list, and nodes are returned to
+ * the free list after the event has run. When the free list is empty, post()
+ * allocates a chunk of nodes, up to the maximum capacity set in the
+ * constructor, after which it blocks like FixedEventQueue::post() until an
+ * event has run. Nodes are never freed until the queue is
+ * destroyed, so once the queue has grown to its working size, or if enough
+ * nodes are preallocated with reserve(), posting and running events makes no
+ * use of the heap and disables interrupts only for a bounded time. Events can
+ * thus be posted also from within interrupt handlers with IRQpost(), which
+ * fails instead of growing the queue if there are no free nodes.
+ * 
+ * Timed events posted with postAt(), postAfter() or postPeriodic() also take
+ * a node, which for periodic events is never returned to the free list.
+ * 
+ * This class acts as a synchronization point, multiple threads (and IRQs) can
+ * post events, and multiple threads can call run() or runOne()
+ * (thread pooling).
+ * 
+ * Events are function that are posted by a thread through post() but executed
+ * in the context of the thread that calls run() or runOne()
+ * 
+ * \param SlotSize size of the Callback objects. This limits the maximum number
+ * of parameters that can be bound to a function. If you get compile-time
+ * errors in callback.h, consider increasing this value. The default is 20
+ * bytes, which is enough to bind a member function pointer, a "this" pointer
+ * and two byte or pointer sized parameters.
+ */
+template<unsigned SlotSize=20>
+class PooledEventQueue
+{
+public:
+    /**
+     * Constructor. No memory is allocated until the first event is posted or
+     * reserve() is called.
+     * \param chunkSize number of event slots allocated at once when the queue
+     * needs to grow
+     * \param maxSlots maximum number of event slots, including those taken by
+     * timed events. By default the queue grows as long as there is heap memory
+     */
+    PooledEventQueue(unsigned int chunkSize=8,
+            unsigned int maxSlots=std::numeric_limits<unsigned int>::max())
+        : chunkSize(chunkSize>0 ? chunkSize : 1),
+          maxSlots(maxSlots>0 ? maxSlots : 1) {}
+
+    /**
+     * Preallocate event slots, so that posting events does not need to
+     * allocate memory as long as no more than the given number of events
+     * are in the queue.
+     * \param slots minimum number of event slots, reduced to the maximum
+     * capacity if larger
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void reserve(unsigned int slots)
+    {
+        unsigned int c=capacity();
+        if(c<slots) grow(slots-c);
+    }
+
+    /**
+     * Post an event to the queue. If there are no free event slots, it grows
+     * the queue allocating a chunk of event slots, or blocks until an event
+     * has run if the queue is at its maximum capacity.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * Like with the FixedEventQueue, the operator= of the bound parameters
+     * must be callable from inside a InterruptDisableLock.
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void post(Callback<SlotSize> event)
+    {
+        for(;;)
+        {
+            {
+                //Not FastInterruptDisableLock as the operator= of the bound
+                //parameters of the Callback may allocate
+                InterruptDisableLock dLock;
+                if(IRQpostImpl(event)) return;
+                if(IRQwaitFreeSlot(dLock)) continue;
+            }
+            grow(chunkSize);
+        }
+    }
+
+    /**
+     * Post an event in the queue, or return if there are no free event slots.
+     * This function never allocates event slots.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \return false if there was no space in the queue
+     */
+    bool postNonBlocking(Callback<SlotSize> event)
+    {
+        InterruptDisableLock dLock;
+        return IRQpostImpl(event);
+    }
+
+    /**
+     * Post an event in the queue, or return if there are no free event slots.
+     * Can be called only with interrupts disabled or within an interrupt
+     * handler, allowing device drivers to post an event to a thread.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * The same restrictions of FixedEventQueue::IRQpost() apply.
+     * \return false if there was no space in the queue
+     */
+    bool IRQpost(Callback<SlotSize> event)
+    {
+        return IRQpostImpl(event);
+    }
+
+    /**
+     * Post an event in the queue, or return if there are no free event slots.
+     * Can be called only with interrupts disabled or within an interrupt
+     * handler, allowing device drivers to post an event to a thread.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * The same restrictions of FixedEventQueue::IRQpost() apply.
+     * \param hppw returns true if a higher priority thread was awakened as
+     * part of posting the event. Can be used inside an IRQ to call the
+     * scheduler.
+     * \return false if there was no space in the queue
+     */
+    bool IRQpost(Callback<SlotSize> event, bool& hppw)
+    {
+        hppw=false;
+        return IRQpostImpl(event,&hppw);
+    }
+
+    /**
+     * Post an event to the queue, to be run at the given time. This function
+     * grows the queue or blocks like post() does.
+     * 
+     * \param when absolute time in nanoseconds, as returned by getTime(), at
+     * which the event should be run. The event is run as soon as possible
+     * after that time, depending on how busy the threads calling run() are.
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(), with the same restrictions as post()
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void postAt(long long when, Callback<SlotSize> event)
+    {
+        postTimed(when,0,event);
+    }
+
+    /**
+     * Post an event to the queue, to be run after the given delay. This
+     * function grows the queue or blocks like post() does.
+     * 
+     * \param delay delay in nanoseconds from now
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(), with the same restrictions as post()
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void postAfter(long long delay, Callback<SlotSize> event)
+    {
+        postTimed(getTime()+delay,0,event);
+    }
+
+    /**
+     * Post an event to the queue, to be run periodically, with the first run
+     * after one period. If the threads calling run() fall behind, missed
+     * activations are skipped. Periodic events permanently take an event slot.
+     * This function grows the queue or blocks like post() does.
+     * 
+     * \param period period in nanoseconds, must be greater than zero
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(), with the same restrictions as post()
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    void postPeriodic(long long period, Callback<SlotSize> event)
+    {
+        postTimed(getTime()+period,period,event);
+    }
+
+    /**
+     * This function blocks waiting for events being posted or timed events
+     * becoming due, and when available it calls the event function. To return
+     * from this event loop an event function must throw an exception.
+     * 
+     * \throws any exception that is thrown by the event functions
+     */
+    void run()
+    {
+        for(;;) runOneImpl(true);
+    }
+
+    /**
+     * Run at most one event, either posted or timed and due. This function
+     * does not block.
+     * 
+     * \throws any exception that is thrown by the event functions
+     */
+    void runOne()
+    {
+        runOneImpl(false);
+    }
+
+    /**
+     * \return the number of events in the queue, not counting timed events
+     */
+    unsigned int size() const
+    {
+        FastInterruptDisableLock dLock;
+        return n;
+    }
+
+    /**
+     * \return true if the queue has no events, not counting timed events
+     */
+    bool empty() const
+    {
+        return size()==0;
+    }
+
+    /**
+     * \return the number of timed events in the queue, including periodic
+     * events except those that are running
+     */
+    unsigned int timedSize() const
+    {
+        FastInterruptDisableLock dLock;
+        return nTimers;
+    }
+
+    /**
+     * \return the number of allocated event slots, both used and free
+     */
+    unsigned int capacity() const
+    {
+        FastInterruptDisableLock dLock;
+        return slots;
+    }
+
+    PooledEventQueue(const PooledEventQueue&) = delete;
+    PooledEventQueue& operator= (const PooledEventQueue&) = delete;
+
+private:
+    /**
+     * \internal Event slot, linked either in the event queue or in the free list
+     */
+    struct Node
+    {
+        Node *next=nullptr;
+        long long when=0;   ///< Deadline, for timed events
+        long long period=0; ///< Period, for periodic events
+        Callback<SlotSize> event;
+    };
+
+    /**
+     * \internal Comparison for std::push_heap and std::pop_heap so that the
+     * first element of the deadline heap is the earliest deadline
+     */
+    struct NodeCompare
+    {
+        bool operator()(const Node *a, const Node *b) const
+        {
+            return a->when>b->when;
+        }
+    };
+
+    /**
+     * \internal Returns a node to the free list when the event has run, also
+     * if the event throws
+     */
+    class NodeReleaser
+    {
+    public:
+        NodeReleaser(PooledEventQueue *q, Node *node) : q(q), node(node) {}
+        ~NodeReleaser()
+        {
+            if(node->period>0)
+            {
+                //Periodic events keep their node, and go back in the heap
+                FastInterruptDisableLock dLock;
+                node->when=nextActivation(node->when,node->period,IRQgetTime());
+                q->IRQaddTimer(node);
+                return;
+            }
+            node->event.clear(); //May free memory, so interrupts are enabled
+            FastInterruptDisableLock dLock;
+            node->next=q->freeList;
+            q->freeList=node;
+            if(q->waitingPut.empty()) return;
+            q->waitingPut.front()->thread->IRQwakeup();
+            q->waitingPut.front()->thread=nullptr;
+            q->waitingPut.pop_front();
+        }
+    private:
+        PooledEventQueue *q;
+        Node *node;
+    };
+
+    /**
+     * \internal Element of a thread waiting list
+     */
+    class WaitToken : public IntrusiveListItem
+    {
+    public:
+        WaitToken(Thread *thread) : thread(thread) {}
+        Thread *thread; ///<\internal Waiting thread and spurious wakeup token
+    };
+
+    /**
+     * Post an event from an interrupt, or with interrupts disabled.
+     * \param event event to post
+     * \param hppw if not null set to true if a higher priority thread is
+     * awakened, otherwise the variable is not modified
+     * \return false if there was no free event slot
+     */
+    bool IRQpostImpl(Callback<SlotSize>& event, bool *hppw=nullptr);
+
+    /**
+     * Post a timed event, growing the queue if there are no free event slots
+     * \param when absolute time in nanoseconds when the event runs
+     * \param period period in nanoseconds, or 0 for non periodic events
+     * \param event event to post
+     */
+    void postTimed(long long when, long long period, Callback<SlotSize>& event);
+
+    /**
+     * If the queue is at its maximum capacity, wait until an event slot is
+     * returned to the free list
+     * \param dLock interrupts are enabled while waiting
+     * \return false if the queue can still grow, so nothing was done
+     */
+    bool IRQwaitFreeSlot(InterruptDisableLock& dLock);
+
+    /**
+     * Add a node to the deadline heap, which has space for all the nodes
+     * \param node node with the when field set
+     */
+    void IRQaddTimer(Node *node);
+
+    /**
+     * Wake a thread waiting in run(), if any
+     * \param hppw if not null set to true if a higher priority thread is
+     * awakened, otherwise the variable is not modified
+     */
+    void IRQwakeGetter(bool *hppw=nullptr);
+
+    /**
+     * Run at most one event
+     * \param block if true, wait for an event to be posted or a timed event
+     * to become due if there is none, otherwise return immediately
+     */
+    void runOneImpl(bool block);
+
+    /**
+     * Allocate event slots and add them to the free list
+     * \param count number of slots to allocate, reduced so as not to exceed
+     * the maximum capacity
+     */
+    void grow(unsigned int count);
+
+    Node *head=nullptr;     ///< First event in the queue
+    Node *tail=nullptr;     ///< Last event in the queue
+    Node *freeList=nullptr; ///< Free event slots
+    unsigned int n=0;       ///< Number of events in the queue
+    unsigned int slots=0;   ///< Number of allocated event slots
+    unsigned int nTimers=0; ///< Number of timed events in the deadline heap
+    std::unique_ptr<Node*[]> timers; ///< Deadline heap, with room for slots
+    const unsigned int chunkSize; ///< Slots allocated at once when growing
+    const unsigned int maxSlots;  ///< Maximum number of allocated event slots
+    IntrusiveList<WaitToken> waitingGet; ///< Threads waiting for events
+    IntrusiveList<WaitToken> waitingPut; ///< Threads waiting for free slots
+    FastMutex growMutex;    ///< Protects chunks and growing slots
+    std::list<std::unique_ptr<Node[]>> chunks; ///< Allocated event slots
+};
+
+template<unsigned SlotSize>
+bool PooledEventQueue<SlotSize>::IRQpostImpl(Callback<SlotSize>& event,
+        bool *hppw)
+{
+    if(freeList==nullptr) return false;
+    Node *node=freeList;
+    freeList=node->next;
+    node->event=event; //This may allocate memory
+    node->next=nullptr;
+    if(tail) tail->next=node;
+    else head=node;
+    tail=node;
+    n++;
+    IRQwakeGetter(hppw);
+    return true;
+}
+
+template<unsigned SlotSize>
+void PooledEventQueue<SlotSize>::postTimed(long long when, long long period,
+        Callback<SlotSize>& event)
+{
+    for(;;)
+    {
+        {
+            //Not FastInterruptDisableLock as the operator= of the bound
+            //parameters of the Callback may allocate
+            InterruptDisableLock dLock;
+            if(freeList)
+            {
+                Node *node=freeList;
+                freeList=node->next;
+                node->event=event; //This may allocate memory
+                node->next=nullptr;
+                node->when=when;
+                node->period=period;
+                IRQaddTimer(node);
+                return;
+            }
+            if(IRQwaitFreeSlot(dLock)) continue;
+        }
+        grow(chunkSize);
+    }
+}
+
+template<unsigned SlotSize>
+bool PooledEventQueue<SlotSize>::IRQwaitFreeSlot(InterruptDisableLock& dLock)
+{
+    //slots is modified with interrupts disabled, so it can be read here
+    if(slots<maxSlots) return false;
+    WaitToken w(Thread::IRQgetCurrentThread());
+    waitingPut.push_back(&w);
+    //w.thread must be set to nullptr to protect against spurious wakeups
+    while(w.thread) Thread::IRQenableIrqAndWait(dLock);
+    return true;
+}
+
+template<unsigned SlotSize>
+void PooledEventQueue<SlotSize>::IRQaddTimer(Node *node)
+{
+    timers[nTimers++]=node;
+    std::push_heap(timers.get(),timers.get()+nTimers,NodeCompare());
+    //Wake a thread in run() as its deadline may no longer be the earliest one
+    IRQwakeGetter();
+}
+
+template<unsigned SlotSize>
+void PooledEventQueue<SlotSize>::IRQwakeGetter(bool *hppw)
+{
+    if(waitingGet.empty()) return;
+    Thread *t=waitingGet.front()->thread;
+    waitingGet.front()->thread=nullptr;
+    waitingGet.pop_front();
+    t->IRQwakeup();
+    if(hppw && t->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
+        *hppw=true;
+}
+
+template<unsigned SlotSize>
+void PooledEventQueue<SlotSize>::runOneImpl(bool block)
+{
+    Node *node;
+    {
+        FastInterruptDisableLock dLock;
+        for(;;)
+        {
+            if(nTimers>0 && timers[0]->when<=IRQgetTime())
+            {
+                std::pop_heap(timers.get(),timers.get()+nTimers,NodeCompare());
+                node=timers[--nTimers];
+                break;
+            }
+            if(head)
+            {
+                node=head;
+                head=node->next;
+                if(head==nullptr) tail=nullptr;
+                n--;
+                break;
+            }
+            if(block==false) return;
+            WaitToken w(Thread::IRQgetCurrentThread());
+            waitingGet.push_back(&w);
+            if(nTimers==0)
+            {
+                //w.thread must be set to nullptr to protect against spurious wakeups
+                while(w.thread) Thread::IRQenableIrqAndWait(dLock);
+            } else {
+                Thread::IRQenableIrqAndTimedWait(dLock,timers[0]->when);
+                waitingGet.removeFast(&w); //In case of timeout or spurious wakeup
+            }
+        }
+    }
+    //The event is called in place, without copying it out of its slot
+    NodeReleaser r(this,node);
+    node->event();
+}
+
+template<unsigned SlotSize>
+void PooledEventQueue<SlotSize>::grow(unsigned int count)
+{
+    Lock<FastMutex> l(growMutex);
+    count=std::min(count,maxSlots-slots);
+    if(count==0) return; //Another thread grew the queue to its maximum
+    //Allocation is done with interrupts enabled, as it is not bounded in time
+    std::unique_ptr<Node[]> p(new Node[count]);
+    Node *chunk=p.get();
+    //The deadline heap has room for all the nodes, so that adding a timed
+    //event never needs to allocate
+    std::unique_ptr<Node*[]> heap(new Node*[slots+count]);
+    chunks.push_back(std::move(p));
+    for(unsigned int i=0;i<count-1;i++) chunk[i].next=&chunk[i+1];
+    {
+        FastInterruptDisableLock dLock;
+        std::copy(timers.get(),timers.get()+nTimers,heap.get());
+        timers.swap(heap);
+        chunk[count-1].next=freeList;
+        freeList=chunk;
+        slots+=count;
+    }
+    //The old deadline heap is freed here, with interrupts enabled
+}
+
 } //namespace miosix
@@ -0,0 +1,473 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Miosix event based API, multi-worker executor
+
+#pragma once
+
+#include <new>
+#include <memory>
+#include <miosix.h>
+#include <kernel/error.h>
+#include "e20.h"
+
+namespace miosix {
+
+/**
+ * An executor that owns a set of worker threads, each with its own fixed
+ * size event queue.
+ * 
+ * Unlike an event queue drained by multiple threads calling run(), each
+ * worker takes events from its own queue, and only when its queue is empty it
+ * steals events from the queues of the other workers. Events can be posted
+ * either to a specific worker, to keep related events together, or to the
+ * least loaded worker. This allows to overlap blocking jobs, such as
+ * filesystem I/O, with CPU bound jobs without dedicated threads.
+ * 
+ * Posting to a worker is a hint and not a guarantee, as an event in the queue
+ * of a busy worker can be stolen by an idle one. For this reason, events
+ * posted to the same worker may run concurrently and out of order.
+ * 
+ * Like FixedEventQueue, posting makes no use of the heap, therefore events can
+ * be posted also from within interrupt handlers. Event functions should not
+ * throw, as an exception terminates the worker thread running the event.
+ * 
+ * \param SlotsPerWorker maximum queue length of each worker
+ * \param SlotSize size of the Callback objects. This limits the maximum number
+ * of parameters that can be bound to a function. If you get compile-time
+ * errors in callback.h, consider increasing this value. The default is 20
+ * bytes, which is enough to bind a member function pointer, a "this" pointer
+ * and two byte or pointer sized parameters.
+ */
+template<unsigned SlotsPerWorker, unsigned SlotSize=20>
+class Executor
+{
+public:
+    /**
+     * Statistics of a worker
+     */
+    struct WorkerStats
+    {
+        unsigned int depth;    ///< Events currently in the worker queue
+        unsigned int maxDepth; ///< Maximum number of events ever queued
+        unsigned int executed; ///< Events run by the worker, including steals
+        unsigned int steals;   ///< Events the worker took from other queues
+    };
+
+    /**
+     * Constructor, starts the worker threads
+     * \param numWorkers number of worker threads
+     * \param stackSize stack size of the worker threads
+     * \param priority priority of the worker threads
+     * \throws std::bad_alloc if there is not enough heap memory for the
+     * worker queues or for any worker thread. If only some of the worker
+     * threads could be created, the executor runs with fewer workers, and
+     * workers() returns a lower number than requested
+     */
+    Executor(unsigned int numWorkers,
+             unsigned int stackSize=STACK_DEFAULT_FOR_PTHREAD,
+             Priority priority=Priority());
+
+    /**
+     * Destructor. Runs all the events remaining in the queues, then stops
+     * the worker threads. No event can be posted while the executor is being
+     * destroyed.
+     */
+    ~Executor();
+
+    /**
+     * Post an event to the least loaded worker, blocking if the queues of all
+     * workers are full.
+     * 
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function. The same
+     * restrictions of FixedEventQueue::post() apply.
+     */
+    void post(Callback<SlotSize> event)
+    {
+        //Not FastInterruptDisableLock as the operator= of the bound
+        //parameters of the Callback may allocate
+        InterruptDisableLock dLock;
+        while(IRQpostImpl(IRQleastLoaded(),event)==false) IRQwaitPut(dLock);
+    }
+
+    /**
+     * Post an event to a given worker, blocking if its queue is full.
+     * 
+     * \param worker worker index, taken modulo the number of workers so that
+     * also a hash can be used to keep related events on the same worker
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function. The same
+     * restrictions of FixedEventQueue::post() apply.
+     */
+    void post(unsigned int worker, Callback<SlotSize> event)
+    {
+        InterruptDisableLock dLock;
+        while(IRQpostImpl(worker%numWorkers,event)==false) IRQwaitPut(dLock);
+    }
+
+    /**
+     * Post an event to the least loaded worker, or return if the queues of
+     * all workers are full.
+     * 
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function. The same
+     * restrictions of FixedEventQueue::post() apply.
+     * \return false if there was no space in the queues
+     */
+    bool postNonBlocking(Callback<SlotSize> event)
+    {
+        InterruptDisableLock dLock;
+        return IRQpostImpl(IRQleastLoaded(),event);
+    }
+
+    /**
+     * Post an event to a given worker, or return if its queue is full.
+     * 
+     * \param worker worker index, taken modulo the number of workers
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function. The same
+     * restrictions of FixedEventQueue::post() apply.
+     * \return false if there was no space in the queue
+     */
+    bool postNonBlocking(unsigned int worker, Callback<SlotSize> event)
+    {
+        InterruptDisableLock dLock;
+        return IRQpostImpl(worker%numWorkers,event);
+    }
+
+    /**
+     * Post an event to the least loaded worker, or return if the queues of
+     * all workers are full.
+     * Can be called only with interrupts disabled or within an interrupt
+     * handler, allowing device drivers to post an event to a worker.
+     * 
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function.
+     * The same restrictions of FixedEventQueue::IRQpost() apply.
+     * \return false if there was no space in the queues
+     */
+    bool IRQpost(Callback<SlotSize> event)
+    {
+        return IRQpostImpl(IRQleastLoaded(),event);
+    }
+
+    /**
+     * Post an event to a given worker, or return if its queue is full.
+     * Can be called only with interrupts disabled or within an interrupt
+     * handler, allowing device drivers to post an event to a worker.
+     * 
+     * \param worker worker index, taken modulo the number of workers
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function.
+     * The same restrictions of FixedEventQueue::IRQpost() apply.
+     * \return false if there was no space in the queue
+     */
+    bool IRQpost(unsigned int worker, Callback<SlotSize> event)
+    {
+        return IRQpostImpl(worker%numWorkers,event);
+    }
+
+    /**
+     * Post an event to a given worker, or return if its queue is full.
+     * Can be called only with interrupts disabled or within an interrupt
+     * handler, allowing device drivers to post an event to a worker.
+     *
+     * \param worker worker index, taken modulo the number of workers
+     * \param event function function to be called in a worker thread.
+     * Bind can be used to bind parameters to the function.
+     * The same restrictions of FixedEventQueue::IRQpost() apply.
+     * \param hppw returns true if a higher priority thread was awakened as
+     * part of posting the event. Can be used inside an IRQ to call the
+     * scheduler.
+     * \return false if there was no space in the queue
+     */
+    bool IRQpost(unsigned int worker, Callback<SlotSize> event, bool& hppw)
+    {
+        hppw=false;
+        return IRQpostImpl(worker%numWorkers,event,&hppw);
+    }
+
+    /**
+     * \return the number of workers
+     */
+    unsigned int workers() const { return numWorkers; }
+
+    /**
+     * \return the number of events in the queues of all workers
+     */
+    unsigned int size() const
+    {
+        FastInterruptDisableLock dLock;
+        unsigned int result=0;
+        for(unsigned int i=0;i<numWorkers;i++) result+=w[i].n;
+        return result;
+    }
+
+    /**
+     * \param worker worker index, taken modulo the number of workers
+     * \return the statistics of the worker
+     */
+    WorkerStats stats(unsigned int worker) const
+    {
+        FastInterruptDisableLock dLock;
+        const Worker& x=w[worker%numWorkers];
+        return {x.n,x.maxDepth,x.executed,x.steals};
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator= (const Executor&) = delete;
+
+private:
+    /**
+     * \internal A worker thread and its event queue
+     */
+    struct Worker
+    {
+        Executor *executor=nullptr; ///< Executor the worker belongs to
+        Thread *thread=nullptr;     ///< Worker thread
+        Thread *idle=nullptr;       ///< Worker thread, if waiting for events
+        unsigned int id=0;          ///< Worker index
+        unsigned int put=0;         ///< Put position into events
+        unsigned int get=0;         ///< Get position into events
+        unsigned int n=0;           ///< Number of occupied event slots
+        unsigned int maxDepth=0;    ///< Maximum value of n
+        unsigned int executed=0;    ///< Events run
+        unsigned int steals=0;      ///< Events taken from other workers
+        Callback<SlotSize> events[SlotsPerWorker]; ///< Fixed size queue
+    };
+
+    /**
+     * \internal Element of a thread waiting list
+     */
+    class WaitToken : public IntrusiveListItem
+    {
+    public:
+        WaitToken(Thread *thread) : thread(thread) {}
+        Thread *thread; ///<\internal Waiting thread and spurious wakeup token
+    };
+
+    /**
+     * Entry point of worker threads
+     * \param arg pointer to the Worker
+     */
+    static void workerLauncher(void *arg);
+
+    /**
+     * Main loop of worker threads
+     * \param x the worker
+     */
+    void workerMain(Worker& x);
+
+    /**
+     * Post an event to a worker queue, and wake either the worker or, if it
+     * is busy, an idle worker that can steal the event
+     * \param worker worker index, must be less than numWorkers
+     * \param event event to post
+     * \param hppw if not null set to true if a higher priority thread is
+     * awakened, otherwise the variable is not modified
+     * \return false if there was no space in the queue
+     */
+    bool IRQpostImpl(unsigned int worker, Callback<SlotSize>& event,
+            bool *hppw=nullptr);
+
+    /**
+     * Take an event from a worker queue
+     * \param x the worker
+     * \param f the event is returned here
+     * \return false if the queue is empty
+     */
+    bool IRQtake(Worker& x, Callback<SlotSize>& f);
+
+    /**
+     * \return the index of the worker with the least events in its queue,
+     * rotating among equally loaded workers
+     */
+    unsigned int IRQleastLoaded();
+
+    /**
+     * Wait until an event is taken from any queue
+     * \param dLock interrupts are enabled while waiting
+     */
+    void IRQwaitPut(InterruptDisableLock& dLock);
+
+    std::unique_ptr<Worker[]> w;  ///< Workers
+    unsigned int numWorkers=0;    ///< Number of workers whose thread started
+    unsigned int next=0;          ///< Rotating start for IRQleastLoaded()
+    bool quit=false;              ///< Set by the destructor
+    IntrusiveList<WaitToken> waitingPut; ///< Threads waiting on a full queue
+};
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+Executor<SlotsPerWorker,SlotSize>::Executor(unsigned int numWorkers,
+        unsigned int stackSize, Priority priority)
+    : w(new Worker[numWorkers>0 ? numWorkers : 1])
+{
+    {
+        //Workers start running only once numWorkers is final, and workers
+        //whose thread could not be created are not used
+        PauseKernelLock pLock;
+        for(unsigned int i=0;i<(numWorkers>0 ? numWorkers : 1);i++)
+        {
+            Worker& x=w[this->numWorkers];
+            x.executor=this;
+            x.id=this->numWorkers;
+            x.thread=Thread::create(workerLauncher,stackSize,priority,&x,
+                                    Thread::JOINABLE);
+            if(x.thread) this->numWorkers++;
+        }
+    }
+    #ifndef __NO_EXCEPTIONS
+    if(this->numWorkers==0) throw std::bad_alloc();
+    #else //__NO_EXCEPTIONS
+    if(this->numWorkers==0) errorHandler(OUT_OF_MEMORY);
+    #endif //__NO_EXCEPTIONS
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+Executor<SlotsPerWorker,SlotSize>::~Executor()
+{
+    {
+        FastInterruptDisableLock dLock;
+        quit=true;
+        for(unsigned int i=0;i<numWorkers;i++)
+        {
+            if(w[i].idle==nullptr) continue;
+            w[i].idle->IRQwakeup();
+            w[i].idle=nullptr;
+        }
+    }
+    for(unsigned int i=0;i<numWorkers;i++) w[i].thread->join();
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+void Executor<SlotsPerWorker,SlotSize>::workerLauncher(void *arg)
+{
+    Worker *x=reinterpret_cast<Worker*>(arg);
+    x->executor->workerMain(*x);
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+void Executor<SlotsPerWorker,SlotSize>::workerMain(Worker& x)
+{
+    //Not FastInterruptDisableLock as the operator= of the bound
+    //parameters of the Callback may allocate
+    InterruptDisableLock dLock;
+    for(;;)
+    {
+        Callback<SlotSize> f;
+        bool found=IRQtake(x,f);
+        //Own queue empty, steal starting from the next worker to spread steals
+        for(unsigned int i=1;found==false && i<numWorkers;i++)
+        {
+            found=IRQtake(w[(x.id+i)%numWorkers],f);
+            if(found) x.steals++;
+        }
+        if(found)
+        {
+            x.executed++;
+            InterruptEnableLock eLock(dLock);
+            f();
+            continue;
+        }
+        if(quit) return;
+        x.idle=Thread::IRQgetCurrentThread();
+        //x.idle must be set to nullptr to protect against spurious wakeups
+        while(x.idle) Thread::IRQenableIrqAndWait(dLock);
+    }
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+bool Executor<SlotsPerWorker,SlotSize>::IRQpostImpl(unsigned int worker,
+        Callback<SlotSize>& event, bool *hppw)
+{
+    Worker& x=w[worker];
+    if(x.n>=SlotsPerWorker) return false;
+    x.events[x.put]=event; //This may allocate memory
+    if(++x.put>=SlotsPerWorker) x.put=0;
+    if(++x.n>x.maxDepth) x.maxDepth=x.n;
+    Worker *target=&x;
+    if(target->idle==nullptr)
+    {
+        //The worker is busy, wake an idle one so that it steals the event
+        for(unsigned int i=1;i<numWorkers;i++)
+        {
+            Worker *y=&w[(worker+i)%numWorkers];
+            if(y->idle) { target=y; break; }
+        }
+        if(target->idle==nullptr) return true;
+    }
+    Thread *t=target->idle;
+    target->idle=nullptr;
+    t->IRQwakeup();
+    if(hppw && t->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
+        *hppw=true;
+    return true;
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+bool Executor<SlotsPerWorker,SlotSize>::IRQtake(Worker& x,
+        Callback<SlotSize>& f)
+{
+    if(x.n==0) return false;
+    f=x.events[x.get]; //This may allocate memory
+    x.events[x.get].clear();
+    if(++x.get>=SlotsPerWorker) x.get=0;
+    x.n--;
+    //Threads may be waiting on different queues, so wake them all
+    while(waitingPut.empty()==false)
+    {
+        waitingPut.front()->thread->IRQwakeup();
+        waitingPut.front()->thread=nullptr;
+        waitingPut.pop_front();
+    }
+    return true;
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+unsigned int Executor<SlotsPerWorker,SlotSize>::IRQleastLoaded()
+{
+    unsigned int result=next;
+    for(unsigned int i=1;i<numWorkers;i++)
+    {
+        unsigned int j=(next+i)%numWorkers;
+        if(w[j].n<w[result].n) result=j;
+    }
+    if(++next>=numWorkers) next=0;
+    return result;
+}
+
+template<unsigned SlotsPerWorker, unsigned SlotSize>
+void Executor<SlotsPerWorker,SlotSize>::IRQwaitPut(InterruptDisableLock& dLock)
+{
+    WaitToken t(Thread::IRQgetCurrentThread());
+    waitingPut.push_back(&t);
+    //t.thread must be set to nullptr to protect against spurious wakeups
+    while(t.thread) Thread::IRQenableIrqAndWait(dLock);
+}
+
+} //namespace miosix
@@ -0,0 +1,356 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "block_cache.h"
+#include <cstring>
+#include <algorithm>
+#include "filesystem/ioctl.h"
+
+using namespace std;
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+//
+// class BlockCache
+//
+
+const unsigned int BlockCache::blockSize;
+const unsigned int BlockCache::maxMultiBlock;
+
+BlockCache::BlockCache(intrusive_ref_ptr<FileBase> disk, unsigned int numBlocks)
+    : FileBase(intrusive_ref_ptr<FilesystemBase>(),O_RDWR), disk(disk),
+      numBlocks(max(numBlocks,2u)),
+      multiBlock(min(maxMultiBlock,max(1u,this->numBlocks/4)))
+{
+    unsigned int hashSize=1;
+    while(hashSize<this->numBlocks) hashSize<<=1;
+    hashMask=hashSize-1;
+    blocks=new CacheBlock[this->numBlocks];
+    hashTable=new CacheBlock*[hashSize]();
+    storage=new char[this->numBlocks*blockSize];
+    scratch=new char[multiBlock*blockSize];
+    for(unsigned int i=0;i<this->numBlocks;i++)
+    {
+        blocks[i].data=storage+i*blockSize;
+        lru.push_back(&blocks[i]);
+    }
+}
+
+ssize_t BlockCache::write(const void *data, size_t len)
+{
+    ssize_t result=pwrite(data,len,seekPoint);
+    if(result>0) seekPoint+=result;
+    return result;
+}
+
+ssize_t BlockCache::read(void *data, size_t len)
+{
+    ssize_t result=pread(data,len,seekPoint);
+    if(result>0) seekPoint+=result;
+    return result;
+}
+
+off_t BlockCache::lseek(off_t pos, int whence)
+{
+    off_t newSeekPoint=seekPoint;
+    switch(whence)
+    {
+        case SEEK_CUR:
+            newSeekPoint+=pos;
+            break;
+        case SEEK_SET:
+            newSeekPoint=pos;
+            break;
+        case SEEK_END:
+        {
+            off_t size=disk->lseek(0,SEEK_END);
+            if(size<0) return size;
+            newSeekPoint=size+pos;
+            break;
+        }
+        default:
+            return -EINVAL;
+    }
+    if(newSeekPoint<0) return -EOVERFLOW;
+    seekPoint=newSeekPoint;
+    return seekPoint;
+}
+
+ssize_t BlockCache::pwrite(const void *data, size_t len, off_t pos)
+{
+    if(pos<0) return -EINVAL;
+    auto d=reinterpret_cast<const char*>(data);
+    Lock<FastMutex> l(mutex);
+    size_t done=0;
+    while(done<len)
+    {
+        unsigned int b=(pos+done)/blockSize;
+        unsigned int ofs=(pos+done)%blockSize;
+        size_t n=min<size_t>(len-done,blockSize-ofs);
+        CacheBlock *e=lookup(b);
+        if(e) stats.hits++;
+        else if(n==blockSize)
+        {
+            //The whole block is overwritten, no need to read it
+            int result=evict(e);
+            if(result<0) return done>0 ? done : result;
+            install(e,b);
+        } else {
+            stats.misses++;
+            int result=fill(b,1);
+            if(result<0) return done>0 ? done : result;
+            if(result==0)
+            {
+                //Writing past the end of the disk, the block is zero filled
+                result=evict(e);
+                if(result<0) return done>0 ? done : result;
+                memset(e->data,0,blockSize);
+                install(e,b);
+            } else e=lookup(b);
+        }
+        memcpy(e->data+ofs,d+done,n);
+        e->dirty=true;
+        touch(e);
+        done+=n;
+    }
+    return done;
+}
+
+ssize_t BlockCache::pread(void *data, size_t len, off_t pos)
+{
+    if(pos<0) return -EINVAL;
+    auto d=reinterpret_cast<char*>(data);
+    Lock<FastMutex> l(mutex);
+    size_t done=0;
+    unsigned int fetchedEnd=0; //Blocks before this were just read by fill()
+    while(done<len)
+    {
+        unsigned int b=(pos+done)/blockSize;
+        unsigned int ofs=(pos+done)%blockSize;
+        size_t n=min<size_t>(len-done,blockSize-ofs);
+        CacheBlock *e=lookup(b);
+        if(e==nullptr)
+        {
+            //Read all the blocks the request still needs in one transaction,
+            //and if the access is sequential also read ahead the next ones
+            unsigned int needed=(ofs+len-done+blockSize-1)/blockSize;
+            unsigned int count=needed;
+            if(b==nextSequential) count=max(count,multiBlock);
+            int result=fill(b,count);
+            if(result<0) return done>0 ? done : result;
+            if(result==0) break; //End of disk
+            unsigned int fetched=result;
+            stats.misses+=min(fetched,needed);
+            if(fetched>needed) stats.readAhead+=fetched-needed;
+            fetchedEnd=b+fetched;
+            e=lookup(b);
+        } else if(b>=fetchedEnd) stats.hits++;
+        memcpy(d+done,e->data+ofs,n);
+        touch(e);
+        done+=n;
+        nextSequential=b+1;
+    }
+    return done;
+}
+
+int BlockCache::ftruncate(off_t size) { return -EINVAL; }
+
+int BlockCache::fstat(struct stat *pstat) const
+{
+    return disk->fstat(pstat);
+}
+
+int BlockCache::ioctl(int cmd, void *arg)
+{
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+        {
+            Lock<FastMutex> l(mutex);
+            int result=flush();
+            if(result<0) return result;
+            result=disk->ioctl(cmd,arg);
+            //Allow caching regular files, which do not support ioctl
+            return result==-ENOTTY ? 0 : result;
+        }
+        case IOCTL_BLOCK_CACHE_STATS:
+        {
+            if(arg==nullptr) return -EFAULT;
+            Lock<FastMutex> l(mutex);
+            *reinterpret_cast<BlockCacheStats*>(arg)=stats;
+            return 0;
+        }
+        default:
+            return disk->ioctl(cmd,arg);
+    }
+}
+
+BlockCache::~BlockCache()
+{
+    flush();
+    delete[] scratch;
+    delete[] storage;
+    delete[] hashTable;
+    delete[] blocks;
+}
+
+BlockCache::CacheBlock *BlockCache::lookup(unsigned int block)
+{
+    for(auto e=hashTable[block & hashMask];e;e=e->hashNext)
+        if(e->block==block) return e;
+    return nullptr;
+}
+
+int BlockCache::evict(CacheBlock *& e)
+{
+    e=lru.front();
+    if(e->dirty)
+    {
+        int result=writeBack(e);
+        if(result<0) return result;
+    }
+    if(e->valid)
+    {
+        CacheBlock **p=&hashTable[e->block & hashMask];
+        while(*p!=e) p=&(*p)->hashNext;
+        *p=e->hashNext;
+        e->hashNext=nullptr;
+        e->valid=false;
+    }
+    //Move it to the back, so that consecutive calls return different blocks
+    touch(e);
+    return 0;
+}
+
+void BlockCache::install(CacheBlock *e, unsigned int block)
+{
+    e->block=block;
+    e->valid=true;
+    e->dirty=false;
+    e->hashNext=hashTable[block & hashMask];
+    hashTable[block & hashMask]=e;
+    touch(e);
+}
+
+int BlockCache::fill(unsigned int first, unsigned int count)
+{
+    count=min(count,multiBlock);
+    for(unsigned int i=1;i<count;i++)
+    {
+        if(lookup(first+i)==nullptr) continue;
+        count=i;
+        break;
+    }
+    //Evict before reading, as writing back dirty blocks uses scratch
+    CacheBlock *victims[maxMultiBlock];
+    for(unsigned int i=0;i<count;i++)
+    {
+        int result=evict(victims[i]);
+        if(result<0) return result;
+    }
+    ssize_t result=disk->pread(scratch,count*blockSize,
+                               static_cast<off_t>(first)*blockSize);
+    stats.diskReads++;
+    if(result<0) return result;
+    //The disk size is expected to be a multiple of the block size, if it is
+    //not the last block is zero filled
+    unsigned int n=(result+blockSize-1)/blockSize;
+    memset(scratch+result,0,n*blockSize-result);
+    for(unsigned int i=0;i<count;i++)
+    {
+        if(i<n)
+        {
+            memcpy(victims[i]->data,scratch+i*blockSize,blockSize);
+            install(victims[i],first+i);
+        } else {
+            //Unused blocks are the first to be reused
+            lru.removeFast(victims[i]);
+            lru.push_front(victims[i]);
+        }
+    }
+    return n;
+}
+
+int BlockCache::writeBack(CacheBlock *e)
+{
+    //Find the first block of the run of consecutive dirty blocks containing e,
+    //then write the run in chunks of up to multiBlock blocks until the chunk
+    //containing e. Starting from the first block of the run makes chunking
+    //independent of the order in which blocks are written back
+    unsigned int first=e->block;
+    while(first>0)
+    {
+        CacheBlock *p=lookup(first-1);
+        if(p==nullptr || p->dirty==false) break;
+        first--;
+    }
+    while(e->dirty)
+    {
+        CacheBlock *run[maxMultiBlock];
+        unsigned int count=0;
+        while(count<multiBlock)
+        {
+            CacheBlock *p=lookup(first+count);
+            if(p==nullptr || p->dirty==false) break;
+            run[count++]=p;
+        }
+        ssize_t result;
+        off_t pos=static_cast<off_t>(first)*blockSize;
+        if(count==1) result=disk->pwrite(run[0]->data,blockSize,pos);
+        else {
+            for(unsigned int i=0;i<count;i++)
+                memcpy(scratch+i*blockSize,run[i]->data,blockSize);
+            result=disk->pwrite(scratch,count*blockSize,pos);
+        }
+        stats.diskWrites++;
+        if(result!=static_cast<ssize_t>(count*blockSize))
+            return result<0 ? result : -EIO;
+        stats.blocksWritten+=count;
+        for(unsigned int i=0;i<count;i++) run[i]->dirty=false;
+        first+=count;
+    }
+    return 0;
+}
+
+int BlockCache::flush()
+{
+    //Writing back a block also writes the adjacent dirty ones, so runs of
+    //consecutive dirty blocks become multi-block writes
+    for(unsigned int i=0;i<numBlocks;i++)
+    {
+        if(blocks[i].dirty==false) continue;
+        int result=writeBack(&blocks[i]);
+        if(result<0) return result;
+    }
+    return 0;
+}
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
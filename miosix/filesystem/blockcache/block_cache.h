@@ -0,0 +1,247 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "filesystem/file.h"
+#include "kernel/sync.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * Statistics of a BlockCache, returned by IOCTL_BLOCK_CACHE_STATS
+ */
+struct BlockCacheStats
+{
+    unsigned int hits;          ///< Block accesses served from the cache
+    unsigned int misses;        ///< Block accesses that required a disk read
+    unsigned int readAhead;     ///< Blocks read before being requested
+    unsigned int diskReads;     ///< Read transactions to the disk
+    unsigned int diskWrites;    ///< Write transactions to the disk
+    unsigned int blocksWritten; ///< Blocks written to the disk
+};
+
+/**
+ * A write-back block cache, to be placed between a filesystem and the disk it
+ * is mounted on. It has the same interface as the disk it wraps, so it can be
+ * passed to any filesystem in place of the disk itself.
+ *
+ * Blocks are replaced in least recently used order. Written blocks are kept in
+ * the cache until they are evicted or IOCTL_SYNC is called, and consecutive
+ * dirty blocks are written to the disk with a single multi-block write.
+ * Sequential reads are detected, and the following blocks are read ahead with
+ * a single multi-block read.
+ *
+ * Classes of this type are reference counted, must be allocated on the heap
+ * and managed through intrusive_ref_ptr<FileBase>
+ */
+class BlockCache : public FileBase
+{
+public:
+    /**
+     * Constructor. All the memory used by the cache is allocated here.
+     * \param disk the disk to cache, accessed with pread(), pwrite() and ioctl()
+     * \param numBlocks number of blocks in the cache, must be at least 2
+     */
+    BlockCache(intrusive_ref_ptr<FileBase> disk, unsigned int numBlocks);
+
+    /**
+     * Write data to the file, if the file supports writing.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the file, if the file supports reading.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Move file pointer, if the file supports random-access.
+     * \param pos offset to sum to the beginning of the file, current position
+     * or end of file, depending on whence
+     * \param whence SEEK_SET, SEEK_CUR or SEEK_END
+     * \return the offset from the beginning of the file if the operation
+     * completed, or a negative number in case of errors
+     */
+    virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Write data to the file at a given position, without changing the file
+     * pointer.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+
+    /**
+     * Read data from the file at a given position, without changing the file
+     * pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+
+    /**
+     * Truncate the file
+     * \param size new file size
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int ftruncate(off_t size);
+
+    /**
+     * Return file information.
+     * \param pstat pointer to stat struct
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+    /**
+     * Perform various operations on a file descriptor. IOCTL_SYNC writes all
+     * dirty blocks to the disk before forwarding the sync to it,
+     * IOCTL_BLOCK_CACHE_STATS copies the cache statistics into a
+     * BlockCacheStats pointed to by arg. Other operations are forwarded to
+     * the disk.
+     * \param cmd specifies the operation to perform
+     * \param arg optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int ioctl(int cmd, void *arg);
+
+    /**
+     * Destructor, writes all dirty blocks to the disk
+     */
+    ~BlockCache();
+
+    static const unsigned int blockSize=512;     ///< Cache block size
+    static const unsigned int maxMultiBlock=8;   ///< Max blocks per transfer
+
+private:
+    BlockCache(const BlockCache&)=delete;
+    BlockCache& operator=(const BlockCache&)=delete;
+
+    /**
+     * A block in the cache
+     */
+    class CacheBlock : public IntrusiveListItem
+    {
+    public:
+        unsigned int block=0;         ///< Disk block number
+        CacheBlock *hashNext=nullptr; ///< Next block in the same hash bucket
+        char *data=nullptr;           ///< Block content
+        bool valid=false;             ///< True if the block holds disk data
+        bool dirty=false;             ///< True if it must be written back
+    };
+
+    /**
+     * \param block disk block number
+     * \return the cached block, or nullptr if the block is not in the cache
+     */
+    CacheBlock *lookup(unsigned int block);
+
+    /**
+     * Mark a block as the most recently used
+     */
+    void touch(CacheBlock *e)
+    {
+        lru.removeFast(e);
+        lru.push_back(e);
+    }
+
+    /**
+     * Take the least recently used block out of the cache, writing it to the
+     * disk if dirty
+     * \param e the free block is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int evict(CacheBlock *& e);
+
+    /**
+     * Put a block in the cache
+     * \param e a block returned by evict()
+     * \param block the disk block number
+     */
+    void install(CacheBlock *e, unsigned int block);
+
+    /**
+     * Read blocks from the disk with a single transaction
+     * \param first first block to read, must not be in the cache
+     * \param count number of blocks to read, stops early at the first block
+     * that is already in the cache
+     * \return the number of blocks read, 0 at the end of the disk, or a
+     * negative number on failure
+     */
+    int fill(unsigned int first, unsigned int count);
+
+    /**
+     * Write a dirty block to the disk, together with the dirty blocks
+     * adjacent to it, using multi-block writes
+     * \param e a dirty block
+     * \return 0 on success, or a negative number on failure
+     */
+    int writeBack(CacheBlock *e);
+
+    /**
+     * Write all dirty blocks to the disk
+     * \return 0 on success, or a negative number on failure
+     */
+    int flush();
+
+    intrusive_ref_ptr<FileBase> disk;
+    FastMutex mutex;
+    const unsigned int numBlocks;
+    const unsigned int multiBlock;   ///< Blocks per multi-block transfer
+    unsigned int hashMask;
+    CacheBlock *blocks;              ///< All the blocks
+    CacheBlock **hashTable;          ///< Hash table to find cached blocks
+    IntrusiveList<CacheBlock> lru;   ///< Least recently used at the front
+    char *storage;                   ///< Content of all the blocks
+    char *scratch;                   ///< Buffer for multi-block transfers
+    unsigned int nextSequential=0;   ///< Block that a sequential read would access
+    off_t seekPoint=0;
+    BlockCacheStats stats={0,0,0,0,0,0};
+};
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
@@ -106,6 +106,10 @@ int TerminalDevice::fstat(struct stat *pstat) const
 
 int TerminalDevice::isatty() const { return device->isatty(); }
 
+int TerminalDevice::poll(int events) { return device->poll(events); }
+
+PollQueue *TerminalDevice::getPollQueue() { return device->getPollQueue(); }
+
 #endif //WITH_FILESYSTEM
 
 int TerminalDevice::ioctl(int cmd, void *arg)
@@ -97,6 +97,18 @@ public:
      * case of errors
      */
     virtual int isatty() const;
+
+    /**
+     * Check whether the terminal is ready for I/O, used to implement poll().
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    virtual int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on the terminal
+     */
+    virtual PollQueue *getPollQueue();
     
     #endif //WITH_FILESYSTEM
     
@@ -94,6 +94,28 @@ public:
      */
     virtual off_t lseek(off_t pos, int whence);
 
+    /**
+     * Write data to the file at a given position, without changing the file
+     * pointer.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+
+    /**
+     * Read data from the file at a given position, without changing the file
+     * pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+
     /**
      * Truncate the file
      * \param size new file size
@@ -123,6 +145,18 @@ public:
      */
     virtual int ioctl(int cmd, void *arg);
 
+    /**
+     * Check whether the file is ready for I/O, used to implement poll().
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    virtual int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on the device
+     */
+    virtual PollQueue *getPollQueue();
+
 private:
     intrusive_ref_ptr<Device> dev; ///< Device file
     off_t seekPoint;               ///< Seek point (note that off_t is 64bit)
@@ -148,6 +182,26 @@ ssize_t DevFsFile::read(void *data, size_t len)
     return result;
 }
 
+ssize_t DevFsFile::pwrite(const void *data, size_t len, off_t pos)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos<0) return -EINVAL;
+    if(pos+static_cast<off_t>(len)<0)
+        len=numeric_limits<off_t>::max()-pos-len;
+    return dev->writeBlock(data,len,pos);
+}
+
+ssize_t DevFsFile::pread(void *data, size_t len, off_t pos)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos<0) return -EINVAL;
+    if(pos+static_cast<off_t>(len)<0)
+        len=numeric_limits<off_t>::max()-pos-len;
+    return dev->readBlock(data,len,pos);
+}
+
 off_t DevFsFile::lseek(off_t pos, int whence)
 {
     if(flags & _NOSEEK) return -EBADF; //No seek support
@@ -186,6 +240,16 @@ int DevFsFile::ioctl(int cmd, void *arg)
     return dev->ioctl(cmd,arg);
 }
 
+int DevFsFile::poll(int events)
+{
+    return dev->poll(events);
+}
+
+PollQueue *DevFsFile::getPollQueue()
+{
+    return dev->getPollQueue();
+}
+
 //
 // class Device
 //
@@ -211,6 +275,18 @@ int Device::isatty() const
     return tty ? 1 : 0;
 }
 
+int Device::poll(int events)
+{
+    //Block devices never block, while for stream devices that do not
+    //reimplement this there is no way to know whether a read would block
+    return block ? POLLIN | POLLOUT : POLLOUT;
+}
+
+PollQueue *Device::getPollQueue()
+{
+    return nullptr;
+}
+
 #endif //WITH_FILESYSTEM || WITH_DEVFS
 
 ssize_t Device::readBlock(void *buffer, size_t size, off_t where)
@@ -317,14 +393,32 @@ int DevFsDirectory::getdents(void *dp, int len)
     return buffer-begin;
 }
 
+/**
+ * Device for /dev/null and /dev/zero, whose reads and writes never block
+ */
+class NullDevice : public Device
+{
+public:
+    /**
+     * Constructor
+     */
+    NullDevice() : Device(Device::STREAM) {}
+
+    /**
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return POLLIN | POLLOUT, as the device is always ready
+     */
+    int poll(int events) { return POLLIN | POLLOUT; }
+};
+
 //
 // class DevFs
 //
 
 DevFs::DevFs() : mutex(FastMutex::RECURSIVE), inodeCount(rootDirInode+1)
 {
-    addDevice("null",intrusive_ref_ptr<Device>(new Device(Device::STREAM)));
-    addDevice("zero",intrusive_ref_ptr<Device>(new Device(Device::STREAM)));
+    addDevice("null",intrusive_ref_ptr<Device>(new NullDevice));
+    addDevice("zero",intrusive_ref_ptr<Device>(new NullDevice));
 }
 
 bool DevFs::addDevice(const char *name, intrusive_ref_ptr<Device> dev)
@@ -98,6 +98,24 @@ public:
      */
     virtual int isatty() const;
 
+    /**
+     * Check whether the device is ready for I/O, used to implement poll().
+     * Stream devices whose reads or writes can block should reimplement this
+     * and getPollQueue(). This default implementation reports block devices as
+     * readable and writable, and stream devices only as writable, as it cannot
+     * know whether a read would block.
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    virtual int poll(int events);
+
+    /**
+     * \return the queue of threads blocked in poll() on this device, or
+     * nullptr if the device readiness never changes. This default
+     * implementation returns nullptr.
+     */
+    virtual PollQueue *getPollQueue();
+
     #endif //WITH_FILESYSTEM || WITH_DEVFS
     
     #ifdef WITH_DEVFS
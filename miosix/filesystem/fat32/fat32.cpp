@@ -180,17 +180,22 @@ Fat32Directory::~Fat32Directory()
 }
 
 /**
- * Files of the Fat32Fs filesystem
+ * Files of the Fat32Fs filesystem.
+ * Each file has its own mutex, so that reads and writes to different files can
+ * proceed in parallel. The filesystem mutex, which protects the FAT, the
+ * directories and the list of unsynced files, is locked only for as long as
+ * these are accessed, and always after the file mutex
  */
-class Fat32File : public FileBase
+class Fat32File : public FileBase, public IntrusiveListItem
 {
 public:
     /**
      * Constructor
      * \param parent the filesystem to which this file belongs
      * \param flags file open flags
+     * \param fs pointer to the parent filesystem, to access its FatFs state
      */
-    Fat32File(intrusive_ref_ptr<FilesystemBase> parent, int flags, FastMutex& mutex);
+    Fat32File(intrusive_ref_ptr<FilesystemBase> parent, int flags, Fat32Fs *fs);
     
     /**
      * Write data to the file, if the file supports writing.
@@ -226,6 +231,18 @@ public:
      * \return 0 on success, or a negative number on failure
      */
     virtual int ftruncate(off_t size);
+
+    /**
+     * Allocate the clusters for a range of the file as a single contiguous
+     * run, so that writing to the range does not need to update the FAT.
+     * Clusters allocated past the end of the file are released on close.
+     * \param mode 0 to extend the file size to offset+len if it is smaller,
+     * or FALLOC_FL_KEEP_SIZE to allocate clusters without changing the size
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(int mode, off_t offset, off_t len);
     
     /**
      * Return file information.
@@ -235,7 +252,9 @@ public:
     virtual int fstat(struct stat *pstat) const;
     
     /**
-     * Perform various operations on a file descriptor
+     * Perform various operations on a file descriptor. Supports IOCTL_SYNC,
+     * and IOCTL_FAT32_FASTSEEK to build the cluster map of the file without
+     * waiting for the first far seek
      * \param cmd specifies the operation to perform
      * \param arg optional argument that some operation require
      * \return the exact return value depends on CMD, -1 is returned on error
@@ -251,16 +270,87 @@ public:
      * \param inode file inode
      */
     void setInode(int inode) { this->inode=inode; }
-    
+
+    /**
+     * Sync the file, must be called with the file mutex locked.
+     * If syncing fails, a file handled by the flusher thread stays dirty
+     * \return 0 on success, or a negative number on failure
+     */
+    int syncLocked();
+
+    /**
+     * Called by the flusher thread, with the filesystem mutex locked
+     * \param now current time
+     * \return true if the file has to be synced
+     */
+    bool syncDue(long long now) const
+    {
+        return now-dirtySince>=fs->writeBackParams.interval
+            || dirtyBytes>=fs->writeBackParams.byteThreshold;
+    }
+
     /**
      * Destructor
      */
     ~Fat32File();
     
 private:
+    /**
+     * Called after the file is modified, with the file mutex locked.
+     * Syncs the file if SYNC_AFTER_WRITE is defined, or hands it to the
+     * flusher thread if write-back is enabled
+     * \param bytes number of bytes written
+     * \return 0 on success, or a negative number on failure
+     */
+    int modified(unsigned int bytes);
+
+    /**
+     * Build the cluster map used by FatFs fast seek, must be called with the
+     * file mutex locked
+     * \return 0 on success, or a negative number on failure
+     */
+    int buildClusterMap();
+
+    /**
+     * Drop the cluster map, as it does not cover clusters added to the file.
+     * Must be called with the file mutex locked
+     */
+    void dropClusterMap()
+    {
+        file.cltbl=nullptr;
+        clusterMap.reset();
+    }
+
+    /**
+     * \param offset offset to seek to, not past the end of the file
+     * \return true if seeking there requires following many links in the
+     * cluster chain
+     */
+    bool farSeek(off_t offset) const
+    {
+        //FatFs follows the cluster chain from the current cluster when seeking
+        //forward, and from the first cluster when seeking backward
+        off_t clusterSize=file.fs->csize*_MAX_SS;
+        off_t current=static_cast<off_t>(f_tell(&file))/clusterSize;
+        off_t target=offset/clusterSize;
+        return target<current || target>current+1;
+    }
+
     FIL file;
-    FastMutex& mutex;
+    Fat32Fs *fs;
+    FastMutex mutex;           ///< Locked before the filesystem mutex
     int inode=0;
+    bool dirty=false;          ///< True if in the list of unsynced files
+    unsigned int dirtyBytes=0; ///< Bytes written since last sync
+    long long dirtySince=0;    ///< When the file was first modified
+    /// Cluster map for FatFs fast seek, or nullptr if not built
+    unique_ptr<DWORD[]> clusterMap;
+    /// True if the file has too many fragments for a cluster map
+    bool tooFragmented=false;
+    /// True if clusters may have been allocated past the end of the file
+    bool reserved=false;
+
+    friend class Fat32Fs;
     /// Used to map FatFs behavior into POSIX. Variable is 0 as long as we seek
     /// within, contains by how many bytes we seeked past the end otherwise
     off_t seekPastEnd=0;
@@ -270,13 +360,16 @@ private:
 // class Fat32File
 //
 
-Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, int flags, FastMutex& mutex)
-        : FileBase(parent,flags), mutex(mutex) {}
+Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, int flags, Fat32Fs *fs)
+        : FileBase(parent,flags), fs(fs), mutex(FastMutex::RECURSIVE) {}
 
 ssize_t Fat32File::write(const void *data, size_t len)
 {
     Lock<FastMutex> l(mutex);
     unsigned int bytesWritten;
+    //The cluster map does not allow FatFs to add clusters to the file
+    if(file.cltbl && f_tell(&file)+seekPastEnd+len>f_size(&file))
+        dropClusterMap();
     //NOTE: if we lseek'd past the end, we f_lseek'd to the end and seekPastEnd
     //is >0. We need to handle this special case by filling the gap with zeros
     //Note that in this case write should not return the number of bytes written
@@ -300,9 +393,7 @@ ssize_t Fat32File::write(const void *data, size_t len)
         }
     }
     if(int res=translateError(f_write(&file,data,len,&bytesWritten))) return res;
-    #ifdef SYNC_AFTER_WRITE
-    if(f_sync(&file)!=FR_OK) return -EIO;
-    #endif //SYNC_AFTER_WRITE    
+    if(modified(bytesWritten)) return -EIO;
     return static_cast<int>(bytesWritten);
 }
 
@@ -349,6 +440,10 @@ off_t Fat32File::lseek(off_t pos, int whence)
         seekPastEnd=offset-fileSize;
         offset=fileSize;
     } else seekPastEnd=0;
+    //Failing to build the cluster map just makes the seek slower
+    if(file.cltbl==nullptr && tooFragmented==false && farSeek(offset))
+        buildClusterMap();
+    Lock<FastMutex> l2(fs->mutex);
     if(int result=translateError(
         f_lseek(&file,static_cast<unsigned long>(offset)))) return result;
     return offset+seekPastEnd;
@@ -362,12 +457,18 @@ int Fat32File::ftruncate(off_t size)
     off_t curPos=static_cast<off_t>(f_tell(&file))+seekPastEnd;
 
     int result=0;
+    dropClusterMap();
+    tooFragmented=false;
     if(size<fileSize)
     {
         //Shrinking, FatFs f_truncate truncates to the current file position
-        int r=translateError(f_lseek(&file,static_cast<unsigned long>(size)));
-        if(r) return r;
-        result=translateError(f_truncate(&file));
+        {
+            Lock<FastMutex> l2(fs->mutex);
+            int r=translateError(f_lseek(&file,static_cast<unsigned long>(size)));
+            if(r) return r;
+            result=translateError(f_truncate(&file));
+        }
+        if(result==0) result=modified(0);
     } else {
         //Enlarging, can't use f_truncate so seek past the end an write
         off_t r=lseek(size,SEEK_SET);
@@ -380,6 +481,28 @@ int Fat32File::ftruncate(off_t size)
     return result;
 }
 
+int Fat32File::fallocate(int mode, off_t offset, off_t len)
+{
+    if(mode & ~FALLOC_FL_KEEP_SIZE) return -EOPNOTSUPP;
+    off_t end=offset+len;
+    if(end>0xffffffff) return -EFBIG;
+    Lock<FastMutex> l(mutex);
+    if((file.flag & FA_WRITE)==0) return -EBADF;
+    dropClusterMap();
+    int res;
+    {
+        Lock<FastMutex> l2(fs->mutex);
+        res=f_reserve(&file,end);
+    }
+    if(res==FR_DENIED) return -ENOSPC; //No contiguous free space
+    if(res) return translateError(res);
+    reserved=true;
+    //Extending the size zero-fills the range, writing to the reserved clusters
+    if((mode & FALLOC_FL_KEEP_SIZE)==0 && end>static_cast<off_t>(f_size(&file)))
+        return ftruncate(end);
+    return modified(0);
+}
+
 int Fat32File::fstat(struct stat *pstat) const
 {
     memset(pstat,0,sizeof(struct stat));
@@ -395,17 +518,112 @@ int Fat32File::fstat(struct stat *pstat) const
 
 int Fat32File::ioctl(int cmd, void *arg)
 {
-    if(cmd!=IOCTL_SYNC) return -ENOTTY;
     Lock<FastMutex> l(mutex);
-    return translateError(f_sync(&file));
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+            return syncLocked();
+        case IOCTL_FAT32_FASTSEEK:
+            return buildClusterMap();
+        default:
+            return -ENOTTY;
+    }
+}
+
+int Fat32File::syncLocked()
+{
+    Lock<FastMutex> l(fs->mutex);
+    int result=translateError(f_sync(&file));
+    if(dirty)
+    {
+        fs->dirtyFiles.removeFast(this);
+        if(result==0) dirty=false;
+        else {
+            //Keep the file dirty, so that the flusher retries syncing it after
+            //the write-back interval. Moving it to the back of the list keeps
+            //the list sorted by dirtySince
+            dirtySince=getTime();
+            fs->dirtyFiles.push_back(this);
+        }
+    }
+    dirtyBytes=0;
+    return result;
 }
 
 Fat32File::~Fat32File()
 {
     Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l2(fs->mutex);
+    //f_close also syncs the file
+    if(dirty) fs->dirtyFiles.removeFast(this);
+    //There is no caller to report a trim failure to. The reserved clusters
+    //then stay linked past the end of the file, which wastes space but keeps
+    //the FAT consistent, and they are freed if the file is truncated or
+    //deleted. The file still has to be closed, so the error is not fatal
+    if(reserved)
+    {
+        BYTE err=file.err;
+        if(f_trim(&file)!=FR_OK) file.err=err;
+    }
     if(inode) f_close(&file); //TODO: what to do with error code?
 }
 
+int Fat32File::buildClusterMap()
+{
+    if(file.cltbl) return 0;
+    if(tooFragmented) return -ENOMEM;
+    //The map has a two word header plus two words per fragment. Start sized
+    //for a contiguous file, FatFs reports the required size if too small
+    unsigned int size=4;
+    Lock<FastMutex> l(fs->mutex);
+    for(;;)
+    {
+        clusterMap.reset(new (nothrow) DWORD[size]);
+        if(!clusterMap) return -ENOMEM;
+        clusterMap[0]=size;
+        file.cltbl=clusterMap.get();
+        int res=f_lseek(&file,CREATE_LINKMAP);
+        if(res==FR_OK) return 0;
+        unsigned int required=clusterMap[0];
+        dropClusterMap();
+        if(res!=FR_NOT_ENOUGH_CORE) return translateError(res);
+        if(required>2+2*FATFS_FASTSEEK_MAX_FRAGMENTS)
+        {
+            tooFragmented=true;
+            return -ENOMEM;
+        }
+        size=required;
+    }
+}
+
+int Fat32File::modified(unsigned int bytes)
+{
+    Lock<FastMutex> l(fs->mutex);
+    if(fs->writeBack)
+    {
+        if(dirty==false)
+        {
+            dirty=true;
+            dirtySince=getTime();
+            fs->dirtyFiles.push_back(this);
+            //Wake the flusher so that it waits for this file's deadline
+            fs->flusherCv.signal();
+        }
+        dirtyBytes+=bytes;
+        if(dirtyBytes>=fs->writeBackParams.byteThreshold
+            && fs->flushRequested==false)
+        {
+            fs->flushRequested=true;
+            fs->flusherCv.signal();
+        }
+        return 0;
+    }
+    #ifdef SYNC_AFTER_WRITE
+    if(f_sync(&file)!=FR_OK) return -EIO;
+    #endif //SYNC_AFTER_WRITE
+    return 0;
+}
+
 //
 // class Fat32Fs
 //
@@ -414,7 +632,17 @@ Fat32Fs::Fat32Fs(intrusive_ref_ptr<FileBase> disk)
         : mutex(FastMutex::RECURSIVE), failed(true)
 {
     filesystem.drv=disk;
+    filesystem.mutex=&mutex;
     failed=f_mount(&filesystem,1,false)!=FR_OK;
+    #ifdef FAT32_WRITE_BACK
+    startWriteBack({FAT32_WRITE_BACK_INTERVAL,FAT32_WRITE_BACK_BYTES});
+    #endif //FAT32_WRITE_BACK
+}
+
+Fat32Fs::Fat32Fs(intrusive_ref_ptr<FileBase> disk,
+        const Fat32WriteBack& writeBack) : Fat32Fs(disk)
+{
+    startWriteBack(writeBack);
 }
 
 int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
@@ -449,7 +677,7 @@ int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
         else if(flags & _FCREAT) openflags|=FA_OPEN_ALWAYS;//If !exists create
         else openflags|=FA_OPEN_EXISTING;//If not exists fail
 
-        intrusive_ref_ptr<Fat32File> f(new Fat32File(shared_from_this(),flags-1,mutex));
+        intrusive_ref_ptr<Fat32File> f(new Fat32File(shared_from_this(),flags-1,this));
         Lock<FastMutex> l(mutex);
         if(int res=translateError(f_open(&filesystem,f->fil(),name.c_str(),openflags)))
             return res;
@@ -461,7 +689,7 @@ int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
         f->setInode(st.st_ino);
 
         #ifdef SYNC_AFTER_WRITE
-        if(f_sync(f->fil())!=FR_OK) return -EFAULT;
+        if(writeBack==false && f_sync(f->fil())!=FR_OK) return -EFAULT;
         #endif //SYNC_AFTER_WRITE
 
         //If file opened for appending, seek to end of file
@@ -530,6 +758,24 @@ int Fat32Fs::lstat(StringPart& name, struct stat *pstat)
     return 0;
 }
 
+int Fat32Fs::statfs(struct statfs *buf)
+{
+    if(failed) return -ENOENT;
+    DWORD freeClusters;
+    Lock<FastMutex> l(mutex);
+    if(int result=translateError(f_getfree(&filesystem,&freeClusters)))
+        return result;
+    memset(buf,0,sizeof(struct statfs));
+    buf->f_type=0x4d44; //MSDOS_SUPER_MAGIC
+    buf->f_bsize=filesystem.csize*_MAX_SS;
+    buf->f_frsize=buf->f_bsize;
+    buf->f_blocks=filesystem.n_fatent-2;
+    buf->f_bfree=freeClusters;
+    buf->f_bavail=freeClusters;
+    buf->f_namelen=_MAX_LFN;
+    return 0;
+}
+
 int Fat32Fs::truncate(StringPart& name, off_t size)
 {
     //FatFs does not have a truncate, so we need to open the file and ftruncate
@@ -565,11 +811,82 @@ int Fat32Fs::rmdir(StringPart& name)
 Fat32Fs::~Fat32Fs()
 {
     if(failed) return;
+    if(flusher)
+    {
+        {
+            Lock<FastMutex> l(mutex);
+            flusherStop=true;
+            flusherCv.signal();
+        }
+        flusher->join();
+    }
     f_mount(&filesystem,0,true); //TODO: what to do with error code?
     filesystem.drv->ioctl(IOCTL_SYNC,0);
     filesystem.drv.reset();
 }
 
+void Fat32Fs::startWriteBack(const Fat32WriteBack& writeBack)
+{
+    if(failed) return;
+    Lock<FastMutex> l(mutex);
+    writeBackParams=writeBack;
+    this->writeBack=true;
+    if(flusher) return;
+    flusher=Thread::create(flusherThread,STACK_DEFAULT_FOR_PTHREAD,
+        Priority(),this,Thread::JOINABLE);
+    //Without the flusher thread, fall back to syncing files on close
+    if(flusher==nullptr) this->writeBack=false;
+}
+
+/// When the flusher thread finds a file that is being accessed, it retries
+/// syncing it after this time in nanoseconds
+static const long long flusherRetryDelay=10000000; //10ms
+
+void Fat32Fs::flusherThread(void *argv)
+{
+    Fat32Fs *fs=reinterpret_cast<Fat32Fs*>(argv);
+    Lock<FastMutex> l(fs->mutex);
+    while(fs->flusherStop==false)
+    {
+        if(fs->dirtyFiles.empty())
+        {
+            fs->flusherCv.wait(l);
+            continue;
+        }
+        //Files are in the list in the order they were first modified, so the
+        //front one has the earliest deadline
+        long long deadline=fs->dirtyFiles.front()->dirtySince
+                          +fs->writeBackParams.interval;
+        if(fs->flushRequested==false && getTime()<deadline)
+        {
+            fs->flusherCv.timedWait(l,deadline);
+            continue;
+        }
+        fs->flushRequested=false;
+        long long now=getTime();
+        bool busy=false;
+        for(auto it=fs->dirtyFiles.begin();it!=fs->dirtyFiles.end();)
+        {
+            Fat32File *f=*it;
+            ++it; //Syncing removes the file from the list
+            if(f->syncDue(now)==false) continue;
+            //File mutexes are locked before the filesystem one, so to avoid
+            //deadlocks files that are being accessed are synced later
+            if(f->mutex.tryLock()==false)
+            {
+                busy=true;
+                continue;
+            }
+            //If syncing fails the file stays dirty and is retried later
+            f->syncLocked();
+            f->mutex.unlock();
+        }
+        if(busy) fs->flusherCv.timedWait(l,now+flusherRetryDelay);
+    }
+    //Files sync themselves when closed and the filesystem is destroyed only
+    //once no file is open, so there is nothing left to flush
+}
+
 int Fat32Fs::unlinkRmdirHelper(StringPart& name, bool delDir)
 {
     if(failed) return -ENOENT;
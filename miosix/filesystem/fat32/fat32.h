@@ -37,6 +37,17 @@ namespace miosix {
     
 #ifdef WITH_FILESYSTEM
 
+class Fat32File;
+
+/**
+ * Write-back parameters of a Fat32Fs
+ */
+struct Fat32WriteBack
+{
+    long long interval;         ///< Max time in ns a file can remain unsynced
+    unsigned int byteThreshold; ///< Unsynced bytes causing an early sync
+};
+
 /**
  * Fat32 Filesystem.
  */
@@ -44,9 +55,23 @@ class Fat32Fs : public FilesystemBase
 {
 public:
     /**
-     * Constructor
+     * Constructor. Files are synced as selected by the SYNC_AFTER_WRITE and
+     * FAT32_WRITE_BACK options in miosix_settings.h
+     * \param disk disk to mount
      */
     Fat32Fs(intrusive_ref_ptr<FileBase> disk);
+
+    /**
+     * Constructor, enabling write-back for this filesystem. Instead of
+     * syncing files after each write, a flusher thread syncs them
+     * writeBack.interval nanoseconds after they were first modified, or as soon
+     * as writeBack.byteThreshold bytes have been written to them, whichever
+     * comes first. IOCTL_SYNC still syncs a file immediately, and all files
+     * are synced when the filesystem is unmounted.
+     * \param disk disk to mount
+     * \param writeBack write-back parameters
+     */
+    Fat32Fs(intrusive_ref_ptr<FileBase> disk, const Fat32WriteBack& writeBack);
     
     /**
      * Open a file
@@ -69,6 +94,16 @@ public:
      */
     virtual int lstat(StringPart& name, struct stat *pstat);
 
+    /**
+     * Return information about the filesystem, such as its free space.
+     * The free cluster count is taken from the FSInfo sector if it can be
+     * trusted according to FAT32_FSINFO_POLICY, otherwise it is computed by
+     * scanning the FAT the first time this function is called
+     * \param buf filesystem information is returned here
+     * \return 0 on success, a negative number on failure
+     */
+    virtual int statfs(struct statfs *buf);
+
     /**
      * Change file size
      * \param name path name, relative to the local filesystem
@@ -120,10 +155,32 @@ public:
 private:
     
     int unlinkRmdirHelper(StringPart& name, bool delDir);
-    
+
+    /**
+     * Start the flusher thread, if not already started
+     * \param writeBack write-back parameters
+     */
+    void startWriteBack(const Fat32WriteBack& writeBack);
+
+    /**
+     * Entry point of the flusher thread
+     * \param argv the filesystem
+     */
+    static void flusherThread(void *argv);
+
     FATFS filesystem;
-    FastMutex mutex;
+    FastMutex mutex; ///< Protects FAT, directories and the unsynced files list
     bool failed; ///< Failed to mount
+
+    bool writeBack=false;             ///< True if write-back is enabled
+    bool flusherStop=false;           ///< Asks the flusher thread to quit
+    bool flushRequested=false;        ///< A file exceeded byteThreshold
+    Fat32WriteBack writeBackParams;   ///< Write-back parameters
+    IntrusiveList<Fat32File> dirtyFiles; ///< Unsynced files, oldest first
+    ConditionVariable flusherCv;      ///< To wake the flusher thread
+    Thread *flusher=nullptr;          ///< Flusher thread
+
+    friend class Fat32File;
 };
 
 #endif //WITH_FILESYSTEM
@@ -179,6 +179,12 @@
 
 #define	ABORT(fs, res)		{ fp->err = (BYTE)(res); LEAVE_FF(fs, res); }
 
+/* By TFT: f_read() and f_write() lock the volume only around FAT accesses, so
+   that data transfers of different files can overlap. All other functions need
+   to be called with the volume locked, see Fat32Fs */
+#define	LOCK_FAT(fs)		{ if ((fs)->mutex) (fs)->mutex->lock(); }
+#define	UNLOCK_FAT(fs)		{ if ((fs)->mutex) (fs)->mutex->unlock(); }
+
 
 
 
@@ -461,6 +467,7 @@
 #define	FSI_StrucSig		484	/* FSI: Structure signature (4) */
 #define	FSI_Free_Count		488	/* FSI: Number of free clusters (4) */
 #define	FSI_Nxt_Free		492	/* FSI: Last allocated cluster (4) */
+#define	FAT1_CLEAN			0x08000000	/* FAT[1]: Clean shutdown flag (FAT32) */
 #define MBR_Table			446	/* MBR: Partition table offset (2) */
 #define	SZ_PTE				16	/* MBR: Size of a partition table entry */
 #define BS_55AA				510	/* Boot sector signature (2) */
@@ -837,7 +844,7 @@ FRESULT sync_fs (	/* FR_OK: successful, FR_DISK_ERR: failed */
 	res = sync_window(fs);
 	if (res == FR_OK) {
 		/* Update FSINFO sector if needed */
-		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {
+		if (fs->fs_type == FS_FAT32 && (fs->fsi_flag & 0x81) == 1) {
 			/* Create FSINFO structure */
 			mem_set(fs->win, 0, SS(fs));
 			ST_WORD(fs->win+BS_55AA, 0xAA55);
@@ -848,7 +855,7 @@ FRESULT sync_fs (	/* FR_OK: successful, FR_DISK_ERR: failed */
 			/* Write it into the FSINFO sector */
 			fs->winsect = fs->volbase + 1;
 			disk_write(fs->drv, fs->win, fs->winsect, 1);
-			fs->fsi_flag = 0;
+			fs->fsi_flag &= ~1;
 		}
 		/* Make sure that no pending write process in the physical drive */
 		if (disk_ioctl(fs->drv, CTRL_SYNC, 0) != RES_OK)
@@ -2308,10 +2315,33 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 			&& LD_DWORD(fs->win+FSI_LeadSig) == 0x41615252
 			&& LD_DWORD(fs->win+FSI_StrucSig) == 0x61417272)
 		{
-#if !_FS_NOFSINFO
 			fs->free_clust = LD_DWORD(fs->win+FSI_Free_Count);
-#endif
 			fs->last_clust = LD_DWORD(fs->win+FSI_Nxt_Free);
+			if (fs->free_clust > fs->n_fatent - 2)	/* Discard out of range values */
+				fs->free_clust = 0xFFFFFFFF;
+			if (fs->last_clust < 2 || fs->last_clust >= fs->n_fatent)
+				fs->last_clust = 0xFFFFFFFF;
+		}
+		/* By TFT: the free cluster count is trusted according to the policy.
+		   With policy 1 it is trusted only if the volume was cleanly unmounted,
+		   and the clean flag is cleared until the volume is unmounted again.
+		   FAT[1] is in the FAT area, so sync_window() also writes it to the
+		   second FAT copy, if any */
+		if (miosix::FAT32_FSINFO_POLICY == 0) {
+			fs->free_clust = 0xFFFFFFFF;
+		} else if (miosix::FAT32_FSINFO_POLICY == 1) {
+			if (move_window(fs, fs->fatbase) != FR_OK) return FR_DISK_ERR;
+			DWORD fat1 = LD_DWORD(fs->win+4);
+			if (fat1 & FAT1_CLEAN) {
+				ST_DWORD(fs->win+4, fat1 & ~FAT1_CLEAN);
+				fs->wflag = 1;
+				if (sync_window(fs) == FR_OK) fs->fsi_flag |= 0x40;
+			} else {
+				/* Not cleanly unmounted: do not trust the free cluster count, but
+				   rewrite FSINFO and set the clean flag at the next unmount */
+				fs->free_clust = 0xFFFFFFFF;
+				fs->fsi_flag |= 0x41;
+			}
 		}
 	}
 #endif
@@ -2383,8 +2413,24 @@ FRESULT f_mount (
 	vol = 0;//get_ldnumber(&path);
 	if (vol < 0) return FR_INVALID_DRIVE;
 	cfs = fs;//FatFs[vol];					/* Pointer to fs object */
+	res = FR_OK;
 
 	if (/*cfs*/umount) {
+#if !_FS_READONLY
+		/* By TFT: write back FSINFO, so that the next mount can trust it.
+		   sync_window() mirrors the clean flag to all FAT copies */
+		if (cfs->fs_type == FS_FAT32) {
+			res = sync_fs(cfs);
+			if (res == FR_OK && (cfs->fsi_flag & 0x40)) {	/* Set clean flag */
+				res = move_window(cfs, cfs->fatbase);
+				if (res == FR_OK) {
+					ST_DWORD(cfs->win+4, LD_DWORD(cfs->win+4) | FAT1_CLEAN);
+					cfs->wflag = 1;
+					res = sync_window(cfs);
+				}
+			}
+		}
+#endif
 #ifdef _FS_LOCK
 		clear_lock(cfs);
 #endif
@@ -2403,7 +2449,7 @@ FRESULT f_mount (
 	}
 	//FatFs[vol] = fs;					/* Register new fs object */
 
-	if (/*!fs*/umount || opt != 1) return FR_OK;	/* Do not mount now, it will be mounted later */
+	if (/*!fs*/umount || opt != 1) return res;	/* Do not mount now, it will be mounted later */
 
 	res = find_volume(fs, /*&path,*/ 0);	/* Force mounted the volume */
 	LEAVE_FF(fs, res);
@@ -2590,7 +2636,11 @@ FRESULT f_read (
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
+					{
+						LOCK_FAT(fp->fs);
 						clst = get_fat(fp->fs, fp->clust);	/* Follow cluster chain on the FAT */
+						UNLOCK_FAT(fp->fs);
+					}
 				}
 				if (clst < 2) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
@@ -2685,15 +2735,22 @@ FRESULT f_write (
 			if (!csect) {					/* On the cluster boundary? */
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->sclust;		/* Follow from the origin */
-					if (clst == 0)			/* When no cluster is allocated, */
+					if (clst == 0) {		/* When no cluster is allocated, */
+						LOCK_FAT(fp->fs);
 						fp->sclust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+						UNLOCK_FAT(fp->fs);
+					}
 				} else {					/* Middle or end of the file */
 #if _USE_FASTSEEK
 					if (fp->cltbl)
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
+					{
+						LOCK_FAT(fp->fs);
 						clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+						UNLOCK_FAT(fp->fs);
+					}
 				}
 				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
@@ -3449,6 +3506,140 @@ FRESULT f_truncate (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Reserve Contiguous Clusters Past the End of File                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_reserve (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes the cluster chain has to hold */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, ncl, lcl, cl, scl, rs, run, cnt, st;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->err)							/* Check error */
+		LEAVE_FF(fp->fs, (FRESULT)fp->err);
+	if (!(fp->flag & FA_WRITE))				/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	fs = fp->fs;
+
+	/* Count the clusters in the chain, and find the last one */
+	bcs = (DWORD)fs->csize * SS(fs);
+	ncl = fsz / bcs + (fsz % bcs != 0);		/* Number of clusters required */
+	lcl = 0;
+	for (cl = fp->sclust; cl >= 2 && cl < fs->n_fatent && ncl; ncl--) {
+		lcl = cl;
+		cl = get_fat(fs, cl);
+		if (cl == 1) ABORT(fs, FR_INT_ERR);
+		if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+	}
+	if (!ncl) LEAVE_FF(fs, FR_OK);			/* The chain is already long enough */
+
+	/* Find ncl contiguous free clusters, preferably right after the chain */
+	scl = lcl ? lcl + 1 : fs->last_clust + 1;
+	if (scl < 2 || scl >= fs->n_fatent) scl = 2;
+	cl = scl; rs = run = 0;
+	for (cnt = fs->n_fatent - 2; cnt; cnt--) {
+		st = get_fat(fs, cl);
+		if (st == 1) ABORT(fs, FR_INT_ERR);
+		if (st == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (st == 0) {						/* Free cluster, extend the run */
+			if (run++ == 0) rs = cl;
+			if (run == ncl) break;
+		} else {
+			run = 0;
+		}
+		if (++cl >= fs->n_fatent) {			/* Wrap around, runs cannot span it */
+			cl = 2; run = 0;
+		}
+	}
+	if (run < ncl) LEAVE_FF(fs, FR_DENIED);	/* No contiguous area large enough */
+
+	/* Create the chain of the run, then link it to the file */
+	for (cl = rs; cl < rs + ncl - 1 && res == FR_OK; cl++)
+		res = put_fat(fs, cl, cl + 1);
+	if (res == FR_OK) res = put_fat(fs, rs + ncl - 1, 0x0FFFFFFF);
+	if (res == FR_OK) {
+		if (lcl) res = put_fat(fs, lcl, rs);
+		else fp->sclust = rs;				/* Written to the directory entry on sync */
+	}
+	if (res != FR_OK) ABORT(fs, res);
+	fs->last_clust = rs + ncl - 1;			/* Update FSINFO */
+	if (fs->free_clust != 0xFFFFFFFF) {
+		fs->free_clust -= ncl;
+		fs->fsi_flag |= 1;
+	}
+	fp->flag |= FA__WRITTEN;
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Release the Clusters Past the End of File                             */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_trim (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, cl, ncl, n;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->err)							/* Check error */
+		LEAVE_FF(fp->fs, (FRESULT)fp->err);
+	if (!(fp->flag & FA_WRITE))				/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	fs = fp->fs;
+	if (!fp->sclust) LEAVE_FF(fs, FR_OK);	/* No cluster chain */
+
+	if (fp->fsize == 0) {					/* Empty file, remove the entire chain */
+		res = remove_chain(fs, fp->sclust);
+		if (res != FR_OK) ABORT(fs, res);
+		fp->sclust = 0;
+		fp->flag |= FA__WRITTEN;
+		LEAVE_FF(fs, FR_OK);
+	}
+
+	/* Find the cluster holding the last byte of the file */
+	bcs = (DWORD)fs->csize * SS(fs);
+	if (fp->fptr == fp->fsize) {			/* Current cluster, common when appending */
+		cl = fp->clust;
+	} else {
+		cl = fp->sclust;
+		for (n = (fp->fsize - 1) / bcs; n; n--) {
+			cl = get_fat(fs, cl);
+			if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			if (cl < 2 || cl >= fs->n_fatent) ABORT(fs, FR_INT_ERR);
+		}
+	}
+	ncl = get_fat(fs, cl);
+	if (ncl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+	if (ncl == 1) ABORT(fs, FR_INT_ERR);
+	if (ncl >= 2 && ncl < fs->n_fatent) {	/* Clusters past the end of file */
+		res = put_fat(fs, cl, 0x0FFFFFFF);
+		if (res == FR_OK) res = remove_chain(fs, ncl);
+		if (res != FR_OK) ABORT(fs, res);
+		fp->flag |= FA__WRITTEN;			/* To flush the FAT on sync */
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -36,6 +36,7 @@
 //#endif
 
 #include <filesystem/file.h>
+#include "kernel/sync.h"
 #include "config/miosix_settings.h"
 
 #include "integer.h"	/* Basic integer types */
@@ -113,7 +114,7 @@ struct FATFS {
 	BYTE	csize;			/* Sectors per cluster (1,2,4...128) */
 	BYTE	n_fats;			/* Number of FAT copies (1 or 2) */
 	BYTE	wflag;			/* win[] flag (b0:dirty) */
-	BYTE	fsi_flag;		/* FSINFO flags (b7:disabled, b0:dirty) */
+	BYTE	fsi_flag;		/* FSINFO flags (b7:disabled, b6:clean flag cleared, b0:dirty) */
 	WORD	id;				/* File system mount ID */
 	WORD	n_rootdir;		/* Number of root directory entries (FAT12/16) */
 #if _MAX_SS != 512
@@ -144,6 +145,7 @@ struct FATFS {
     FILESEM	Files[miosix::FATFS_MAX_OPEN_FILES];/* Open object lock semaphores */
 #endif
     miosix::intrusive_ref_ptr<miosix::FileBase> drv; /* drive device */
+    miosix::FastMutex *mutex; /* By TFT: volume lock, or NULL if unused */
 };
 
 
@@ -253,6 +255,8 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);								/* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate file */
+FRESULT f_reserve (FIL* fp, DWORD fsz);								/* Allocate contiguous clusters past the end of file */
+FRESULT f_trim (FIL* fp);											/* Release the clusters past the end of file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of a writing file */
 FRESULT f_opendir (FATFS *fs, DIR_* dp, const /*TCHAR*/char *path);						/* Open a directory */
 FRESULT f_closedir (DIR_* dp);										/* Close an open directory */
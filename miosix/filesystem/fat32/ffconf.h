@@ -44,7 +44,7 @@
 /* To enable f_mkfs() function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
-#define	_USE_FASTSEEK	0	/* 0:Disable or 1:Enable */
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
@@ -163,14 +163,8 @@
 /  should be added to the disk_ioctl() function. */
 
 
-#define _FS_NOFSINFO	0	/* 0 or 1 */
-/* If you need to know the correct free space on the FAT32 volume, set this
-/  option to 1 and f_getfree() function at first time after volume mount will
-/  force a full FAT scan.
-/
-/  0: Load all informations in the FSINFO if available.
-/  1: Do not trust free cluster count in the FSINFO.
-*/
+/* By TFT: _FS_NOFSINFO has been replaced by FAT32_FSINFO_POLICY in
+/  miosix_settings.h */
 
 
 
@@ -30,6 +30,7 @@
 #include <string>
 #include <fcntl.h>
 #include "file_access.h"
+#include "kernel/sync.h"
 #include "config/miosix_settings.h"
 
 using namespace std;
@@ -39,6 +40,35 @@ namespace miosix {
 //The filesystem code assumes off_t is 64bit.
 static_assert(sizeof(off_t)==8,"");
 
+//
+// class PollQueue
+//
+
+void PollQueue::add(PollEntry *entry)
+{
+    FastInterruptDisableLock dLock;
+    entries.push_back(entry);
+}
+
+void PollQueue::remove(PollEntry *entry)
+{
+    FastInterruptDisableLock dLock;
+    entries.removeFast(entry);
+}
+
+void PollQueue::wakeup()
+{
+    FastInterruptDisableLock dLock;
+    IRQwakeup();
+}
+
+void PollQueue::IRQwakeup()
+{
+    //The semaphore is not signaled if already nonzero, as a thread polling
+    //several files only needs to be woken once
+    for(auto e : entries) if(e->sem->getCount()==0) e->sem->IRQsignal();
+}
+
 //
 // class FileBase
 //
@@ -56,11 +86,71 @@ FileBase::~FileBase()
     if(parent) parent->fileCloseHook();
 }
 
+ssize_t FileBase::pwrite(const void *data, size_t len, off_t pos)
+{
+    //NOTE: not atomic with respect to other users of the file pointer
+    off_t prev=lseek(0,SEEK_CUR);
+    if(prev<0) return -ESPIPE;
+    off_t result=lseek(pos,SEEK_SET);
+    if(result<0) return result;
+    ssize_t written=write(data,len);
+    lseek(prev,SEEK_SET);
+    return written;
+}
+
+ssize_t FileBase::pread(void *data, size_t len, off_t pos)
+{
+    //NOTE: not atomic with respect to other users of the file pointer
+    off_t prev=lseek(0,SEEK_CUR);
+    if(prev<0) return -ESPIPE;
+    off_t result=lseek(pos,SEEK_SET);
+    if(result<0) return result;
+    ssize_t readBytes=read(data,len);
+    lseek(prev,SEEK_SET);
+    return readBytes;
+}
+
+ssize_t FileBase::writev(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        ssize_t result=write(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t FileBase::readv(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        ssize_t result=read(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
 int FileBase::isatty() const
 {
     return 0;
 }
 
+int FileBase::poll(int events)
+{
+    return POLLIN | POLLOUT;
+}
+
+PollQueue *FileBase::getPollQueue()
+{
+    return nullptr;
+}
+
 int FileBase::fcntl(int cmd, int opt)
 {
     switch(cmd)
@@ -72,6 +162,11 @@ int FileBase::fcntl(int cmd, int opt)
     return -EBADF;
 }
 
+int FileBase::fallocate(int mode, off_t offset, off_t len)
+{
+    return -EOPNOTSUPP;
+}
+
 int FileBase::ioctl(int cmd, void *arg)
 {
     return -ENOTTY; //Means the operation does not apply to this descriptor
@@ -194,6 +289,12 @@ int FilesystemBase::readlink(StringPart& name, string& target)
 
 bool FilesystemBase::supportsSymlinks() const { return false; }
 
+int FilesystemBase::statfs(struct statfs *buf)
+{
+    memset(buf,0,sizeof(struct statfs));
+    return 0;
+}
+
 void FilesystemBase::newFileOpened() { atomicAdd(&openFileCount,1); }
 
 void FilesystemBase::fileCloseHook()
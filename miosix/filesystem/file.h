@@ -28,6 +28,26 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#else //__has_include(<sys/uio.h>)
+/**
+ * Buffer for readv/writev, not all C libraries provide sys/uio.h
+ */
+struct iovec
+{
+    void *iov_base; ///< Buffer start
+    size_t iov_len; ///< Buffer size
+};
+#endif //__has_include(<sys/uio.h>)
+#ifndef FALLOC_FL_KEEP_SIZE
+/// fallocate() mode, allocate space without changing the file size
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif //FALLOC_FL_KEEP_SIZE
+extern "C" int posix_fallocate(int fd, off_t offset, off_t len);
+extern "C" int fallocate(int fd, int mode, off_t offset, off_t len);
+#include "libsyscalls/statfs.h"
+#include "libsyscalls/poll.h"
 #include "kernel/intrusive.h"
 #include "config/miosix_settings.h"
 
@@ -38,6 +58,68 @@ namespace miosix {
 // Forward decls
 class FilesystemBase;
 class StringPart;
+class Semaphore;
+
+/**
+ * Registration of a thread blocked in poll() into the PollQueue of a file.
+ * A thread polling multiple files uses one PollEntry for each file, all
+ * pointing to the same semaphore.
+ */
+class PollEntry : public IntrusiveListItem
+{
+public:
+    /**
+     * Constructor
+     * \param sem semaphore signaled when the file readiness changes
+     */
+    explicit PollEntry(Semaphore *sem=nullptr) : sem(sem) {}
+
+    Semaphore *sem; ///< Signaled when the file readiness may have changed
+};
+
+/**
+ * Wait queue for threads blocked in poll(). Files whose readiness can change
+ * contain one, and call wakeup() or IRQwakeup() whenever they may have become
+ * readable or writable. Woken threads then call FileBase::poll() to find out
+ * the actual file state, so spurious wakeups are harmless.
+ */
+class PollQueue
+{
+public:
+    /**
+     * Constructor
+     */
+    PollQueue() {}
+
+    /**
+     * Add an entry to the queue
+     * \param entry entry to add, must not be already in a queue
+     */
+    void add(PollEntry *entry);
+
+    /**
+     * Remove an entry from the queue
+     * \param entry entry to remove, previously added with add()
+     */
+    void remove(PollEntry *entry);
+
+    /**
+     * Wake all the threads waiting in the queue
+     */
+    void wakeup();
+
+    /**
+     * Wake all the threads waiting in the queue.
+     * Can only be called with interrupts disabled or within an interrupt.
+     */
+    void IRQwakeup();
+
+private:
+    PollQueue(const PollQueue&)=delete;
+    PollQueue& operator=(const PollQueue&)=delete;
+
+    IntrusiveList<PollEntry> entries;
+};
 
 /**
  * Return value of FileBase::getFileFromMemory()
@@ -125,6 +207,50 @@ public:
      * completed, or a negative number in case of errors
      */
     virtual off_t lseek(off_t pos, int whence)=0;
+
+    /**
+     * Write data to the file at a given position, without changing the file
+     * pointer. The default implementation is based on lseek() and write(),
+     * files that can do better should override it.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+
+    /**
+     * Read data from the file at a given position, without changing the file
+     * pointer. The default implementation is based on lseek() and read(),
+     * files that can do better should override it.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+
+    /**
+     * Write data to the file, gathering it from multiple buffers.
+     * The default implementation calls write() once per buffer.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+
+    /**
+     * Read data from the file, scattering it into multiple buffers.
+     * The default implementation calls read() once per buffer.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
     
     /**
      * Truncate the file
@@ -133,6 +259,18 @@ public:
      */
     virtual int ftruncate(off_t size)=0;
 
+    /**
+     * Allocate storage for a range of the file, so that later writes to it
+     * do not fail for lack of space. This default implementation returns
+     * -EOPNOTSUPP.
+     * \param mode 0 to extend the file size to offset+len if it is smaller,
+     * or FALLOC_FL_KEEP_SIZE to allocate storage without changing the size
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(int mode, off_t offset, off_t len);
+
     /**
      * Return file information.
      * \param pstat pointer to stat struct
@@ -184,6 +322,24 @@ public:
      */
     virtual MemoryMappedFile getFileFromMemory();
 
+    /**
+     * Check whether the file is ready for I/O, used to implement poll().
+     * This default implementation reports the file as always readable and
+     * writable, as is the case of regular files.
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready, possibly including also
+     * POLLERR and POLLHUP even if not requested
+     */
+    virtual int poll(int events);
+
+    /**
+     * Threads blocked in poll() add themselves to this queue, to be woken
+     * when the file readiness changes.
+     * \return the file poll queue, or nullptr if the file readiness never
+     * changes. This default implementation returns nullptr.
+     */
+    virtual PollQueue *getPollQueue();
+
     /**
      * \return a pointer to the parent filesystem
      */
@@ -400,6 +556,15 @@ public:
      */
     virtual bool supportsSymlinks() const;
     
+    /**
+     * Return information about the filesystem, such as its free space.
+     * The default implementation, for filesystems that do not track space,
+     * zeroes all fields
+     * \param buf filesystem information is returned here
+     * \return 0 on success, a negative number on failure
+     */
+    virtual int statfs(struct statfs *buf);
+    
     /**
      * \internal
      * \return true if all files belonging to this filesystem are closed 
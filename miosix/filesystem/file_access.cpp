@@ -28,6 +28,7 @@
 #include "file_access.h"
 #include <vector>
 #include <climits>
+#include <limits>
 #include <fcntl.h>
 #include "console/console_device.h"
 #include "mountpointfs/mountpointfs.h"
@@ -35,9 +36,11 @@
 #include "fat32/fat32.h"
 #include "littlefs/lfs_miosix.h"
 #include "pipe/pipe.h"
+#include "blockcache/block_cache.h"
 #include "kernel/logging.h"
 #ifdef WITH_PROCESSES
 #include "kernel/process.h"
+#include "kernel/elf_program.h"
 #endif //WITH_PROCESSES
 
 using namespace std;
@@ -72,6 +75,22 @@ namespace miosix {
  * of a string.
  */
 
+#ifdef WITH_PROCESSES
+/**
+ * \internal
+ * Invalidate the copy of a file that may have been loaded in RAM to spawn
+ * processes, to be called before modifying it
+ * \param fs filesystem of the file
+ * \param name file name, relative to the filesystem
+ */
+static void invalidateProgram(intrusive_ref_ptr<FilesystemBase> fs,
+                              StringPart& name)
+{
+    struct stat st;
+    if(fs->lstat(name,&st)==0) invalidateProgramCache(st.st_ino,st.st_dev);
+}
+#endif //WITH_PROCESSES
+
 //
 // class FileDescriptorTable
 //
@@ -113,8 +132,15 @@ int FileDescriptorTable::open(const char* name, int flags, int mode)
     if(openData.result<0) return openData.result;
     StringPart sp(path,string::npos,openData.off);
     int result=openData.fs->open(files[fd],sp,flags,mode);
-    if(result==0) return fd; //The file descriptor
-    else return result; //The error code
+    if(result!=0) return result; //The error code
+    #ifdef WITH_PROCESSES
+    if((flags & O_ACCMODE)!=O_RDONLY || (flags & O_TRUNC))
+    {
+        struct stat st;
+        if(files[fd]->fstat(&st)==0) invalidateProgramCache(st.st_ino,st.st_dev);
+    }
+    #endif //WITH_PROCESSES
+    return fd; //The file descriptor
 }
 
 int FileDescriptorTable::close(int fd)
@@ -153,6 +179,55 @@ int FileDescriptorTable::fcntl(int fd, int cmd, int opt)
     } else return file->fcntl(cmd,opt);
 }
 
+int FileDescriptorTable::poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    if(nfds>0 && fds==0) return -EFAULT;
+    //The same file descriptor may appear multiple times in fds, but we only
+    //need to register once per file descriptor, so these arrays are indexed
+    //by file descriptor and their size is bounded
+    intrusive_ref_ptr<FileBase> polled[MAX_OPEN_FILES];
+    PollQueue *queues[MAX_OPEN_FILES]={0};
+    PollEntry entries[MAX_OPEN_FILES];
+    Semaphore sem;
+    //Register before checking readiness, so no state change can be missed
+    for(nfds_t i=0;i<nfds;i++)
+    {
+        int fd=fds[i].fd;
+        if(fd<0 || fd>=MAX_OPEN_FILES || polled[fd]) continue;
+        polled[fd]=getFile(fd);
+        if(!polled[fd]) continue;
+        queues[fd]=polled[fd]->getPollQueue();
+        if(queues[fd]==nullptr) continue;
+        entries[fd].sem=&sem;
+        queues[fd]->add(&entries[fd]);
+    }
+    long long deadline=numeric_limits<long long>::max();
+    if(timeout>0) deadline=getTime()+static_cast<long long>(timeout)*1000000;
+    int result;
+    for(;;)
+    {
+        result=0;
+        for(nfds_t i=0;i<nfds;i++)
+        {
+            int fd=fds[i].fd;
+            int revents=0;
+            if(fd>=0 && fd<MAX_OPEN_FILES && polled[fd])
+            {
+                revents=polled[fd]->poll(fds[i].events);
+                revents&=fds[i].events | POLLERR | POLLHUP;
+            } else if(fd>=0) revents=POLLNVAL;
+            fds[i].revents=revents;
+            if(revents) result++;
+        }
+        if(result>0 || timeout==0) break;
+        if(timeout<0) sem.wait();
+        else if(sem.timedWait(deadline)==TimedWaitResult::Timeout) break;
+    }
+    for(int fd=0;fd<MAX_OPEN_FILES;fd++)
+        if(entries[fd].sem) queues[fd]->remove(&entries[fd]);
+    return result;
+}
+
 int FileDescriptorTable::getcwd(char *buf, size_t len)
 {
     if(buf==0 || len<2) return -EINVAL; //We don't support the buf==0 extension
@@ -250,9 +325,26 @@ int FileDescriptorTable::truncate(const char *name, off_t size)
     ResolvedPath openData=FilesystemManager::instance().resolvePath(path);
     if(openData.result<0) return openData.result;
     StringPart sp(path,string::npos,openData.off);
+    #ifdef WITH_PROCESSES
+    invalidateProgram(openData.fs,sp);
+    #endif //WITH_PROCESSES
     return openData.fs->truncate(sp,size);
 }
 
+int FileDescriptorTable::statfs(const char *name, struct statfs *buf)
+{
+    if(name==nullptr || name[0]=='\0' || buf==nullptr) return -EFAULT;
+    string path=absolutePath(name);
+    if(path.empty()) return -ENAMETOOLONG;
+    ResolvedPath openData=FilesystemManager::instance().resolvePath(path);
+    if(openData.result<0) return openData.result;
+    //Fail with ENOENT if the path does not exist
+    StringPart sp(path,string::npos,openData.off);
+    struct stat st;
+    if(int result=openData.fs->lstat(sp,&st)) return result;
+    return openData.fs->statfs(buf);
+}
+
 int FileDescriptorTable::rename(const char *oldName, const char *newName)
 {
     if(oldName==0 || oldName[0]=='\0') return -EFAULT;
@@ -304,9 +396,10 @@ int FileDescriptorTable::pipe(int fds[2])
         }
     }
     if(availableFds<2) return -EMFILE;
-    intrusive_ref_ptr<FileBase> pipe(new Pipe);
-    files[fds[0]]=pipe;
-    files[fds[1]]=pipe;
+    intrusive_ref_ptr<FileBase> readEnd, writeEnd;
+    Pipe::create(readEnd,writeEnd);
+    files[fds[0]]=readEnd;
+    files[fds[1]]=writeEnd;
     filesCloexec[fds[0]]=false;
     filesCloexec[fds[1]]=false;
     return 0;
@@ -752,6 +845,9 @@ int FilesystemManager::unlinkHelper(string& path)
     //After resolvePath() so path is in canonical form and symlinks are followed
     if(filesystems.find(StringPart(path))!=filesystems.end()) return -EBUSY;
     StringPart sp(path,string::npos,openData.off);
+    #ifdef WITH_PROCESSES
+    invalidateProgram(openData.fs,sp);
+    #endif //WITH_PROCESSES
     return openData.fs->unlink(sp);
 }
 
@@ -784,6 +880,10 @@ int FilesystemManager::renameHelper(string& oldPath, string& newPath)
     
     //Can't rename a directory into a subdirectory of itself
     if(newSp.startsWith(oldSp)) return -EINVAL;
+    #ifdef WITH_PROCESSES
+    invalidateProgram(oldOpenData.fs,oldSp);
+    invalidateProgram(newOpenData.fs,newSp);
+    #endif //WITH_PROCESSES
     return oldOpenData.fs->rename(oldSp,newSp);
 }
 
@@ -827,6 +927,9 @@ static inline bool tryMount(const char *name, intrusive_ref_ptr<Device> dev,
         return false;
     }
 
+    #ifdef WITH_BLOCK_CACHE
+    disk=intrusive_ref_ptr<FileBase>(new BlockCache(disk,BLOCK_CACHE_BLOCKS));
+    #endif //WITH_BLOCK_CACHE
     intrusive_ref_ptr<T> fsImpl(new T(disk));
     if(fsImpl->mountFailed()) { bootlog("Failed\n"); return false; }
     StringPart sd("sd");
@@ -167,6 +167,85 @@ public:
         return file->read(data,len);
     }
     
+    /**
+     * Write data to the file at a given position, without changing the file
+     * pointer.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pwrite(int fd, const void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->pwrite(data,len,pos);
+    }
+
+    /**
+     * Read data from the file at a given position, without changing the file
+     * pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pread(int fd, void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->pread(data,len,pos);
+    }
+
+    /**
+     * Write data to the file, gathering it from multiple buffers.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+    {
+        if(iovLenInvalid(iov,iovcnt)) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->writev(iov,iovcnt);
+    }
+
+    /**
+     * Read data from the file, scattering it into multiple buffers.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    {
+        if(iovLenInvalid(iov,iovcnt)) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->readv(iov,iovcnt);
+    }
+
+    /**
+     * Wait for one or more file descriptors to become ready for I/O
+     * \param fds array of file descriptors to poll, with the requested
+     * events. On return, the revents field of each entry is updated with the
+     * ready events
+     * \param nfds number of entries in fds
+     * \param timeout maximum time to wait in milliseconds, 0 to return
+     * immediately, or a negative number to wait forever
+     * \return the number of entries with nonzero revents, 0 on timeout, or a
+     * negative number in case of errors
+     */
+    int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -335,6 +414,30 @@ public:
         if(!file) return -EBADF;
         return file->ftruncate(size);
     }
+
+    /**
+     * Allocate storage for a range of a file
+     * \param fd file descriptor
+     * \param mode 0 or FALLOC_FL_KEEP_SIZE
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    int fallocate(int fd, int mode, off_t offset, off_t len)
+    {
+        if(offset<0 || len<=0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->fallocate(mode,offset,len);
+    }
+
+    /**
+     * Return information about a mounted filesystem
+     * \param name path of any file or directory in the filesystem
+     * \param buf filesystem information is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int statfs(const char *name, struct statfs *buf);
     
     /**
      * Rename a file or directory
@@ -405,6 +508,26 @@ private:
      */
     int statImpl(const char *name, struct stat *pstat, bool f);
 
+    /**
+     * Validate the buffers passed to readv/writev
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return true if the buffers are not valid, or their total size does not
+     * fit in the ssize_t return value
+     */
+    static bool iovLenInvalid(const struct iovec *iov, int iovcnt)
+    {
+        if(iovcnt<0 || (iovcnt>0 && iov==0)) return true;
+        size_t total=0;
+        for(int i=0;i<iovcnt;i++)
+        {
+            if(iov[i].iov_base==0 && iov[i].iov_len>0) return true;
+            total+=iov[i].iov_len;
+            if(static_cast<ssize_t>(total)<0 || total<iov[i].iov_len) return true;
+        }
+        return false;
+    }
+
     /**
      * Get the first available file descriptor. Must be called with mutex locked
      * to avoid race conditions.
@@ -36,7 +36,9 @@ enum Ioctl
     IOCTL_TCSETATTR_NOW=102,
     IOCTL_TCSETATTR_FLUSH=103,
     IOCTL_TCSETATTR_DRAIN=104,
-    IOCTL_FLUSH=105
+    IOCTL_FLUSH=105,
+    IOCTL_BLOCK_CACHE_STATS=106,
+    IOCTL_FAT32_FASTSEEK=107
 };
 
 }
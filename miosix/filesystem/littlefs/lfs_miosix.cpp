@@ -482,11 +482,8 @@ int miosixBlockDeviceRead(const lfs_config *c, lfs_block_t block,
 {
     FileBase *drv = GET_DRIVER_FROM_LFS_CONTEXT(c);
 
-    if(drv->lseek(static_cast<off_t>(c->block_size * block + off), SEEK_SET) < 0)
-    {
-        return LFS_ERR_IO;
-    }
-    if(drv->read(buffer, size) != static_cast<ssize_t>(size))
+    off_t pos = static_cast<off_t>(c->block_size) * block + off;
+    if(drv->pread(buffer, size, pos) != static_cast<ssize_t>(size))
     {
         return LFS_ERR_IO;
     }
@@ -498,11 +495,8 @@ int miosixBlockDeviceProg(const lfs_config *c, lfs_block_t block,
 {
     FileBase *drv = GET_DRIVER_FROM_LFS_CONTEXT(c);
 
-    if(drv->lseek(static_cast<off_t>(c->block_size * block + off), SEEK_SET) < 0)
-    {
-        return LFS_ERR_IO;
-    }
-    if(drv->write(buffer, size) != static_cast<ssize_t>(size))
+    off_t pos = static_cast<off_t>(c->block_size) * block + off;
+    if(drv->pwrite(buffer, size, pos) != static_cast<ssize_t>(size))
     {
         return LFS_ERR_IO;
     }
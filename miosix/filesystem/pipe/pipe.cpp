@@ -26,6 +26,7 @@
  ***************************************************************************/
 
 #include "pipe.h"
+#include <cstring>
 #include <algorithm>
 
 using namespace std;
@@ -34,33 +35,42 @@ using namespace std;
 
 namespace miosix {
 
-Pipe::Pipe() : FileBase(intrusive_ref_ptr<FilesystemBase>(),O_RDWR), put(0),
-    get(0), size(0), capacity(defaultSize), buffer(new char[defaultSize]) {}
+//
+// class Pipe
+//
+
+void Pipe::create(intrusive_ref_ptr<FileBase>& readEnd,
+                  intrusive_ref_ptr<FileBase>& writeEnd)
+{
+    intrusive_ref_ptr<Pipe> pipe(new Pipe);
+    readEnd=intrusive_ref_ptr<FileBase>(new PipeEnd(pipe,false));
+    writeEnd=intrusive_ref_ptr<FileBase>(new PipeEnd(pipe,true));
+}
 
 ssize_t Pipe::write(const void *data, size_t len)
 {
     auto d=reinterpret_cast<const char*>(data);
     Lock<FastMutex> l(m);
-    ssize_t written=0;
-    while(len>0)
+    size_t written=0;
+    while(written<len)
     {
-        if(unconnected()) return -EPIPE;
-        int writable=min<int>(len,capacity-size);
-        //HACK: if the other end of the pipe is closed after we wait on the
-        //condition variable, we'll wait forever. To fix that, we set a timeout
-        if(writable==0) cv.timedWait(l,getTime()+pollTime);
-        else {
-            for(int i=0;i<writable;i++)
-            {
-                buffer[put]=d[i];
-                if(++put>=capacity) put=0;
-            }
-            size+=writable;
-            d+=writable;
-            len-=writable;
-            written+=writable;
-            cv.broadcast();
+        if(readerClosed) return written>0 ? written : -EPIPE;
+        if(size==capacity)
+        {
+            notFull.wait(l);
+            continue;
         }
+        size_t n=min<size_t>(len-written,capacity-size);
+        //The free space may wrap around the end of the buffer
+        size_t first=min<size_t>(n,capacity-put);
+        memcpy(buffer+put,d+written,first);
+        memcpy(buffer,d+written+first,n-first);
+        put+=n;
+        if(put>=capacity) put-=capacity;
+        size+=n;
+        written+=n;
+        notEmpty.broadcast();
+        pollQueue.wakeup();
     }
     return written;
 }
@@ -70,63 +80,132 @@ ssize_t Pipe::read(void *data, size_t len)
     if(len==0) return 0;
     auto d=reinterpret_cast<char*>(data);
     Lock<FastMutex> l(m);
-    for(;;)
+    while(size==0)
     {
-        int readable=min<int>(len,size);
-        if(unconnected() && readable==0) return 0;
-        //HACK: if the other end of the pipe is closed after we wait on the
-        //condition variable, we'll wait forever. To fix that, we set a timeout
-        if(readable==0) cv.timedWait(l,getTime()+pollTime);
-        else {
-            for(int i=0;i<readable;i++)
-            {
-                d[i]=buffer[get];
-                if(++get>=capacity) get=0;
-            }
-            size-=readable;
-            cv.broadcast();
-            return readable;
-        }
+        if(writerClosed) return 0;
+        notEmpty.wait(l);
     }
+    size_t n=min<size_t>(len,size);
+    //The data may wrap around the end of the buffer
+    size_t first=min<size_t>(n,capacity-get);
+    memcpy(d,buffer+get,first);
+    memcpy(d+first,buffer,n-first);
+    get+=n;
+    if(get>=capacity) get-=capacity;
+    size-=n;
+    notFull.broadcast();
+    pollQueue.wakeup();
+    return n;
 }
 
-off_t Pipe::lseek(off_t pos, int whence) { return -ESPIPE; }
+int Pipe::poll(bool writeEnd, int events)
+{
+    Lock<FastMutex> l(m);
+    int result=0;
+    if(writeEnd)
+    {
+        if(readerClosed) result|=POLLERR;
+        else if(size<capacity) result|=POLLOUT;
+    } else {
+        if(size>0) result|=POLLIN;
+        if(writerClosed) result|=POLLHUP;
+    }
+    return result;
+}
 
-int Pipe::ftruncate(off_t size) { return -EINVAL; }
+int Pipe::setCapacity(int newCapacity)
+{
+    if(newCapacity<=0 || newCapacity>maxCapacity) return -EINVAL;
+    Lock<FastMutex> l(m);
+    if(newCapacity<size) return -EBUSY;
+    if(newCapacity==capacity) return capacity;
+    char *newBuffer=new char[newCapacity];
+    //Move the data to the beginning of the new buffer
+    int first=min(size,capacity-get);
+    memcpy(newBuffer,buffer+get,first);
+    memcpy(newBuffer+first,buffer,size-first);
+    delete[] buffer;
+    buffer=newBuffer;
+    capacity=newCapacity;
+    get=0;
+    put= size==capacity ? 0 : size;
+    //Growing the pipe may unblock writers
+    notFull.broadcast();
+    pollQueue.wakeup();
+    return capacity;
+}
 
-int Pipe::fstat(struct stat *pstat) const
+int Pipe::getCapacity()
 {
-    return -EFAULT; //TODO
+    Lock<FastMutex> l(m);
+    return capacity;
 }
 
-int Pipe::fcntl(int cmd, int opt)
+void Pipe::closeEnd(bool writeEnd)
 {
-    switch(cmd)
-    {
-        case F_GETFD:
-        case F_GETFL: //TODO: also return file access mode
-            return O_RDWR;
-    }
-    return -EBADF;
+    Lock<FastMutex> l(m);
+    if(writeEnd) writerClosed=true; else readerClosed=true;
+    notEmpty.broadcast();
+    notFull.broadcast();
+    pollQueue.wakeup();
 }
 
 Pipe::~Pipe() { delete[] buffer; }
 
-bool Pipe::unconnected()
+Pipe::Pipe() : put(0), get(0), size(0), capacity(defaultCapacity),
+    buffer(new char[defaultCapacity]), readerClosed(false),
+    writerClosed(false) {}
+
+//
+// class PipeEnd
+//
+
+PipeEnd::PipeEnd(intrusive_ref_ptr<Pipe> pipe, bool writeEnd)
+    : FileBase(intrusive_ref_ptr<FilesystemBase>(),
+               writeEnd ? O_WRONLY : O_RDONLY), pipe(pipe), writeEnd(writeEnd) {}
+
+ssize_t PipeEnd::write(const void *data, size_t len)
+{
+    if(!writeEnd) return -EBADF;
+    return pipe->write(data,len);
+}
+
+ssize_t PipeEnd::read(void *data, size_t len)
+{
+    if(writeEnd) return -EBADF;
+    return pipe->read(data,len);
+}
+
+off_t PipeEnd::lseek(off_t pos, int whence) { return -ESPIPE; }
+
+int PipeEnd::ftruncate(off_t size) { return -EINVAL; }
+
+int PipeEnd::fstat(struct stat *pstat) const
 {
-    //How many references does an unconnected pipe have? One in the file
-    //descriptor table. Then, since we check whether we are unconnected within
-    //either a read or write operation, either FileDescriptorTable::read or
-    //FileDescriptorTable::write hold a temporary reference to make sure a
-    //concurrent close doesn't lead to a dangling pointer in the middle of a
-    //syscall, bringing the reference count to 2. Finally, to get the reference
-    //count, we need to get the intrusive_shared_ptr first as a temporary through
-    //shared_from_this() and this adds to the reference count, reaching 3.
-    //This should be done with the mutex locked to prevent concurrent calls from
-    //not spotting that we are unconnected
-    return shared_from_this().use_count()<=3;
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_mode=S_IFIFO | 0600; //prw-------
+    pstat->st_nlink=1;
+    return 0;
 }
 
+int PipeEnd::fcntl(int cmd, int opt)
+{
+    switch(cmd)
+    {
+        case F_SETPIPE_SZ:
+            return pipe->setCapacity(opt);
+        case F_GETPIPE_SZ:
+            return pipe->getCapacity();
+    }
+    return FileBase::fcntl(cmd,opt);
+}
+
+int PipeEnd::poll(int events) { return pipe->poll(writeEnd,events); }
+
+PollQueue *PipeEnd::getPollQueue() { return pipe->getPollQueue(); }
+
+PipeEnd::~PipeEnd() { pipe->closeEnd(writeEnd); }
+
 } //namespace miosix
 
 #endif //WITH_FILESYSTEM
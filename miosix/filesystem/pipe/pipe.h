@@ -31,28 +31,129 @@
 #include "kernel/sync.h"
 #include "config/miosix_settings.h"
 
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031 ///< fcntl command to set the pipe capacity
+#endif
+#ifndef F_GETPIPE_SZ
+#define F_GETPIPE_SZ 1032 ///< fcntl command to get the pipe capacity
+#endif
+
 #ifdef WITH_FILESYSTEM
 
 namespace miosix {
 
 /**
  * Pipe
- * This is an almost standard compliant pipe implementation. A pipe should in
- * theory have two separate file descriptors pointing to two file objects, one
- * for the read end and one for the write end. This pipe implementation is a
- * single file object that does both. This file object is aliased through
- * reference counting to both file descriptors, which can be used
- * interchangeably as read/write end. Code that uses those file descriptor in a
- * standard compliant way won't notice the difference.
+ * This class holds the state shared by the two ends of a pipe, which are
+ * separate PipeEnd file objects. The data is stored in a ring buffer, which is
+ * accessed with at most two memcpy per read or write. When all the file
+ * descriptors referring to one end are closed, the other end is notified
+ * immediately, so blocked readers see end of file and blocked writers fail
+ * with EPIPE.
  */
-class Pipe : public FileBase
+class Pipe : public IntrusiveRefCounted<Pipe>
 {
 public:
+    /**
+     * Create a pipe
+     * \param readEnd the read end of the pipe will be stored here
+     * \param writeEnd the write end of the pipe will be stored here
+     */
+    static void create(intrusive_ref_ptr<FileBase>& readEnd,
+                       intrusive_ref_ptr<FileBase>& writeEnd);
+
+    /**
+     * Write data to the pipe, blocking until all data has been written or
+     * the read end is closed.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the pipe, blocking until some data is available or the
+     * write end is closed.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, 0 if the write end is closed and
+     * the pipe is empty, or a negative number in case of errors
+     */
+    ssize_t read(void *data, size_t len);
+
+    /**
+     * Check whether one of the ends of the pipe is ready for I/O
+     * \param writeEnd true to check the write end, false for the read end
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
+     */
+    int poll(bool writeEnd, int events);
+
+    /**
+     * Change the pipe capacity
+     * \param newCapacity new capacity in bytes
+     * \return the new capacity, -EINVAL if the capacity is out of range, or
+     * -EBUSY if the pipe contains more data than the new capacity
+     */
+    int setCapacity(int newCapacity);
+
+    /**
+     * \return the pipe capacity in bytes
+     */
+    int getCapacity();
+
+    /**
+     * Called when all the file descriptors of one end of the pipe are closed
+     * \param writeEnd true if the write end was closed, false for the read end
+     */
+    void closeEnd(bool writeEnd);
+
+    /**
+     * \return the queue of threads blocked in poll() on the pipe
+     */
+    PollQueue *getPollQueue() { return &pollQueue; }
+
+    /**
+     * Destructor
+     */
+    ~Pipe();
+
+    static const int defaultCapacity=256;  ///< Capacity of a new pipe
+    static const int maxCapacity=65536;    ///< Maximum pipe capacity
+
+private:
     /**
      * Constructor
      */
     Pipe();
 
+    Pipe(const Pipe&)=delete;
+    Pipe& operator=(const Pipe&)=delete;
+
+    FastMutex m;
+    ConditionVariable notEmpty; ///< Readers wait here for data
+    ConditionVariable notFull;  ///< Writers wait here for free space
+    PollQueue pollQueue;
+    int put, get, size, capacity;
+    char *buffer;
+    bool readerClosed, writerClosed;
+};
+
+/**
+ * One of the two ends of a pipe. Multiple file descriptors can refer to the
+ * same end through dup(), and the end is closed when the last one is closed.
+ */
+class PipeEnd : public FileBase
+{
+public:
+    /**
+     * Constructor
+     * \param pipe the pipe
+     * \param writeEnd true for the write end, false for the read end
+     */
+    PipeEnd(intrusive_ref_ptr<Pipe> pipe, bool writeEnd);
+
     /**
      * Write data to the file, if the file supports writing.
      * \param data the data to write
@@ -96,7 +197,8 @@ public:
     virtual int fstat(struct stat *pstat) const;
 
     /**
-     * Perform various operations on a file descriptor
+     * Perform various operations on a file descriptor. In addition to the
+     * generic ones, F_SETPIPE_SZ and F_GETPIPE_SZ are supported.
      * \param cmd specifies the operation to perform
      * \param opt optional argument that some operation require
      * \return the exact return value depends on CMD, -1 is returned on error
@@ -104,23 +206,25 @@ public:
     virtual int fcntl(int cmd, int opt);
 
     /**
-     * Destructor
+     * Check whether the pipe is ready for I/O, used to implement poll().
+     * \param events requested events, a combination of POLLIN and POLLOUT
+     * \return the events that are currently ready
      */
-    ~Pipe();
+    virtual int poll(int events);
 
-private:
     /**
-     * \return true if there is only one file descriptor associated with the pipe
-     * Must be called with mutex locked
+     * \return the queue of threads blocked in poll() on this pipe
      */
-    bool unconnected();
+    virtual PollQueue *getPollQueue();
 
-    static const int defaultSize=256;
-    static const int pollTime=100000000; //100ms
-    FastMutex m;
-    ConditionVariable cv;
-    int put, get, size, capacity;
-    char *buffer;
+    /**
+     * Destructor, notifies the other end that this end was closed
+     */
+    ~PipeEnd();
+
+private:
+    intrusive_ref_ptr<Pipe> pipe;
+    const bool writeEnd;
 };
 
 } //namespace miosix
@@ -27,12 +27,14 @@
 
 #include "romfs.h"
 #include <string>
+#include <memory>
 #include <errno.h>
 #include <fcntl.h>
 #include "filesystem/path.h"
 #include "kernel/logging.h"
 #include "interfaces/endianness.h"
 #include "util/util.h"
+#include "util/lz4.h"
 #include "romfs_types.h"
 
 #ifdef WITH_FILESYSTEM
@@ -64,6 +66,17 @@ const void *getRomFsAddressAfterKernel()
     return nullptr;
 }
 
+/**
+ * \param entry directory entry
+ * \return the entry mode, with compressed files reported as regular files
+ */
+static unsigned short entryMode(const RomFsDirectoryEntry *entry)
+{
+    unsigned short mode=fromLittleEndian16(entry->mode);
+    if((mode & S_IFMT)!=romFsCompressedFile) return mode;
+    return (mode & ~S_IFMT) | S_IFREG;
+}
+
 /**
  * Fill a struct stat
  * \param pstat struct stat to fill
@@ -76,7 +89,7 @@ static void fillStatHelper(struct stat* pstat, const RomFsDirectoryEntry *entry,
     memset(pstat,0,sizeof(struct stat));
     pstat->st_dev=dev;
     pstat->st_ino=fromLittleEndian32(entry->inode);
-    pstat->st_mode=fromLittleEndian16(entry->mode);
+    pstat->st_mode=entryMode(entry);
     pstat->st_nlink=1;
     pstat->st_uid=fromLittleEndian16(entry->uid);
     pstat->st_gid=fromLittleEndian16(entry->gid);
@@ -167,7 +180,7 @@ public:
      */
     virtual MemoryMappedFile getFileFromMemory();
 
-private:
+protected:
     const RomFsDirectoryEntry * const entry;
     off_t seekPoint; ///< Seek point (note that off_t is 64bit)
 };
@@ -229,6 +242,121 @@ MemoryMappedFile MemoryMappedRomFsFile::getFileFromMemory()
                             fromLittleEndian32(entry->size));
 }
 
+/**
+ * Compressed file class for MemoryMappedRomFs
+ */
+class MemoryMappedRomFsCompressedFile : public MemoryMappedRomFsFile
+{
+public:
+    /**
+     * Constructor
+     * \param parent pointer to parent filesystem
+     * \param flags file open flags
+     * \param entry directory entry containing the file information
+     * \param window buffer of the file block size to hold a decompressed block
+     */
+    MemoryMappedRomFsCompressedFile(intrusive_ref_ptr<FilesystemBase> parent,
+            int flags, const RomFsDirectoryEntry *entry,
+            unique_ptr<char[]> window)
+            : MemoryMappedRomFsFile(parent,flags,entry), window(move(window)) {}
+
+    /**
+     * Read data from the file, if the file supports reading.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Compressed files are not stored as a contiguous block
+     * \return {nullptr,0}
+     */
+    virtual MemoryMappedFile getFileFromMemory();
+
+private:
+    /**
+     * Decompress a block of the file
+     * \param parent parent filesystem
+     * \param block block number
+     * \param dst buffer where to decompress the block
+     * \param size uncompressed block size
+     * \return true on success
+     */
+    bool decompressBlock(MemoryMappedRomFs *parent, unsigned int block,
+                         char *dst, unsigned int size);
+
+    unique_ptr<char[]> window; ///< Holds the last decompressed block
+    unsigned int windowBlock=0xffffffff; ///< Block in window, if any
+};
+
+ssize_t MemoryMappedRomFsCompressedFile::read(void *data, size_t len)
+{
+    unsigned int size=fromLittleEndian32(entry->size);
+    if(seekPoint>=size) return 0;
+    size_t toRead=min<size_t>(len,size-seekPoint);
+    #ifdef __NO_EXCEPTIONS
+    auto parent=static_pointer_cast<MemoryMappedRomFs>(getParent());
+    #else
+    auto parent=dynamic_pointer_cast<MemoryMappedRomFs>(getParent());
+    #endif
+    auto header=parent->ptr<const RomFsCompressedFile*>(
+        fromLittleEndian32(entry->inode));
+    unsigned int blockSize=fromLittleEndian32(header->blockSize);
+    char *out=reinterpret_cast<char*>(data);
+    size_t done=0;
+    while(done<toRead)
+    {
+        unsigned int block=seekPoint/blockSize;
+        unsigned int blockStart=block*blockSize;
+        unsigned int blockLen=min(blockSize,size-blockStart);
+        unsigned int inBlock=seekPoint-blockStart;
+        unsigned int n=min<size_t>(toRead-done,blockLen-inBlock);
+        if(inBlock==0 && n==blockLen && block!=windowBlock)
+        {
+            //Whole blocks are decompressed directly in the caller's buffer
+            if(!decompressBlock(parent.get(),block,out+done,blockLen))
+                return -EIO;
+        } else {
+            if(block!=windowBlock)
+            {
+                windowBlock=0xffffffff;
+                if(!decompressBlock(parent.get(),block,window.get(),blockLen))
+                    return -EIO;
+                windowBlock=block;
+            }
+            memcpy(out+done,window.get()+inBlock,n);
+        }
+        done+=n;
+        seekPoint+=n;
+    }
+    return done;
+}
+
+MemoryMappedFile MemoryMappedRomFsCompressedFile::getFileFromMemory()
+{
+    return MemoryMappedFile(nullptr,0);
+}
+
+bool MemoryMappedRomFsCompressedFile::decompressBlock(MemoryMappedRomFs *parent,
+        unsigned int block, char *dst, unsigned int size)
+{
+    unsigned int inode=fromLittleEndian32(entry->inode);
+    auto offsets=parent->ptr<const unsigned int*>(
+        inode+sizeof(RomFsCompressedFile));
+    unsigned int begin=fromLittleEndian32(offsets[block]);
+    unsigned int end=fromLittleEndian32(offsets[block+1]);
+    const char *src=parent->ptr(inode+begin);
+    //Blocks that did not shrink when compressed are stored uncompressed
+    if(end-begin==size)
+    {
+        memcpy(dst,src,size);
+        return true;
+    }
+    return lz4Decompress(src,end-begin,dst,size)==static_cast<int>(size);
+}
+
 /**
  * Directory class for MemoryMappedRomFs
  */
@@ -287,8 +415,8 @@ int MemoryMappedRomFsDirectory::getdents(void *dp, int len)
     {
         auto e=parent->ptr<const RomFsDirectoryEntry*>(index);
         unsigned int entryInode=fromLittleEndian32(e->inode);
-        unsigned char entryMode=modeToType(fromLittleEndian16(e->mode));
-        if(addEntry(&buffer,end,entryInode,entryMode,e->name)<0)
+        unsigned char entryType=modeToType(entryMode(e));
+        if(addEntry(&buffer,end,entryInode,entryType,e->name)<0)
             return buffer-begin;
         index+=sizeof(RomFsDirectoryEntry)+strlen(e->name)+1; // +1 for the \0
         index=(index+romFsStructAlignment-1) & (0-romFsStructAlignment);
@@ -302,10 +430,18 @@ int MemoryMappedRomFsDirectory::getdents(void *dp, int len)
 //
 
 MemoryMappedRomFs::MemoryMappedRomFs(const void *baseAddress)
-    : base(reinterpret_cast<const char*>(baseAddress)), failed(false)
+    : base(reinterpret_cast<const char*>(baseAddress)), indexed(false),
+      failed(false)
 {
     auto header=ptr<const RomFsHeader*>(0);
-    if(strncmp(header->fsName,"RomFs 2.01",11)==0) return;
+    //RomFs 2.01 has no directory name index, which was added in 2.02, and
+    //2.03 added compressed files, which older images simply do not contain
+    if(strncmp(header->fsName,"RomFs 2.0",9)==0 && header->fsName[10]=='\0'
+       && header->fsName[9]>='1' && header->fsName[9]<='3')
+    {
+        indexed=header->fsName[9]>='2';
+        return;
+    }
     errorLog("Unexpected FS version %s\n",header->fsName);
     failed=true;
 }
@@ -323,6 +459,18 @@ int MemoryMappedRomFs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
             file=intrusive_ref_ptr<FileBase>(new MemoryMappedRomFsFile(
                 shared_from_this(),flags,entry));
             break;
+        case romFsCompressedFile:
+        {
+            auto header=ptr<const RomFsCompressedFile*>(
+                fromLittleEndian32(entry->inode));
+            unsigned int blockSize=fromLittleEndian32(header->blockSize);
+            if(blockSize==0 || blockSize>romFsMaxBlockSize) return -EIO;
+            unique_ptr<char[]> window(new (nothrow) char[blockSize]);
+            if(!window) return -ENOMEM;
+            file=intrusive_ref_ptr<FileBase>(new MemoryMappedRomFsCompressedFile(
+                shared_from_this(),flags,entry,move(window)));
+            break;
+        }
         case S_IFDIR:
             file=intrusive_ref_ptr<FileBase>(new MemoryMappedRomFsDirectory(
                 shared_from_this(),entry));
@@ -371,7 +519,20 @@ const RomFsDirectoryEntry *MemoryMappedRomFs::findEntry(StringPart& name)
     {
         if((fromLittleEndian16(entry->mode) & S_IFMT)!=S_IFDIR) return nullptr;
         unsigned int inode=fromLittleEndian32(entry->inode);
-        const void *end=ptr(inode+fromLittleEndian32(entry->size));
+        unsigned int size=fromLittleEndian32(entry->size);
+        if(indexed)
+        {
+            unsigned int indexOffset=(inode+size+romFsStructAlignment-1)
+                                   & (0-romFsStructAlignment);
+            auto index=ptr<const RomFsDirectoryIndex *>(indexOffset);
+            if(index->numEntries!=0)
+            {
+                entry=findIndexedEntry(index,element->c_str());
+                if(entry==nullptr) return nullptr; //Not found
+                continue;
+            }
+        }
+        const void *end=ptr(inode+size);
         entry=ptr<const RomFsDirectoryEntry *>(inode+sizeof(RomFsFirstEntry));
         while(entry<end)
         {
@@ -383,6 +544,30 @@ const RomFsDirectoryEntry *MemoryMappedRomFs::findEntry(StringPart& name)
     return entry;
 }
 
+const RomFsDirectoryEntry *MemoryMappedRomFs::findIndexedEntry(
+        const RomFsDirectoryIndex *index, const char *name)
+{
+    auto entries=reinterpret_cast<const RomFsIndexEntry*>(index+1);
+    unsigned int n=fromLittleEndian32(index->numEntries);
+    unsigned int hash=romFsHash(name);
+    //Binary search for the first index entry with the given hash
+    unsigned int lo=0, hi=n;
+    while(lo<hi)
+    {
+        unsigned int mid=lo+(hi-lo)/2;
+        if(fromLittleEndian32(entries[mid].hash)<hash) lo=mid+1;
+        else hi=mid;
+    }
+    //Then check all entries with that hash, as names may collide
+    for(;lo<n && fromLittleEndian32(entries[lo].hash)==hash;lo++)
+    {
+        auto entry=ptr<const RomFsDirectoryEntry *>(
+            fromLittleEndian32(entries[lo].offset));
+        if(strcmp(name,entry->name)==0) return entry;
+    }
+    return nullptr;
+}
+
 } //namespace miosix
 
 #endif //WITH_FILESYSTEM
@@ -35,6 +35,7 @@
 
 //Forward decl
 struct RomFsDirectoryEntry;
+struct RomFsDirectoryIndex;
 
 namespace miosix {
 
@@ -155,8 +156,18 @@ private:
      */
     const RomFsDirectoryEntry *findEntry(StringPart& name);
 
+    /**
+     * Look up a name in a directory name index
+     * \param index name index of the directory, must not be empty
+     * \param name file/directory/symlink name
+     * \return corresponding entry if found, or nullptr
+     */
+    const RomFsDirectoryEntry *findIndexedEntry(const RomFsDirectoryIndex *index,
+                                                const char *name);
+
     const char * const base;
-    bool failed; ///< Failed to mount
+    bool indexed; ///< Directories have a name index (RomFs 2.02)
+    bool failed;  ///< Failed to mount
 };
 
 } //namespace miosix
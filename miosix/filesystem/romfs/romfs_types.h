@@ -35,7 +35,7 @@
 struct RomFsHeader
 {
     char marker[6];            ///< 5 'w' characters, null terminated
-    char fsName[11];           ///< "RomFs 2.00", null terminated
+    char fsName[11];           ///< "RomFs 2.03", null terminated
     char osName[7];            ///< "Miosix", null terminated
     unsigned int imageSize;    ///< Size of the entire filesystem image
     unsigned int unused;       ///< Reserved for future use, set as 0 for now
@@ -61,6 +61,73 @@ struct __attribute__((packed)) RomFsDirectoryEntry
     char name[];              ///< File name, null teminated
 };
 
+/**
+ * Starting from RomFs 2.02, every directory inode is followed by a name index,
+ * stored at the first romFsStructAlignment aligned offset after the last
+ * directory entry. The index is not included in the directory size, so code
+ * that only iterates directory entries is unaffected by it.
+ * The header is followed by numEntries RomFsIndexEntry sorted by hash, to
+ * allow looking up a name with a binary search. Directories with less than
+ * romFsIndexMinEntries entries have an empty index, as a linear scan is
+ * faster for them.
+ */
+struct RomFsDirectoryIndex
+{
+    unsigned int numEntries;  ///< Number of index entries, 0 if no index
+};
+
+/**
+ * Name index entry
+ */
+struct RomFsIndexEntry
+{
+    unsigned int hash;        ///< Hash of the entry name, see romFsHash()
+    unsigned int offset;      ///< Offset of the RomFsDirectoryEntry
+};
+
+/**
+ * Hash function used by the name index, 32 bit FNV-1a
+ * \param name null terminated file name
+ * \return the hash of the name
+ */
+inline unsigned int romFsHash(const char *name)
+{
+    unsigned int hash=2166136261u;
+    for(;*name;name++)
+    {
+        hash^=static_cast<unsigned char>(*name);
+        hash*=16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Starting from RomFs 2.03, regular files can be stored compressed. Compressed
+ * files have romFsCompressedFile as file type in the mode field of their
+ * directory entry, and the size field is the uncompressed file size.
+ * The file content is split in blocks of blockSize bytes (the last block may
+ * be shorter) and each block is compressed independently as an LZ4 block, so
+ * that reading at any offset only requires decompressing one block.
+ * The inode starts with this header, followed by an array of
+ * numBlocks+1 unsigned int with the offset from the inode start of each
+ * compressed block, the last one being the end of the compressed data.
+ * Blocks that would not shrink when compressed are stored uncompressed, and are
+ * recognized by having the same compressed and uncompressed size.
+ */
+struct RomFsCompressedFile
+{
+    unsigned int blockSize;   ///< Uncompressed block size
+};
+
+/// File type (the S_IFMT bits of mode) of compressed regular files. Chosen
+/// among the file type values not used by POSIX, and reported as S_IFREG
+const unsigned short romFsCompressedFile=0110000;
+/// Maximum block size of compressed files, as the kernel needs a block sized
+/// buffer for each open compressed file
+const unsigned int romFsMaxBlockSize=16384;
+
+/// Directories with less than this number of entries have an empty name index
+const unsigned int romFsIndexMinEntries=8;
 /// Alignment of all filesystem data structures. Must be a power of 2. Chosen as
 /// 4 bytes for compatibility to architectures without unaligned memory accesses
 const unsigned int romFsStructAlignment=4;
@@ -78,3 +145,6 @@ static_assert(romFsImageAlignment>=romFsStructAlignment,"");
 static_assert(sizeof(RomFsHeader)==32,"");
 static_assert(sizeof(RomFsFirstEntry)==4,"");
 static_assert(sizeof(RomFsDirectoryEntry)==14,"");
+static_assert(sizeof(RomFsDirectoryIndex)==4,"");
+static_assert(sizeof(RomFsIndexEntry)==8,"");
+static_assert(sizeof(RomFsCompressedFile)==4,"");
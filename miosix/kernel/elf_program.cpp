@@ -28,12 +28,14 @@
 #include "elf_program.h"
 #include "process.h"
 #include "process_pool.h"
+#include "intrusive.h"
 #include "filesystem/file_access.h"
 #include "interfaces/cpu_const.h"
 #include <stdexcept>
 #include <cstring>
 #include <cstdio>
 #include <memory>
+#include <new>
 
 using namespace std;
 
@@ -48,9 +50,137 @@ namespace miosix {
 ///By convention, in an elf file for Miosix, the data segment starts @ this addr
 static const unsigned int DATA_BASE=0x40000000;
 
+/**
+ * Cache of relocated data segment templates, to speed up creating process
+ * images. A template is the initial content of the part of a process image
+ * that is initialized from the elf file, with relocations already applied for
+ * a given image address, plus the list of words that need to be adjusted if
+ * the image is at a different address.
+ * Templates are indexed by elf pointer, and since relocations to the code
+ * segment only depend on it, they are already applied.
+ */
+class DataTemplateCache
+{
+public:
+    /**
+     * A relocated data segment template. The object is followed in memory by
+     * the template content and the word offsets to adjust
+     */
+    struct Template
+    {
+        const unsigned int *elf; ///< Program this template belongs to
+        unsigned int ramSize;    ///< Process image size (DT_MX_RAMSIZE)
+        unsigned int stackSize;  ///< Main stack size (DT_MX_STACKSIZE)
+        unsigned int dataBssSize;///< Size of .data and .bss
+        unsigned int ramBase;    ///< Image address the template is relocated for
+        unsigned int words;      ///< Template size in words
+        unsigned int numFixups;  ///< Number of words to adjust
+        Template *next;          ///< Next template in the cache
+
+        unsigned int *data() { return reinterpret_cast<unsigned int*>(this+1); }
+        unsigned short *fixups()
+        {
+            return reinterpret_cast<unsigned short*>(data()+words);
+        }
+    };
+
+    /**
+     * Allocate a template, to be filled by the caller and then added with add()
+     * \param words template size in words
+     * \param numFixups number of words to adjust
+     * \return the template or nullptr if out of memory
+     */
+    static Template *allocate(unsigned int words, unsigned int numFixups);
+
+    /**
+     * Add a template to the cache, possibly replacing the least recently
+     * added one
+     * \param t template to add
+     */
+    static void add(Template *t);
+
+    /**
+     * Remove the template of a program, if present
+     * \param elf pointer to the program
+     */
+    static void invalidate(const unsigned int *elf);
+
+    /**
+     * \param elf pointer to the program
+     * \return the program template or nullptr. Must be called with m locked
+     */
+    static Template *find(const unsigned int *elf);
+
+    static FastMutex m; ///< Protects the cache
+
+private:
+    static const int maxTemplates=4; ///< Maximum number of templates
+    static Template *templates;      ///< Cached templates, newest first
+};
+
+DataTemplateCache::Template *DataTemplateCache::allocate(unsigned int words,
+        unsigned int numFixups)
+{
+    unsigned int bytes=sizeof(Template)+words*sizeof(unsigned int)
+                      +numFixups*sizeof(unsigned short);
+    auto t=reinterpret_cast<Template*>(new (nothrow) char[bytes]);
+    if(t==nullptr) return nullptr;
+    t->words=words;
+    t->numFixups=numFixups;
+    return t;
+}
+
+void DataTemplateCache::add(Template *t)
+{
+    Lock<FastMutex> l(m);
+    //Another thread may have added the template concurrently
+    if(find(t->elf))
+    {
+        delete[] reinterpret_cast<char*>(t);
+        return;
+    }
+    t->next=templates;
+    templates=t;
+    int count=0;
+    for(Template **walk=&templates;*walk;walk=&(*walk)->next)
+    {
+        if(++count<=maxTemplates) continue;
+        Template *removed=*walk;
+        *walk=nullptr;
+        delete[] reinterpret_cast<char*>(removed);
+        break;
+    }
+}
+
+void DataTemplateCache::invalidate(const unsigned int *elf)
+{
+    Lock<FastMutex> l(m);
+    for(Template **walk=&templates;*walk;walk=&(*walk)->next)
+    {
+        if((*walk)->elf!=elf) continue;
+        Template *removed=*walk;
+        *walk=removed->next;
+        delete[] reinterpret_cast<char*>(removed);
+        return;
+    }
+}
+
+DataTemplateCache::Template *DataTemplateCache::find(const unsigned int *elf)
+{
+    for(Template *t=templates;t;t=t->next) if(t->elf==elf) return t;
+    return nullptr;
+}
+
+FastMutex DataTemplateCache::m;
+DataTemplateCache::Template *DataTemplateCache::templates=nullptr;
+
 /**
  * Cache of programs loaded in RAM, to allow sharing memory for the code part
- * of loaded programs
+ * of loaded programs.
+ * Programs are kept in RAM also when no process is using them, to make
+ * spawning the same program again fast. Unused programs are evicted in least
+ * recently used order when the process pool runs out of memory, and are
+ * invalidated when the file they were loaded from is modified.
  */
 class ProgramCache
 {
@@ -68,10 +198,12 @@ public:
      * requested program is in a XIP capable filesystem, so the pointer returned
      * is to a memory area that does not need unloading, and calling unload is
      * not required.
+     * \param validated true if the program was found in the cache and was
+     * already validated with a call to setValidated()
      * \return 0 on success, an error code on error
      */
     static int load(const char *name, const unsigned int *& elf,
-             unsigned int& size, bool& needUnload);
+             unsigned int& size, bool& needUnload, bool& validated);
 
     /**
      * Unload a program that was loaded in RAM
@@ -79,38 +211,96 @@ public:
      */
     static void unload(const unsigned int *elf);
 
+    /**
+     * Mark a program loaded in RAM as valid, so that validation can be skipped
+     * next time it is loaded
+     * \param elf pointer to the program
+     */
+    static void setValidated(const unsigned int *elf);
+
+    /**
+     * Remove a file from the cache, as it was modified
+     * \param inode inode of the file
+     * \param device filesystem id
+     */
+    static void invalidate(ino_t inode, dev_t device);
+
+    /**
+     * Allocate memory in the process pool, evicting unused programs if needed
+     * \param size size in bytes of the requested memory
+     * \param zero if true, the returned memory is zeroed
+     * \return same as ProcessPool::allocate()
+     * \throws bad_alloc if out of memory
+     */
+    static pair<unsigned int *, unsigned int> allocate(unsigned int size,
+                                                       bool zero=false);
+
 private:
     /**
-     * An entry into the cache of programs loaded in RAM
+     * An entry into the cache of programs loaded in RAM.
+     * Entries are in a hash table indexed by <inode,dev> to load programs
+     * and in another one indexed by pointer to unload them. Entries whose
+     * useCount is zero are also in the lru list.
      */
-    class Entry
+    class Entry : public IntrusiveListItem
     {
     public:
         /**
          * Constructor
          * \param inode inode of file on disk, used as key
          * \param device filesystem id, used as key
+         * \param fileSize file size, used to detect modified files
          * \param elf pointer to the program RAM allocated memory region
          * \param size memory region size
          */
-        Entry(ino_t inode, dev_t device, unsigned int *elf, unsigned int size)
-            : inode(inode), device(device), elf(elf), size(size), useCount(1) {}
+        Entry(ino_t inode, dev_t device, off_t fileSize, unsigned int *elf,
+              unsigned int size) : inode(inode), device(device),
+              fileSize(fileSize), elf(elf), size(size), useCount(1),
+              validated(false), stale(false) {}
         ino_t inode;
         dev_t device;
+        off_t fileSize;
         unsigned int *elf;
         unsigned int size;
-        int useCount; ///< Used for reference counting the cache entry
+        int useCount;    ///< Used for reference counting the cache entry
+        bool validated;  ///< Elf file already validated
+        bool stale;      ///< File modified, entry no longer in keyTable
+        Entry *nextByKey=nullptr; ///< Next entry in the keyTable bucket
+        Entry *nextByElf=nullptr; ///< Next entry in the elfTable bucket
     };
 
+    static unsigned int keyHash(ino_t inode, dev_t device)
+    {
+        return (static_cast<unsigned int>(inode)*2654435761u
+              ^ static_cast<unsigned int>(device)) % hashSize;
+    }
+
+    static unsigned int elfHash(const unsigned int *elf)
+    {
+        //Programs are in the process pool, aligned to at least 1KB
+        return (reinterpret_cast<unsigned int>(elf)>>10) % hashSize;
+    }
+
+    static pair<unsigned int *, unsigned int> allocateLocked(unsigned int size,
+                                                             bool zero=false);
+    static Entry *findByKey(ino_t inode, dev_t device);
+    static Entry *findByElf(const unsigned int *elf);
+    static void removeByKey(Entry *e);
+    static void destroy(Entry *e);
+    static bool evict();
+
+    static const unsigned int hashSize=16; ///< Buckets in the hash tables
     static FastMutex m; ///< Protect programs against concurrent accesses
-    static list<Entry> programs; ///< Cache entries
+    static Entry *keyTable[hashSize]; ///< Entries indexed by <inode,dev>
+    static Entry *elfTable[hashSize]; ///< Entries indexed by elf pointer
+    static IntrusiveList<Entry> lru;  ///< Unused entries, oldest first
 };
 
 //
 // class ProgramCache
 //
 int ProgramCache::load(const char *name, const unsigned int *& elf,
-                       unsigned int& size, bool& needUnload)
+        unsigned int& size, bool& needUnload, bool& validated)
 {
     if(name==nullptr || name[0]=='\0') return -EFAULT;
     string path=getFileDescriptorTable().absolutePath(name);
@@ -127,34 +317,37 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
         elf=reinterpret_cast<const unsigned int*>(mmFile.data);
         size=mmFile.size;
         needUnload=false;
+        validated=false;
         DBG("ProgramCache::load(%s): found %p in XIP fs\n",name,elf);
         return 0;
     }
     //Search program in cache
-    //NOTE: if the program is modified on disk in a way that the inode does not
-    //change and at least one instance of the program is running, subsequent
-    //attempts to run the same program will hit the cache and return the old
-    //version, i.e. the one that was overwritten on disk. We would need some
-    //kind of inotify framework to invalidate the cache...
+    //NOTE: the cache is invalidated by the filesystem code when a file is
+    //opened for writing, truncated, renamed or unlinked. As a further check in
+    //case the file was modified by other means, the file size is compared
     struct stat s;
     if(file->fstat(&s)) return -EFAULT;
     Lock<FastMutex> l(m);
-    //I know, lookup is O(n), but we need to index the cache by <inode,dev>
-    //when loading, and index it by pointer when unloading, while also caring
-    //about code size. On top of that, we don't expect many loaded programs
-    //and spawning a process is already a heavy operation so this won't be
-    //the bottleneck anyway
-    for(auto& p : programs)
+    if(Entry *e=findByKey(s.st_ino,s.st_dev))
     {
-        if(p.inode!=s.st_ino || p.device!=s.st_dev) continue;
-        //Found, increment use count and return
-        p.useCount++;
-        elf=p.elf;
-        size=p.size;
-        needUnload=true;
-        DBG("ProgramCache::load(%s): found %p in cache use count %d\n",
-            name,elf,p.useCount);
-        return 0;
+        if(e->fileSize==s.st_size)
+        {
+            //Found, increment use count and return
+            if(e->useCount++==0) lru.removeFast(e);
+            elf=e->elf;
+            size=e->size;
+            needUnload=true;
+            validated=e->validated;
+            DBG("ProgramCache::load(%s): found %p in cache use count %d\n",
+                name,elf,e->useCount);
+            return 0;
+        }
+        removeByKey(e);
+        if(e->useCount==0)
+        {
+            lru.removeFast(e);
+            destroy(e);
+        } else e->stale=true;
     }
     //Not found, load program in cache
     //Seek to the end to get file size, then seek back to the start
@@ -166,7 +359,7 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
     //Allocate a RAM block in the process pool
     unsigned int *ramPointer;
     unsigned int ramSize;
-    tie(ramPointer,ramSize)=ProcessPool::instance().allocate(fileSize);
+    tie(ramPointer,ramSize)=allocateLocked(fileSize);
     //Protect agains exceptions being thrown from here on
     auto finalize=[](unsigned int *p){ ProcessPool::instance().deallocate(p); };
     unique_ptr<unsigned int,decltype(finalize)> finalizer(ramPointer,finalize);
@@ -176,10 +369,17 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
     //Zero the eventual slack size
     memset(reinterpret_cast<unsigned char*>(ramPointer)+fileSize,0,ramSize-fileSize);
     //Success
-    programs.push_front(Entry(s.st_ino,s.st_dev,ramPointer,ramSize));
+    Entry *e=new Entry(s.st_ino,s.st_dev,fileSize,ramPointer,ramSize);
+    unsigned int k=keyHash(s.st_ino,s.st_dev);
+    e->nextByKey=keyTable[k];
+    keyTable[k]=e;
+    k=elfHash(ramPointer);
+    e->nextByElf=elfTable[k];
+    elfTable[k]=e;
     elf=ramPointer;
     size=ramSize;
     needUnload=true;
+    validated=false;
     finalizer.release();
     DBG("ProgramCache::load(%s): added %p in cache\n",name,elf);
     return 0;
@@ -188,23 +388,112 @@ int ProgramCache::load(const char *name, const unsigned int *& elf,
 void ProgramCache::unload(const unsigned int *elf)
 {
     Lock<FastMutex> l(m);
-    for(auto it=begin(programs);it!=end(programs);++it)
+    Entry *e=findByElf(elf);
+    if(e==nullptr)
     {
-        if(it->elf!=elf) continue;
-        DBG("ProgramCache::unload(%p): use count %d\n",elf,it->useCount);
-        if(--it->useCount<=0)
-        {
-            DBG("ProgramCache::unload(%p): deallocate\n",elf);
-            ProcessPool::instance().deallocate(it->elf);
-            programs.erase(it);
-        }
+        DBG("ProgramCache::unload(%p): bug: not in cache\n",elf);
         return;
     }
-    DBG("ProgramCache::unload(%p): bug: not in cache\n",elf);
+    DBG("ProgramCache::unload(%p): use count %d\n",elf,e->useCount);
+    if(--e->useCount>0) return;
+    if(e->stale)
+    {
+        DBG("ProgramCache::unload(%p): deallocate\n",elf);
+        destroy(e);
+    } else lru.push_back(e); //Keep it in RAM till memory is needed
+}
+
+void ProgramCache::setValidated(const unsigned int *elf)
+{
+    Lock<FastMutex> l(m);
+    if(Entry *e=findByElf(elf)) e->validated=true;
+}
+
+void ProgramCache::invalidate(ino_t inode, dev_t device)
+{
+    Lock<FastMutex> l(m);
+    Entry *e=findByKey(inode,device);
+    if(e==nullptr) return;
+    DBG("ProgramCache::invalidate(%p)\n",e->elf);
+    removeByKey(e);
+    if(e->useCount==0)
+    {
+        lru.removeFast(e);
+        destroy(e);
+    } else e->stale=true; //Deallocated by unload()
+}
+
+pair<unsigned int *, unsigned int> ProgramCache::allocate(unsigned int size,
+                                                         bool zero)
+{
+    Lock<FastMutex> l(m);
+    return allocateLocked(size,zero);
+}
+
+pair<unsigned int *, unsigned int> ProgramCache::allocateLocked(unsigned int size,
+                                                               bool zero)
+{
+    for(;;)
+    {
+        try {
+            return ProcessPool::instance().allocate(size,zero);
+        } catch(bad_alloc&) {
+            if(evict()==false) throw;
+        }
+    }
+}
+
+ProgramCache::Entry *ProgramCache::findByKey(ino_t inode, dev_t device)
+{
+    Entry *e=keyTable[keyHash(inode,device)];
+    while(e && (e->inode!=inode || e->device!=device)) e=e->nextByKey;
+    return e;
+}
+
+ProgramCache::Entry *ProgramCache::findByElf(const unsigned int *elf)
+{
+    Entry *e=elfTable[elfHash(elf)];
+    while(e && e->elf!=elf) e=e->nextByElf;
+    return e;
+}
+
+void ProgramCache::removeByKey(Entry *e)
+{
+    Entry **walk=&keyTable[keyHash(e->inode,e->device)];
+    while(*walk!=e) walk=&(*walk)->nextByKey;
+    *walk=e->nextByKey;
+}
+
+void ProgramCache::destroy(Entry *e)
+{
+    Entry **walk=&elfTable[elfHash(e->elf)];
+    while(*walk!=e) walk=&(*walk)->nextByElf;
+    *walk=e->nextByElf;
+    DataTemplateCache::invalidate(e->elf);
+    ProcessPool::instance().deallocate(e->elf);
+    delete e;
+}
+
+bool ProgramCache::evict()
+{
+    if(lru.empty()) return false;
+    Entry *e=lru.front();
+    DBG("ProgramCache::evict(%p)\n",e->elf);
+    lru.pop_front();
+    removeByKey(e);
+    destroy(e);
+    return true;
 }
 
 FastMutex ProgramCache::m;
-list<ProgramCache::Entry> ProgramCache::programs;
+ProgramCache::Entry *ProgramCache::keyTable[hashSize];
+ProgramCache::Entry *ProgramCache::elfTable[hashSize];
+IntrusiveList<ProgramCache::Entry> ProgramCache::lru;
+
+void invalidateProgramCache(ino_t inode, dev_t device)
+{
+    ProgramCache::invalidate(inode,device);
+}
 
 //
 // class ElfProgram
@@ -213,8 +502,18 @@ list<ProgramCache::Entry> ProgramCache::programs;
 ElfProgram::ElfProgram(const char *name)
     : elf(nullptr), size(0), ec(-ENOEXEC), copiedInRam(false)
 {
-    if(int ec=ProgramCache::load(name,elf,size,copiedInRam)) this->ec=ec;
-    else validateHeader();
+    bool validated;
+    if(int ec=ProgramCache::load(name,elf,size,copiedInRam,validated))
+        this->ec=ec;
+    else if(validated) {
+        this->ec=0;
+        validateTime=0;
+    } else {
+        long long t=getTime();
+        validateHeader();
+        validateTime=getTime()-t;
+        if(this->ec==0 && copiedInRam) ProgramCache::setValidated(elf);
+    }
 }
 
 void ElfProgram::validateHeader()
@@ -481,6 +780,7 @@ ElfProgram& ElfProgram::operator= (ElfProgram&& rhs)
     size=rhs.size;
     ec=rhs.ec;
     copiedInRam=rhs.copiedInRam;
+    validateTime=rhs.validateTime;
     //Invalidate rhs
     rhs.elf=nullptr;
     rhs.size=0;
@@ -501,7 +801,44 @@ ElfProgram::~ElfProgram()
 void ProcessImage::load(const ElfProgram& program)
 {
     if(image) ProcessPool::instance().deallocate(image);
+    image=nullptr;
+    loadTimes.validate=program.getValidateTime();
     const unsigned int base=program.getElfBase();
+    const unsigned int *elf=reinterpret_cast<const unsigned int*>(base);
+    //Fast path, use the relocated template of the data segment. The template
+    //can't be invalidated while program is in use, but can be replaced by
+    //other templates, so we need to look it up again after the allocation,
+    //which can't be done with the template cache locked
+    unsigned int ramSize=0;
+    {
+        Lock<FastMutex> l(DataTemplateCache::m);
+        if(auto t=DataTemplateCache::find(elf)) ramSize=t->ramSize;
+    }
+    //The entire process image is zeroed to prevent data leakage. Most of the
+    //times the process pool has already zeroed the memory in background
+    long long t0=getTime();
+    if(ramSize!=0)
+    {
+        tie(image,size)=ProgramCache::allocate(ramSize,true);
+        long long t1=getTime();
+        loadTimes.zero=t1-t0;
+        Lock<FastMutex> l(DataTemplateCache::m);
+        if(auto t=DataTemplateCache::find(elf))
+        {
+            mainStackSize=t->stackSize;
+            dataBssSize=t->dataBssSize;
+            memcpy(image,t->data(),t->words*sizeof(unsigned int));
+            const unsigned int delta=reinterpret_cast<unsigned int>(image)
+                                    -t->ramBase;
+            if(delta!=0)
+            {
+                const unsigned short *fixups=t->fixups();
+                for(unsigned int i=0;i<t->numFixups;i++) image[fixups[i]]+=delta;
+            }
+            loadTimes.relocate=getTime()-t1;
+            return;
+        }
+    }
     const Elf32_Phdr *phdr=program.getProgramHeaderTable();
     const Elf32_Phdr *dataSegment=nullptr;
     Elf32_Addr dtRel=0;
@@ -533,8 +870,8 @@ void ProcessImage::load(const ElfProgram& program)
                             dtRelsz=dyn->d_un.d_val;
                             break;
                         case DT_MX_RAMSIZE:
-                            tie(image,size)=ProcessPool::instance()
-                                    .allocate(dyn->d_un.d_val);
+                            ramSize=dyn->d_un.d_val;
+                            break;
                         case DT_MX_STACKSIZE:
                             mainStackSize=dyn->d_un.d_val;
                             break;
@@ -549,49 +886,74 @@ void ProcessImage::load(const ElfProgram& program)
                 break;
         }
     }
-    const char *dataSegmentInFile=
-        reinterpret_cast<const char*>(base+dataSegment->p_offset);
-    char *dataSegmentInMem=reinterpret_cast<char*>(image);
-    memcpy(dataSegmentInMem,dataSegmentInFile,dataSegment->p_filesz);
-    dataSegmentInMem+=dataSegment->p_filesz;
-    //Zero only .bss section (faster but processes leak data to other processes)
-    //memset(dataSegmentInMem,0,dataSegment->p_memsz-dataSegment->p_filesz);
-    //Zero the entire process image to prevent data leakage, exclude .data as
-    //it is initialized, and the stack size since it will be filled later
-    //NOTE: as the args block size isn't known here, we can't account for that.
-    //This is not an issue though, we may just unnecessary fill with zeros up to
-    //MAX_PROCESS_ARGS_BLOCK_SIZE bytes into the stack
-    memset(dataSegmentInMem,0,size-dataSegment->p_filesz-mainStackSize-WATERMARK_LEN);
+    if(image==nullptr)
+    {
+        t0=getTime();
+        tie(image,size)=ProgramCache::allocate(ramSize,true);
+        loadTimes.zero=getTime()-t0;
+    }
+    long long t1=getTime();
+    const unsigned int *dataSegmentInFile=
+        reinterpret_cast<const unsigned int*>(base+dataSegment->p_offset);
+    memcpy(image,dataSegmentInFile,dataSegment->p_filesz);
     dataBssSize=dataSegment->p_memsz;
-    if(hasRelocs)
+    const Elf32_Rel *rel=reinterpret_cast<const Elf32_Rel*>(base+dtRel);
+    const int relSize=hasRelocs ? dtRelsz/sizeof(Elf32_Rel) : 0;
+    const unsigned int ramBase=reinterpret_cast<unsigned int>(image);
+    //The template covers .data and any relocated word in .bss
+    unsigned int words=(dataSegment->p_filesz+3)/4;
+    const unsigned int fileWords=dataSegment->p_filesz/4;
+    unsigned int numFixups=0;
+    //DBG("Relocations -- start (code base @0x%x, data base @ 0x%x)\n",base,ramBase);
+    for(int i=0;i<relSize;i++)
     {
-        const Elf32_Rel *rel=reinterpret_cast<const Elf32_Rel*>(base+dtRel);
-        const int relSize=dtRelsz/sizeof(Elf32_Rel);
-        const unsigned int ramBase=reinterpret_cast<unsigned int>(image);
-        //DBG("Relocations -- start (code base @0x%x, data base @ 0x%x)\n",base,ramBase);
-        for(int i=0;i<relSize;i++,rel++)
+        unsigned int offset=(rel[i].r_offset-DATA_BASE)/4;
+        switch(ELF32_R_TYPE(rel[i].r_info))
         {
-            unsigned int offset=(rel->r_offset-DATA_BASE)/4;
-            switch(ELF32_R_TYPE(rel->r_info))
-            {
-                case R_ARM_RELATIVE:
-                    if(image[offset]>=DATA_BASE)
-                    {
-                        //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
-                        //    offset*4,image[offset],image[offset]+ramBase-DATA_BASE);
-                        image[offset]+=ramBase-DATA_BASE;
-                    } else {
-                        //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
-                        //    offset*4,image[offset],image[offset]+base);
-                        image[offset]+=base;
-                    }
-                    break;
-                default:
-                    break;
-            }
+            case R_ARM_RELATIVE:
+                if(image[offset]>=DATA_BASE)
+                {
+                    //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
+                    //    offset*4,image[offset],image[offset]+ramBase-DATA_BASE);
+                    image[offset]+=ramBase-DATA_BASE;
+                } else {
+                    //DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
+                    //    offset*4,image[offset],image[offset]+base);
+                    image[offset]+=base;
+                }
+                words=max(words,offset+1);
+                if(offset<fileWords && dataSegmentInFile[offset]>=DATA_BASE)
+                    numFixups++;
+                break;
+            default:
+                break;
         }
-        //DBG("Relocations -- end\n");
     }
+    //DBG("Relocations -- end\n");
+    loadTimes.relocate=getTime()-t1;
+
+    //Create the template for the next time. Words pointing to the data segment
+    //are found by looking at their value in the elf file, as the image is
+    //already relocated. Those are the words to adjust if the next image is
+    //allocated at a different address
+    static_assert(MAX_PROCESS_IMAGE_SIZE/4<=65536,"fixups are unsigned short");
+    auto t=DataTemplateCache::allocate(words,numFixups);
+    if(t==nullptr) return; //Not an error, just slower next time
+    t->elf=elf;
+    t->ramSize=ramSize;
+    t->stackSize=mainStackSize;
+    t->dataBssSize=dataBssSize;
+    t->ramBase=ramBase;
+    memcpy(t->data(),image,words*sizeof(unsigned int));
+    unsigned short *fixups=t->fixups();
+    for(int i=0;i<relSize;i++)
+    {
+        if(ELF32_R_TYPE(rel[i].r_info)!=R_ARM_RELATIVE) continue;
+        unsigned int offset=(rel[i].r_offset-DATA_BASE)/4;
+        if(offset<fileWords && dataSegmentInFile[offset]>=DATA_BASE)
+            *fixups++=offset;
+    }
+    DataTemplateCache::add(t);
 }
 
 ProcessImage::~ProcessImage()
@@ -29,6 +29,7 @@
 
 #include <utility>
 #include <cerrno>
+#include <sys/types.h>
 #include "elf_types.h"
 #include "config/miosix_settings.h"
 
@@ -36,6 +37,32 @@
 
 namespace miosix {
 
+/**
+ * \internal
+ * Called by the filesystem code when a file is modified, to drop the copy of
+ * the file that may have been loaded in RAM to spawn processes
+ * \param inode inode of the modified file
+ * \param device filesystem id of the modified file
+ */
+void invalidateProgramCache(ino_t inode, dev_t device);
+
+/**
+ * Time spent in the phases of loading a process, for benchmarking purposes
+ */
+struct SpawnTimes
+{
+    long long validate; ///< Elf file validation, zero if skipped
+    long long relocate; ///< Copying and relocating the data segment
+    long long zero;     ///< Allocating and zeroing the process image
+};
+
+/**
+ * \return the time in nanoseconds spent in the phases of loading the last
+ * process that was spawned. Defined in process.cpp, as the value is published
+ * while holding the process list mutex
+ */
+SpawnTimes getLastSpawnTimes();
+
 /**
  * This class represents an elf file.
  */
@@ -93,6 +120,12 @@ public:
      * and thus it was required to copy the file content in RAM
      */
     bool isCopiedInRam() const { return copiedInRam; }
+
+    /**
+     * \return the time in nanoseconds spent validating the elf file, zero if
+     * the validation was skipped because the file was already validated
+     */
+    long long getValidateTime() const { return validateTime; }
     
     /**
      * \return the a pointer to the elf header
@@ -190,6 +223,7 @@ private:
     unsigned int size;  ///< Size in bytes of the elf file
     int ec;             ///< Error code
     bool copiedInRam;   ///< If true, elf is allocated in RAM and *this owns it
+    long long validateTime=0; ///< Time spent validating the elf file
 };
 
 /**
@@ -235,6 +269,11 @@ public:
      * \return the size in bytes of the .data and .bss sections
      */
     unsigned int getDataBssSize() const { return dataBssSize; }
+
+    /**
+     * \return the time spent in the phases of the last call to load()
+     */
+    const SpawnTimes& getLoadTimes() const { return loadTimes; }
     
     /**
      * Destructor. Deletes the process image memory.
@@ -249,6 +288,7 @@ private:
     unsigned int size;          ///< Size in bytes of the process image
     unsigned int mainStackSize; ///< Size of the main stack
     unsigned int dataBssSize;   ///< Combined size of .data and .bss
+    SpawnTimes loadTimes={};    ///< Time spent in the last call to load()
 };
 
 } //namespace miosix
@@ -25,6 +25,8 @@
  *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
  ***************************************************************************/
 
+#include <utility>
+
 #ifndef TEST_ALGORITHM
 
 #include "intrusive.h"
@@ -33,8 +35,11 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
 
-// Unused stubs as the test code only tests IntrusiveList
+// Unused stubs as the test code only tests IntrusiveList/IntrusivePairingHeap
 inline int atomicSwap(volatile int*, int) { return 0; }
 void *atomicFetchAndIncrement(void *const volatile*, int, int) { return nullptr; }
 
@@ -172,9 +177,90 @@ void IntrusiveListBase::fail()
 }
 #endif //INTRUSIVE_LIST_ERROR_CHECK
 
+//
+// class IntrusivePairingHeapBase
+//
+
+void IntrusivePairingHeapBase::insert(IntrusivePairingHeapItem *item,
+        Compare cmp)
+{
+    if(root==nullptr) root=item;
+    else root=meld(root,item,cmp);
+}
+
+void IntrusivePairingHeapBase::pop_front(Compare cmp)
+{
+    IntrusivePairingHeapItem *removedItem=root;
+    root=combineSiblings(removedItem->child,cmp);
+    removedItem->child=nullptr;
+}
+
+void IntrusivePairingHeapBase::erase(IntrusivePairingHeapItem *item,
+        Compare cmp)
+{
+    if(item==root) return pop_front(cmp);
+    //Unlink the subtree rooted at item from its parent and siblings
+    if(item->prev->child==item) item->prev->child=item->next;
+    else item->prev->next=item->next;
+    if(item->next) item->next->prev=item->prev;
+    item->next=nullptr;
+    item->prev=nullptr;
+    //Then merge back the children of item
+    IntrusivePairingHeapItem *subtree=combineSiblings(item->child,cmp);
+    item->child=nullptr;
+    if(subtree) root=meld(root,subtree,cmp);
+}
+
+IntrusivePairingHeapItem *IntrusivePairingHeapBase::meld(
+        IntrusivePairingHeapItem *a, IntrusivePairingHeapItem *b, Compare cmp)
+{
+    if(cmp(b,a)) std::swap(a,b);
+    //Make b the leftmost child of a
+    b->prev=a;
+    b->next=a->child;
+    if(a->child) a->child->prev=b;
+    a->child=b;
+    return a;
+}
+
+IntrusivePairingHeapItem *IntrusivePairingHeapBase::combineSiblings(
+        IntrusivePairingHeapItem *first, Compare cmp)
+{
+    if(first==nullptr) return nullptr;
+    //First pass, left to right: meld siblings in pairs, pushing the results
+    //on a stack linked through the next pointer
+    IntrusivePairingHeapItem *stack=nullptr;
+    while(first)
+    {
+        IntrusivePairingHeapItem *a=first;
+        IntrusivePairingHeapItem *b=a->next;
+        first=b ? b->next : nullptr;
+        a->next=a->prev=nullptr;
+        if(b)
+        {
+            b->next=b->prev=nullptr;
+            a=meld(a,b,cmp);
+        }
+        a->next=stack;
+        stack=a;
+    }
+    //Second pass, right to left: meld all pairs into a single heap
+    IntrusivePairingHeapItem *result=stack;
+    stack=stack->next;
+    result->next=nullptr;
+    while(stack)
+    {
+        IntrusivePairingHeapItem *a=stack;
+        stack=stack->next;
+        a->next=nullptr;
+        result=meld(result,a,cmp);
+    }
+    return result;
+}
+
 } //namespace miosix
 
-//Testsuite for IntrusiveList. Compile with:
+//Testsuite for IntrusiveList and IntrusivePairingHeap. Compile with:
 //g++ -DTEST_ALGORITHM -DINTRUSIVE_LIST_ERROR_CHECK -fsanitize=address -m32
 //    -std=c++14 -Wall -O2 -o test intrusive.cpp; ./test
 #ifdef TEST_ALGORITHM
@@ -299,6 +385,80 @@ void threeItemCheck(IntrusiveList<IntrusiveListItem>& list, IntrusiveListItem& a
     assert(c.next==nullptr);
 }
 
+class HeapItem : public IntrusivePairingHeapItem
+{
+public:
+    int key=0;
+};
+
+bool operator<(const HeapItem& a, const HeapItem& b) { return a.key<b.key; }
+
+void emptyCheck(HeapItem& x)
+{
+    //Glass box check
+    assert(x.child==nullptr); assert(x.next==nullptr); assert(x.prev==nullptr);
+}
+
+void heapTest()
+{
+    HeapItem a,b,c;
+    IntrusivePairingHeap<HeapItem> heap;
+    assert(heap.empty());
+    assert(heap.removeFast(&a)==false); //Not present, heap empty
+    a.key=1; b.key=2; c.key=3;
+    heap.insert(&b);
+    assert(heap.front()==&b);
+    assert(heap.removeFast(&a)==false); //Not present, heap not empty
+    heap.insert(&c);
+    heap.insert(&a);
+    assert(heap.front()==&a);
+    assert(heap.removeFast(&b)==true); //Present, not at the root
+    emptyCheck(b);
+    assert(heap.front()==&a);
+    heap.pop_front();
+    emptyCheck(a);
+    assert(heap.front()==&c);
+    assert(heap.removeFast(&c)==true); //Present, at the root
+    emptyCheck(c);
+    assert(heap.empty());
+
+    //Randomized test against a sorted vector
+    const int numItems=1000;
+    vector<HeapItem> items(numItems);
+    vector<int> keys;
+    srand(0);
+    for(int iter=0;iter<100;iter++)
+    {
+        for(int i=0;i<numItems;i++)
+        {
+            if(rand() % 2) continue;
+            if(heap.removeFast(&items[i]))
+                keys.erase(find(keys.begin(),keys.end(),items[i].key));
+            items[i].key=rand() % 100;
+            heap.insert(&items[i]);
+            keys.push_back(items[i].key);
+        }
+        sort(keys.begin(),keys.end());
+        assert(heap.front()->key==keys.front());
+        for(int i=0;i<numItems/10 && !heap.empty();i++)
+        {
+            assert(heap.front()->key==keys.front());
+            HeapItem *x=heap.front();
+            heap.pop_front();
+            emptyCheck(*x);
+            keys.erase(keys.begin());
+        }
+    }
+    while(!heap.empty())
+    {
+        assert(heap.front()->key==keys.front());
+        heap.pop_front();
+        keys.erase(keys.begin());
+    }
+    assert(keys.empty());
+    for(auto& x : items) emptyCheck(x);
+}
+
 int main()
 {
     IntrusiveListItem a,b,c;
@@ -405,6 +565,11 @@ int main()
     emptyCheck(list);
     emptyCheck(a);
 
+    //
+    // Testing IntrusivePairingHeap
+    //
+    heapTest();
+
     cout<<"Test passed"<<endl;
     return 0;
 }
@@ -865,4 +865,147 @@ public:
     bool empty() const { return IntrusiveListBase::empty(); }
 };
 
+//Forward declarations
+class IntrusivePairingHeapBase;
+template<typename T>
+class IntrusivePairingHeap;
+
+/**
+ * Base class from which all items to be put in an IntrusivePairingHeap must
+ * derive, contains the pointers that create the heap
+ */
+class IntrusivePairingHeapItem
+{
+private:
+    IntrusivePairingHeapItem *child=nullptr; ///< Leftmost child
+    IntrusivePairingHeapItem *next=nullptr;  ///< Next sibling
+    ///Previous sibling, or parent if this is the leftmost child
+    IntrusivePairingHeapItem *prev=nullptr;
+
+    friend class IntrusivePairingHeapBase;
+    template<typename T>
+    friend class IntrusivePairingHeap;
+};
+
+/**
+ * \internal
+ * Base class of IntrusivePairingHeap with the non-template-dependent part to
+ * improve code size when instantiationg multiple IntrusivePairingHeaps
+ */
+class IntrusivePairingHeapBase
+{
+protected:
+    ///Comparison function, returns true if a has to come before b
+    typedef bool (*Compare)(const IntrusivePairingHeapItem *a,
+                            const IntrusivePairingHeapItem *b);
+
+    IntrusivePairingHeapBase() : root(nullptr) {}
+
+    void insert(IntrusivePairingHeapItem *item, Compare cmp);
+
+    void pop_front(Compare cmp);
+
+    void erase(IntrusivePairingHeapItem *item, Compare cmp);
+
+    IntrusivePairingHeapItem* front() { return root; }
+
+    bool empty() const { return root==nullptr; }
+
+private:
+    /**
+     * Merge two heaps, both a and b must be heap roots
+     * \return the root of the merged heap
+     */
+    static IntrusivePairingHeapItem *meld(IntrusivePairingHeapItem *a,
+            IntrusivePairingHeapItem *b, Compare cmp);
+
+    /**
+     * Merge a list of sibling heaps using the two pass algorithm.
+     * Implemented iteratively as it is called with interrupts disabled, and
+     * recursion depth would be unbounded.
+     * \return the root of the merged heap
+     */
+    static IntrusivePairingHeapItem *combineSiblings(
+            IntrusivePairingHeapItem *first, Compare cmp);
+
+    IntrusivePairingHeapItem *root;
+};
+
+/**
+ * A min-heap that only accepts objects that derive from
+ * IntrusivePairingHeapItem and that can be compared with operator<
+ *
+ * Implemented as a pairing heap, it has O(1) insert() and front(), and
+ * O(log n) amortized pop_front() and removeFast().
+ * As for IntrusiveList, no dynamic memory allocation is performed, and the
+ * caller is responsible for managing the lifetime of objects put in the heap.
+ */
+template<typename T>
+class IntrusivePairingHeap : private IntrusivePairingHeapBase
+{
+public:
+    /**
+     * Constructor, produces an empty heap
+     */
+    IntrusivePairingHeap() {}
+
+    /**
+     * Disabled copy constructor and operator=
+     * Since intrusive heaps do not store objects by value, and an item can
+     * only belong to at most one heap, intrusive heaps are not copyable.
+     */
+    IntrusivePairingHeap(const IntrusivePairingHeap&)=delete;
+    IntrusivePairingHeap& operator=(const IntrusivePairingHeap&)=delete;
+
+    /**
+     * Adds an item to the heap
+     * \param item item to add
+     */
+    void insert(T *item) { IntrusivePairingHeapBase::insert(item,less); }
+
+    /**
+     * Removes the first item of the heap. Heap must not be empty
+     */
+    void pop_front() { IntrusivePairingHeapBase::pop_front(less); }
+
+    /**
+     * Removes an item from the heap
+     * NOTE: can ONLY be called if you are sure the item to remove is either not
+     * in any heap (in this case, nothing is done) or is in the heap it is being
+     * removed from. Trying to remove an item that is present in another heap
+     * produces undefined bahavior.
+     * \param item item to remove, must not be nullptr
+     * \return true if the item was removed, false if the item was not present
+     * in the heap
+     */
+    bool removeFast(T *item)
+    {
+        if(item->prev==nullptr && IntrusivePairingHeapBase::front()!=item)
+            return false;
+        IntrusivePairingHeapBase::erase(item,less);
+        return true;
+    }
+
+    /**
+     * \return a pointer to the first item, that is the item that compares
+     * less than all the others. Heap must not be empty
+     */
+    T* front()
+    {
+        return static_cast<T*>(IntrusivePairingHeapBase::front());
+    }
+
+    /**
+     * \return true if the heap is empty
+     */
+    bool empty() const { return IntrusivePairingHeapBase::empty(); }
+
+private:
+    static bool less(const IntrusivePairingHeapItem *a,
+                     const IntrusivePairingHeapItem *b)
+    {
+        return *static_cast<const T*>(a) < *static_cast<const T*>(b);
+    }
+};
+
 } //namespace miosix
@@ -70,7 +70,7 @@ volatile Thread *runningThread=nullptr;///<\internal Thread currently running
 ///\internal True if there are threads in the DELETED status. Used by idle thread
 static volatile bool existDeleted=false;
 
-IntrusiveList<SleepData> sleepingList;///list of sleeping threads
+IntrusivePairingHeap<SleepData> sleepingHeap;///heap of sleeping threads
 
 ///\internal !=0 after pauseKernel(), ==0 after restartKernel()
 volatile int kernelRunning=0;
@@ -121,9 +121,9 @@ void *idleThread(void *argv)
             bool sleep;
             if(deepSleepCounter==0)
             {
-                if(sleepingList.empty()==false)
+                if(sleepingHeap.empty()==false)
                 {
-                    long long wakeup=sleepingList.front()->wakeupTime;
+                    long long wakeup=sleepingHeap.front()->wakeupTime;
                     sleep=!IRQdeepSleep(wakeup);
                 } else sleep=!IRQdeepSleep();
             } else sleep=true;
@@ -268,20 +268,14 @@ bool isKernelRunning()
 /**
  * \internal
  * Used by Thread::sleep() and pthread_cond_timedwait() to add a thread to
- * sleeping list. The list is sorted by the wakeupTime field to reduce time
- * required to wake threads during context switch.
+ * sleeping heap. The heap is ordered by the wakeupTime field so that the first
+ * thread to wake is always found in constant time, while insertion does not
+ * depend on the number of sleeping threads.
  * Interrupts must be disabled prior to calling this function.
  */
-static void IRQaddToSleepingList(SleepData *x)
+static void IRQaddToSleepingHeap(SleepData *x)
 {
-    if(sleepingList.empty() || sleepingList.front()->wakeupTime>=x->wakeupTime)
-    {
-        sleepingList.push_front(x);
-    } else {
-        auto it=sleepingList.begin();
-        while(it!=sleepingList.end() && (*it)->wakeupTime<x->wakeupTime) ++it;
-        sleepingList.insert(it,x);
-    }
+    sleepingHeap.insert(x);
 }
 
 /**
@@ -293,19 +287,18 @@ static void IRQaddToSleepingList(SleepData *x)
  */
 bool IRQwakeThreads(long long currentTime)
 {
-    if(sleepingList.empty()) return false; //If no item in list, return
-    
     bool result=false;
-    //Since list is sorted, if we don't need to wake the first element
-    //we don't need to wake the other too
-    for(auto it=sleepingList.begin();it!=sleepingList.end();)
+    //Since the heap front is the first thread to wake, if we don't need to
+    //wake it we don't need to wake the others too
+    while(sleepingHeap.empty()==false)
     {
-        if(currentTime<(*it)->wakeupTime) break;
+        SleepData *first=sleepingHeap.front();
+        if(currentTime<first->wakeupTime) break;
         //Wake both threads doing absoluteSleep() and timedWait()
-        (*it)->thread->flags.IRQclearSleepAndWait();
-        if(const_cast<Thread*>(runningThread)->IRQgetPriority()<(*it)->thread->IRQgetPriority())
+        first->thread->flags.IRQclearSleepAndWait();
+        if(const_cast<Thread*>(runningThread)->IRQgetPriority()<first->thread->IRQgetPriority())
             result=true;
-        it=sleepingList.erase(it);
+        sleepingHeap.pop_front();
     }
     return result;
 }
@@ -382,18 +375,18 @@ void Thread::nanoSleepUntil(long long absoluteTimeNs)
     //side effect, very short sleeps done very early at boot will be extended.
     absoluteTimeNs=std::max(absoluteTimeNs,100000LL);
     //pauseKernel() here is not enough since even if the kernel is stopped
-    //the timer isr will wake threads, modifying the sleepingList
+    //the timer isr will wake threads, modifying the sleepingHeap
     {
         FastInterruptDisableLock dLock;
         SleepData d(const_cast<Thread*>(runningThread),absoluteTimeNs);
         d.thread->flags.IRQsetSleep(); //Sleeping thread: set sleep flag
-        IRQaddToSleepingList(&d);
+        IRQaddToSleepingHeap(&d);
         {
             FastInterruptEnableLock eLock(dLock);
             Thread::yield();
         }
         //Only required for interruptibility when terminate is called
-        sleepingList.removeFast(&d);
+        sleepingHeap.removeFast(&d);
     }
 }
 
@@ -509,7 +502,7 @@ void Thread::setPriority(Priority pr)
             while(walk!=nullptr)
             {
                 if(walk->waiting.empty()==false)
-                    pr=std::max(pr,walk->waiting.front()->PKgetPriority());
+                    pr=std::max(pr,walk->waiting.front()->thread->PKgetPriority());
                 walk=walk->next;
             }
         }
@@ -750,7 +743,8 @@ void Thread::setupUserspaceContext(unsigned int entry, int argc, void *argvSp,
 
 Thread::Thread(unsigned int *watermark, unsigned int stacksize,
                bool defaultReent) : schedData(), flags(this), savedPriority(0),
-               mutexLocked(nullptr), mutexWaiting(nullptr), watermark(watermark),
+               mutexLocked(nullptr), mutexWaiting(nullptr), mutexWaitItem(this),
+               watermark(watermark),
                ctxsave(), stacksize(stacksize)
 {
     joinData.waitingForJoin=nullptr;
@@ -835,7 +829,7 @@ void Thread::threadLauncher(void *(*threadfunc)(void*), void *argv)
     #endif //__NO_EXCEPTIONS
     //Thread returned from its entry point, so delete it
 
-    //Since the thread is running, it cannot be in the sleepingList, so no need
+    //Since the thread is running, it cannot be in the sleepingHeap, so no need
     //to remove it from the list
     {
         FastInterruptDisableLock lock;
@@ -879,7 +873,7 @@ TimedWaitResult Thread::IRQenableIrqAndTimedWaitImpl(long long absoluteTimeNs)
     Thread *t=const_cast<Thread*>(runningThread);
     SleepData sleepData(t,absoluteTimeNs);
     t->flags.IRQsetWait(true); //timedWait thread: set wait flag
-    IRQaddToSleepingList(&sleepData);
+    IRQaddToSleepingHeap(&sleepData);
     auto savedNesting=interruptDisableNesting; //For InterruptDisableLock
     interruptDisableNesting=0;
     fastEnableInterrupts();
@@ -887,8 +881,8 @@ TimedWaitResult Thread::IRQenableIrqAndTimedWaitImpl(long long absoluteTimeNs)
     fastDisableInterrupts();
     if(interruptDisableNesting!=0) errorHandler(UNEXPECTED);
     interruptDisableNesting=savedNesting;
-    bool removed=sleepingList.removeFast(&sleepData);
-    //If the thread was still in the sleeping list, it was woken up by a wakeup()
+    bool removed=sleepingHeap.removeFast(&sleepData);
+    //If the thread was still in the sleeping heap, it was woken up by a wakeup()
     return removed ? TimedWaitResult::NoTimeout : TimedWaitResult::Timeout;
 }
 
@@ -410,6 +410,7 @@ enum class TimedWaitResult
 class SleepData;
 class MemoryProfiling;
 class Mutex;
+class Thread;
 class ConditionVariable;
 #ifdef WITH_PROCESSES
 class ProcessBase;
@@ -418,6 +419,22 @@ class FaultData;
 class SyscallParameters;
 #endif //WITH_PROCESSES
 
+/**
+ * \internal
+ * This class is used to make a heap of threads waiting to lock a Mutex. An
+ * instance is embedded in every thread, as a thread can wait on at most one
+ * Mutex at a time.
+ * It is used by the kernel, and should not be used by end users.
+ */
+class MutexWaitItem : public IntrusivePairingHeapItem
+{
+public:
+    MutexWaitItem(Thread *thread) : thread(thread) {}
+
+    ///\internal Thread that is waiting
+    Thread *thread;
+};
+
 /**
  * This class represents a thread. It has methods for creating, deleting and
  * handling threads.<br>It has private constructor and destructor, since memory
@@ -1199,6 +1216,8 @@ private:
     Mutex *mutexLocked;
     ///If the thread is waiting on a Mutex, mutexWaiting points to that Mutex
     Mutex *mutexWaiting;
+    ///Used to put the thread in the waiting heap of the Mutex it waits on
+    MutexWaitItem mutexWaitItem;
     unsigned int *watermark;///< pointer to watermark area
     unsigned int ctxsave[CTXSAVE_SIZE];///< Holds cpu registers during ctxswitch
     unsigned int stacksize;///< Contains stack size
@@ -1255,10 +1274,10 @@ private:
 
 /**
  * \internal
- * This class is used to make a list of sleeping threads.
+ * This class is used to make a heap of sleeping threads.
  * It is used by the kernel, and should not be used by end users.
  */
-class SleepData : public IntrusiveListItem
+class SleepData : public IntrusivePairingHeapItem
 {
 public:
     SleepData(Thread *thread, long long wakeupTime)
@@ -1272,6 +1291,25 @@ public:
     long long wakeupTime;
 };
 
+/**
+ * \internal
+ * Orders the heap of threads waiting on a Mutex so that the thread with the
+ * highest priority comes first
+ */
+inline bool operator<(const MutexWaitItem& a, const MutexWaitItem& b)
+{
+    return b.thread->PKgetPriority().mutexLessOp(a.thread->PKgetPriority());
+}
+
+/**
+ * \internal
+ * Orders the heap of sleeping threads by wakeup time
+ */
+inline bool operator<(const SleepData& a, const SleepData& b)
+{
+    return a.wakeupTime<b.wakeupTime;
+}
+
 /**
  * \}
  */
@@ -43,6 +43,8 @@
 #include "process.h"
 #include "interfaces/cpu_const.h"
 #include "interfaces_private/userspace.h"
+#include "libsyscalls/syscall_ring.h"
+#include "filesystem/pipe/pipe.h"
 
 using namespace std;
 
@@ -67,6 +69,52 @@ namespace miosix {
  */
 static bool aligned(void *x) { return (reinterpret_cast<unsigned>(x) & 0b11)==0; }
 
+/// Maximum number of entries in the array passed to the poll syscall
+static const nfds_t maxPollFds=4096;
+
+/**
+ * Implements the readv and writev syscalls. As other threads of the process
+ * may modify the iovec array concurrently, it is copied in chunks to kernel
+ * memory before validating the buffers
+ * \param mpu mpu object knowing the valid memory regions for the current process
+ * \param fdt file descriptor table of the process
+ * \param isWrite true for writev, false for readv
+ * \param fd file descriptor
+ * \param iov array of buffers in process memory
+ * \param iovcnt number of buffers
+ * \return the number of bytes read or written, or a negative error code
+ */
+static ssize_t vectoredIo(const MPUConfiguration& mpu, FileDescriptorTable& fdt,
+        bool isWrite, int fd, const struct iovec *iov, int iovcnt)
+{
+    const int maxIovcnt=1024; //Same as Linux UIO_MAXIOV
+    if(iovcnt<0 || iovcnt>maxIovcnt) return -EINVAL;
+    if(!mpu.withinForReading(iov,iovcnt*sizeof(struct iovec))
+        || !aligned(const_cast<struct iovec*>(iov))) return -EFAULT;
+    const int chunkSize=8;
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i+=chunkSize)
+    {
+        struct iovec chunk[chunkSize];
+        int n=min(chunkSize,iovcnt-i);
+        size_t expected=0;
+        for(int j=0;j<n;j++)
+        {
+            chunk[j]=iov[i+j];
+            bool valid=isWrite
+                ? mpu.withinForReading(chunk[j].iov_base,chunk[j].iov_len)
+                : mpu.withinForWriting(chunk[j].iov_base,chunk[j].iov_len);
+            if(!valid) return total>0 ? total : -EFAULT;
+            expected+=chunk[j].iov_len;
+        }
+        ssize_t result=isWrite ? fdt.writev(fd,chunk,n) : fdt.readv(fd,chunk,n);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<expected) break;
+    }
+    return total;
+}
+
 /**
  * Validate that a string array parameter, such as the one passed to the execve
  * syscall belongs to the process memory.
@@ -102,7 +150,9 @@ public:
     pid_t pidCounter;
     ///Maps the pid to the Process instance. Includes zombie processes
     map<pid_t,ProcessBase *> processes;
-    ///Uset to guard access to processes and pidCounter
+    ///Time spent loading the last process that was spawned
+    SpawnTimes lastSpawnTimes={};
+    ///Uset to guard access to processes, pidCounter and lastSpawnTimes
     Mutex procMutex;
     ///Used to wait on process termination
     ConditionVariable genericWaiting;
@@ -139,6 +189,7 @@ pid_t Process::create(ElfProgram&& program, ArgsBlock&& args)
         Lock<Mutex> l(p.procMutex);
         proc->pid=getNewPid();
         proc->ppid=parent->pid;
+        p.lastSpawnTimes=proc->image.getLoadTimes();
         parent->childs.push_back(proc.get());
         p.processes[proc->pid]=proc.get();
     }
@@ -179,6 +230,13 @@ pid_t Process::spawn(const char *path, const char* const* argv,
     return Process::spawn(path,argv,envp,narg,nenv);
 }
 
+SpawnTimes getLastSpawnTimes()
+{
+    Processes& p=Processes::instance();
+    Lock<Mutex> l(p.procMutex);
+    return p.lastSpawnTimes;
+}
+
 pid_t Process::getppid(pid_t proc)
 {
     Processes& p=Processes::instance();
@@ -412,6 +470,62 @@ Process::SvcResult Process::handleSvc(SyscallParameters sp)
                 break;
             }
 
+            case Syscall::READV:
+            case Syscall::WRITEV:
+            {
+                bool isWrite=static_cast<Syscall>(sp.getSyscallId())==Syscall::WRITEV;
+                auto iov=reinterpret_cast<const struct iovec*>(sp.getParameter(1));
+                ssize_t result=vectoredIo(mpu,fileTable,isWrite,
+                    sp.getParameter(0),iov,sp.getParameter(2));
+                sp.setParameter(0,result);
+                break;
+            }
+
+            case Syscall::POLL:
+            {
+                auto fds=reinterpret_cast<struct pollfd*>(sp.getParameter(0));
+                nfds_t nfds=sp.getParameter(1);
+                //Bounding nfds also prevents overflow in the size computation
+                if(nfds>maxPollFds) sp.setParameter(0,-EINVAL);
+                else if(nfds>0 && (!aligned(fds) ||
+                   !mpu.withinForWriting(fds,nfds*sizeof(struct pollfd))))
+                    sp.setParameter(0,-EFAULT);
+                else sp.setParameter(0,fileTable.poll(fds,nfds,sp.getParameter(2)));
+                break;
+            }
+
+            case Syscall::PREAD:
+            {
+                int fd=sp.getParameter(0);
+                void *ptr=reinterpret_cast<void*>(sp.getParameter(1));
+                size_t size=sp.getParameter(2);
+                //The 64 bit offset does not fit in the syscall parameters, so
+                //a pointer to it is passed instead
+                auto pos=reinterpret_cast<off_t*>(sp.getParameter(3));
+                if(mpu.withinForWriting(ptr,size) &&
+                   mpu.withinForReading(pos,sizeof(off_t)) && aligned(pos))
+                {
+                    ssize_t result=fileTable.pread(fd,ptr,size,*pos);
+                    sp.setParameter(0,result);
+                } else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::PWRITE:
+            {
+                int fd=sp.getParameter(0);
+                void *ptr=reinterpret_cast<void*>(sp.getParameter(1));
+                size_t size=sp.getParameter(2);
+                auto pos=reinterpret_cast<off_t*>(sp.getParameter(3));
+                if(mpu.withinForReading(ptr,size) &&
+                   mpu.withinForReading(pos,sizeof(off_t)) && aligned(pos))
+                {
+                    ssize_t result=fileTable.pwrite(fd,ptr,size,*pos);
+                    sp.setParameter(0,result);
+                } else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
             case Syscall::STAT:
             {
                 auto file=reinterpret_cast<const char*>(sp.getParameter(0));
@@ -463,6 +577,7 @@ Process::SvcResult Process::handleSvc(SyscallParameters sp)
                     case F_DUPFD: //Third parameter is int, no validation needed
                     case F_SETFD:
                     case F_SETFL:
+                    case F_SETPIPE_SZ:
                         result=fileTable.fcntl(sp.getParameter(0),cmd,
                                                sp.getParameter(2));
                         break;
@@ -614,6 +729,33 @@ Process::SvcResult Process::handleSvc(SyscallParameters sp)
                 break;
             }
 
+            case Syscall::FALLOCATE:
+            {
+                //The two 64 bit parameters do not fit in the syscall
+                //parameters, so a pointer to them is passed instead
+                auto range=reinterpret_cast<off_t*>(sp.getParameter(2));
+                if(mpu.withinForReading(range,2*sizeof(off_t)) && aligned(range))
+                {
+                    int result=fileTable.fallocate(sp.getParameter(0),
+                        sp.getParameter(1),range[0],range[1]);
+                    sp.setParameter(0,result);
+                } else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
+            case Syscall::STATFS:
+            {
+                auto path=reinterpret_cast<const char*>(sp.getParameter(0));
+                auto buf=reinterpret_cast<struct statfs*>(sp.getParameter(1));
+                if(mpu.withinForReading(path) &&
+                   mpu.withinForWriting(buf,sizeof(struct statfs)) && aligned(buf))
+                {
+                    int result=fileTable.statfs(path,buf);
+                    sp.setParameter(0,result);
+                } else sp.setParameter(0,-EFAULT);
+                break;
+            }
+
             case Syscall::RENAME:
             {
                 auto oldp=reinterpret_cast<const char*>(sp.getParameter(0));
@@ -769,6 +911,11 @@ Process::SvcResult Process::handleSvc(SyscallParameters sp)
                                 //segfault here
                                 return Segfault;
                             }
+                            {
+                                Processes& p=Processes::instance();
+                                Lock<Mutex> l(p.procMutex);
+                                p.lastSpawnTimes=image.getLoadTimes();
+                            }
                             return Execve;
                         } else sp.setParameter(0,program.errorCode());
                     } else sp.setParameter(0,-E2BIG);
@@ -888,6 +1035,13 @@ Process::SvcResult Process::handleSvc(SyscallParameters sp)
                 break;
             }
 
+            case Syscall::BATCH:
+            {
+                auto ring=reinterpret_cast<SyscallRingHeader*>(sp.getParameter(0));
+                sp.setParameter(0,handleSyscallRing(ring));
+                break;
+            }
+
             default:
                 exitCode=SIGSYS; //Bad syscall
                 #ifdef WITH_ERRLOG
@@ -901,6 +1055,72 @@ Process::SvcResult Process::handleSvc(SyscallParameters sp)
     return Resume;
 }
 
+int Process::handleSyscallRing(SyscallRingHeader *ring)
+{
+    if(!mpu.withinForWriting(ring,sizeof(SyscallRingHeader)) || !aligned(ring))
+        return -EFAULT;
+    //Fields are copied before validating them, as other threads of the process
+    //may modify them concurrently
+    SyscallRingEntry *entries=ring->entries;
+    unsigned int size=ring->size;
+    unsigned int head=ring->head;
+    unsigned int tail=ring->tail;
+    if(size==0 || size>maxSyscallRingSize || (size & (size-1))
+        || tail-head>size) return -EINVAL;
+    if(!mpu.withinForWriting(entries,size*sizeof(SyscallRingEntry))
+        || !aligned(entries)) return -EFAULT;
+    int completed=0;
+    for(;head!=tail;head++,completed++)
+    {
+        SyscallRingEntry *e=&entries[head & (size-1)];
+        unsigned short op=e->op;
+        int fd=e->fd;
+        void *ptr=e->ptr;
+        unsigned int len=e->size;
+        long long result;
+        try {
+            switch(op)
+            {
+                case RING_NOP:
+                    result=0;
+                    break;
+                case RING_READ:
+                    if(mpu.withinForWriting(ptr,len))
+                        result=fileTable.read(fd,ptr,len);
+                    else result=-EFAULT;
+                    break;
+                case RING_WRITE:
+                    if(mpu.withinForReading(ptr,len))
+                        result=fileTable.write(fd,ptr,len);
+                    else result=-EFAULT;
+                    break;
+                case RING_LSEEK:
+                    result=fileTable.lseek(fd,e->offset,len);
+                    break;
+                case RING_FSTAT:
+                {
+                    auto pstat=reinterpret_cast<struct stat*>(ptr);
+                    if(mpu.withinForWriting(pstat,sizeof(struct stat)) && aligned(pstat))
+                        result=fileTable.fstat(fd,pstat);
+                    else result=-EFAULT;
+                    break;
+                }
+                case RING_GETTIME:
+                    result=getTime();
+                    break;
+                default:
+                    result=-ENOSYS;
+                    break;
+            }
+        } catch(exception&) {
+            result=-ENOMEM;
+        }
+        e->result=result;
+        ring->head=head+1;
+    }
+    return completed;
+}
+
 pid_t Process::getNewPid()
 {
     auto& p=Processes::instance();
@@ -46,6 +46,7 @@ namespace miosix {
 //Forware decl
 class Process;
 class ArgsBlock;
+struct SyscallRingHeader;
 
 /**
  * This class contains the fields that are in common between the kernel and
@@ -209,6 +210,13 @@ private:
      * terminated
      */
     SvcResult handleSvc(SyscallParameters sp);
+
+    /**
+     * Execute the operations queued in a syscall ring
+     * \param ring pointer to the ring control block in process memory
+     * \return the number of completed operations, or a negative error code
+     */
+    int handleSyscallRing(SyscallRingHeader *ring);
     
     /**
      * \return an unique pid that is not zero and is not already in use in the
@@ -369,7 +377,10 @@ enum class Syscall
     DUP2      = 31,
     PIPE      = 32,
     ACCESS    = 33,
-    //From 34 to 37 reserved for future use
+    READV     = 34,
+    WRITEV    = 35,
+    PREAD     = 36,
+    PWRITE    = 37,
 
     // Time syscalls
     GETTIME   = 38,
@@ -399,7 +410,11 @@ enum class Syscall
     MKFS      = 58, //Moving filesystem creation code to kernel
 
     // Misc syscalls
-    SYSCONF   = 59
+    SYSCONF   = 59,
+    BATCH     = 60, //Execute the operations in a SyscallRing
+    POLL      = 61,
+    FALLOCATE = 62,
+    STATFS    = 63
 };
 
 } //namespace miosix
@@ -29,8 +29,14 @@
 #include <stdexcept>
 #include <cstring>
 #include <algorithm>
+#include <limits>
 #ifndef TEST_ALLOC
 #include "interfaces_private/userspace.h"
+#else //TEST_ALLOC
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <sys/mman.h>
 #endif //TEST_ALLOC
 
 using namespace std;
@@ -39,12 +45,6 @@ using namespace std;
 
 namespace miosix {
 
-///This constant specifies the size of the minimum allocatable block,
-///in bits. So for example 10 is 1KB.
-static const unsigned int blockBits=10;
-///This constant is the the size of the minimum allocatable block, in bytes.
-static const unsigned int blockSize=1<<blockBits;
-
 ProcessPool& ProcessPool::instance()
 {
     #ifndef TEST_ALLOC
@@ -61,41 +61,64 @@ ProcessPool& ProcessPool::instance()
     #endif //TEST_ALLOC
 }
     
-pair<unsigned int *, unsigned int> ProcessPool::allocate(unsigned int size)
+pair<unsigned int *, unsigned int> ProcessPool::allocate(unsigned int size,
+                                                        bool zero)
 {
-    #ifndef TEST_ALLOC
-    miosix::Lock<miosix::FastMutex> l(mutex);
-    size=MPUConfiguration::roundSizeForMPU(max(size,blockSize));
-    #else //TEST_ALLOC
-    //Size adjustment not supported during test_alloc due to missing mpu header
-    if((size & (size - 1)) || size<blockSize)
-            throw runtime_error("ProcessPool::allocate unsupported size");
-    #endif //TEST_ALLOC
-    if(size>poolSize) throw bad_alloc();
-    
-    unsigned int offset=0;
-    if(reinterpret_cast<unsigned int>(poolBase) % size)
-        offset=size-(reinterpret_cast<unsigned int>(poolBase) % size);
-    unsigned int startBit=offset/blockSize;
-    unsigned int sizeBit=size/blockSize;
+    FreeBlock *block;
+    {
+        #ifndef TEST_ALLOC
+        miosix::Lock<miosix::FastMutex> l(mutex);
+        size=MPUConfiguration::roundSizeForMPU(max(size,blockSize));
+        #else //TEST_ALLOC
+        //Size adjustment not supported during test_alloc due to missing mpu header
+        if((size & (size - 1)) || size<blockSize)
+                throw runtime_error("ProcessPool::allocate unsupported size");
+        #endif //TEST_ALLOC
+        if(size>poolSize) throw bad_alloc();
 
-    for(unsigned int i=startBit;i<=poolSize/blockSize;i+=sizeBit)
+        //Find the smallest free block that is large enough
+        int order=__builtin_ctz(size)-blockBits;
+        unsigned int candidates=freeMask & (~0u<<order);
+        if(candidates==0) throw bad_alloc();
+        int i=__builtin_ctz(candidates);
+        block=freeLists[i];
+        removeFree(block,i);
+        //Split it, putting the upper halves in the free lists
+        while(i>order)
+        {
+            i--;
+            auto buddy=reinterpret_cast<FreeBlock*>(
+                reinterpret_cast<char*>(block)+(blockSize<<i));
+            addFree(buddy,i);
+        }
+        unsigned int first=blockIndex(block);
+        blockInfo[first]|=allocatedFlag | order;
+        bool clean=true;
+        for(unsigned int j=first;j<first+(size>>blockBits);j++)
+        {
+            if(blockInfo[j] & cleanFlag) continue;
+            clean=false;
+            dirtyFree--;
+        }
+        if(zero)
+        {
+            if(clean) zeroingStats.cleanHits++;
+            else zeroingStats.syncZeroed++;
+        }
+    }
+    //Zeroing is done with the mutex unlocked. The cleanFlag of the block being
+    //allocated is not modified by others, and is cleared when deallocating
+    if(zero)
     {
-        bool notEmpty=false;
-        for(unsigned int j=0;j<sizeBit;j++)
+        unsigned int first=blockIndex(block);
+        char *p=reinterpret_cast<char*>(block);
+        for(unsigned int j=first;j<first+(size>>blockBits);j++,p+=blockSize)
         {
-            if(testBit(i+j)==0) continue;
-            notEmpty=true;
-            break;
+            if(blockInfo[j] & cleanFlag) memset(p,0,sizeof(FreeBlock));
+            else memset(p,0,blockSize);
         }
-        if(notEmpty) continue;
-        
-        for(unsigned int j=0;j<sizeBit;j++) setBit(i+j);
-        unsigned int *result=poolBase+i*blockSize/sizeof(unsigned int);
-        allocatedBlocks[result]=size;
-        return make_pair(result,size);
     }
-    throw bad_alloc();
+    return make_pair(reinterpret_cast<unsigned int*>(block),size);
 }
 
 void ProcessPool::deallocate(unsigned int *ptr)
@@ -103,41 +126,280 @@ void ProcessPool::deallocate(unsigned int *ptr)
     #ifndef TEST_ALLOC
     miosix::Lock<miosix::FastMutex> l(mutex);
     #endif //TEST_ALLOC
-    map<unsigned int*, unsigned int>::iterator it= allocatedBlocks.find(ptr);
-    if(it==allocatedBlocks.end())
+    unsigned int offset=reinterpret_cast<unsigned int>(ptr)-
+                        reinterpret_cast<unsigned int>(poolBase);
+    if(offset>=poolSize || (offset & (blockSize-1))
+        || (blockInfo[offset>>blockBits] & allocatedFlag)==0)
     #ifndef TEST_ALLOC
         errorHandler(UNEXPECTED);
     #else //TEST_ALLOC
         throw runtime_error("ProcessPool::deallocate corrupted pointer");
     #endif //TEST_ALLOC
-    unsigned int size =(it->second)/blockSize;
-    unsigned int firstBit=(reinterpret_cast<unsigned int>(ptr)-
-                           reinterpret_cast<unsigned int>(poolBase))/blockSize;
-    for(unsigned int i=firstBit;i<firstBit+size;i++) clearBit(i);
-    allocatedBlocks.erase(it);
+    int order=blockInfo[offset>>blockBits] & orderMask;
+    //The freed memory is dirty, and will be zeroed in background
+    unsigned int numUnits=1<<order;
+    memset(blockInfo+(offset>>blockBits),0,numUnits);
+    dirtyFree+=numUnits;
+    zeroCursor=min(zeroCursor,offset>>blockBits);
+    #ifndef TEST_ALLOC
+    dirtyCv.signal();
+    #endif //TEST_ALLOC
+    //Merge with the buddy as long as it is free. Buddies are computed on the
+    //absolute address, as blocks are aligned to their size in memory, and not
+    //just within the pool. Blocks only exist within the pool, so a buddy that
+    //is outside the pool is never found free
+    unsigned int addr=reinterpret_cast<unsigned int>(ptr);
+    for(;order<numOrders-1;order++)
+    {
+        unsigned int buddy=addr ^ (blockSize<<order);
+        unsigned int buddyOffset=buddy-reinterpret_cast<unsigned int>(poolBase);
+        if(buddyOffset>=poolSize) break;
+        if((blockInfo[buddyOffset>>blockBits] & ~cleanFlag)!=(freeFlag | order))
+            break;
+        removeFree(reinterpret_cast<FreeBlock*>(buddy),order);
+        addr=min(addr,buddy);
+    }
+    addFree(reinterpret_cast<FreeBlock*>(addr),order);
+}
+
+ProcessPoolZeroingStats ProcessPool::getZeroingStats()
+{
+    #ifndef TEST_ALLOC
+    miosix::Lock<miosix::FastMutex> l(mutex);
+    #endif //TEST_ALLOC
+    return zeroingStats;
+}
+
+bool ProcessPool::zeroFreeBlock()
+{
+    #ifndef TEST_ALLOC
+    miosix::Lock<miosix::FastMutex> l(mutex);
+    #endif //TEST_ALLOC
+    if(dirtyFree==0) return false;
+    //Zero one unit at a time with the mutex locked, so that allocations are
+    //delayed by at most the time to zero blockSize bytes. The first bytes of
+    //each unit are left alone, as they may be part of a free list.
+    //The scan resumes from the cursor, so a pass over the pool takes linear
+    //time. Blocks are aligned to their size in memory, so the block containing
+    //the cursor is the first aligned one that has a block starting there
+    const unsigned int numUnits=poolSize>>blockBits;
+    const unsigned int base=reinterpret_cast<unsigned int>(poolBase);
+    const unsigned int cursorAddr=base+(zeroCursor<<blockBits);
+    unsigned int start=zeroCursor;
+    for(int order=1;start<numUnits
+        && (blockInfo[start] & (freeFlag | allocatedFlag))==0;order++)
+        start=((cursorAddr & ~((blockSize<<order)-1))-base)>>blockBits;
+    for(unsigned int j=zeroCursor;start<numUnits;start=j)
+    {
+        unsigned int end=start+(1u<<(blockInfo[start] & orderMask));
+        if((blockInfo[start] & freeFlag)==0)
+        {
+            j=end;
+            continue;
+        }
+        for(;j<end;j++)
+        {
+            if(blockInfo[j] & cleanFlag) continue;
+            char *p=reinterpret_cast<char*>(poolBase)+j*blockSize;
+            memset(p+sizeof(FreeBlock),0,blockSize-sizeof(FreeBlock));
+            blockInfo[j]|=cleanFlag;
+            dirtyFree--;
+            zeroingStats.bgZeroed++;
+            zeroCursor=j+1;
+            return true;
+        }
+    }
+    #ifndef TEST_ALLOC
+    errorHandler(UNEXPECTED); //dirtyFree is wrong
+    #else //TEST_ALLOC
+    throw runtime_error("ProcessPool::zeroFreeBlock dirtyFree mismatch");
+    #endif //TEST_ALLOC
+    return false;
 }
 
 ProcessPool::ProcessPool(unsigned int *poolBase, unsigned int poolSize)
-    : poolBase(poolBase), poolSize(poolSize)
+    : freeMask(0), dirtyFree(0), zeroCursor(0), zeroingStats{0,0,0},
+      poolBase(poolBase), poolSize(poolSize)
 {
-    int numBytes=poolSize/blockSize/8;
-    bitmap=new unsigned int[numBytes/sizeof(unsigned int)];
-    memset(bitmap,0,numBytes);
+    for(int i=0;i<numOrders;i++) freeLists[i]=nullptr;
+    //Blocks are aligned to their size in memory, so the unaligned start of
+    //the pool, if any, is not used
+    unsigned int start=reinterpret_cast<unsigned int>(poolBase);
+    unsigned int skip=min((blockSize-(start & (blockSize-1))) & (blockSize-1),
+                          poolSize);
+    this->poolBase=reinterpret_cast<unsigned int*>(start+skip);
+    this->poolSize=(poolSize-skip) & ~(blockSize-1);
+    blockInfo=new unsigned char[this->poolSize/blockSize];
+    memset(blockInfo,0,this->poolSize/blockSize);
+    //Split the pool in the largest blocks that are aligned to their size
+    unsigned int addr=reinterpret_cast<unsigned int>(this->poolBase);
+    unsigned int end=addr+this->poolSize;
+    while(end-addr>=blockSize)
+    {
+        int order=numOrders-1;
+        if(addr) order=min(order,__builtin_ctz(addr)-static_cast<int>(blockBits));
+        while((blockSize<<order)>end-addr) order--;
+        addFree(reinterpret_cast<FreeBlock*>(addr),order);
+        addr+=blockSize<<order;
+        dirtyFree+=1<<order;
+    }
+    #ifndef TEST_ALLOC
+    #ifndef SCHED_TYPE_EDF
+    Thread::create(zeroingThread,2*STACK_MIN,0,this);
+    #else //SCHED_TYPE_EDF
+    //With EDF the latest deadline before the idle thread's one makes the
+    //zeroing thread run only when no other thread is ready
+    Thread::create(zeroingThread,2*STACK_MIN,
+        numeric_limits<long long>::max()-2,this);
+    #endif //SCHED_TYPE_EDF
+    #endif //TEST_ALLOC
 }
 
 ProcessPool::~ProcessPool()
 {
-    delete[] bitmap;
+    delete[] blockInfo;
+}
+
+#ifndef TEST_ALLOC
+void ProcessPool::zeroingThread(void *argv)
+{
+    ProcessPool *pool=reinterpret_cast<ProcessPool*>(argv);
+    for(;;)
+    {
+        {
+            miosix::Lock<miosix::FastMutex> l(pool->mutex);
+            while(pool->dirtyFree==0) pool->dirtyCv.wait(l);
+        }
+        pool->zeroFreeBlock();
+    }
+}
+#endif //TEST_ALLOC
+
+void ProcessPool::addFree(FreeBlock *block, int order)
+{
+    block->prev=nullptr;
+    block->next=freeLists[order];
+    if(block->next) block->next->prev=block;
+    freeLists[order]=block;
+    freeMask|=1<<order;
+    unsigned int i=blockIndex(block);
+    blockInfo[i]=(blockInfo[i] & cleanFlag) | freeFlag | order;
+}
+
+void ProcessPool::removeFree(FreeBlock *block, int order)
+{
+    if(block->next) block->next->prev=block->prev;
+    if(block->prev) block->prev->next=block->next;
+    else {
+        freeLists[order]=block->next;
+        if(block->next==nullptr) freeMask&=~(1<<order);
+    }
+    blockInfo[blockIndex(block)]&=cleanFlag;
 }
 
 } //namespace miosix
 
 #ifdef TEST_ALLOC
+
+/**
+ * Randomized test, allocates and deallocates blocks checking for overlaps,
+ * alignment and zeroing, and measures the time taken by the allocator
+ */
+void stressTest(miosix::ProcessPool& pool, int iterations)
+{
+    using namespace miosix;
+    struct Alloc { unsigned int *p; unsigned int size; unsigned int fill; };
+    vector<Alloc> allocs;
+    long long allocTime=0, deallocTime=0;
+    int allocCount=0, deallocCount=0, failCount=0;
+    srand(0);
+    auto fill=[](Alloc& a){ for(unsigned int i=0;i<a.size/4;i++) a.p[i]=a.fill; };
+    auto check=[](Alloc& a){
+        for(unsigned int i=0;i<a.size/4;i++)
+            if(a.p[i]!=a.fill) throw runtime_error("stressTest overlap");
+    };
+    for(int i=0;i<iterations;i++)
+    {
+        if(allocs.empty() || rand()%2)
+        {
+            unsigned int size=1<<(10+rand()%6);
+            try {
+                auto t1=chrono::steady_clock::now();
+                bool zero=rand()%2;
+                auto result=pool.allocate(size,zero);
+                auto t2=chrono::steady_clock::now();
+                allocTime+=chrono::duration_cast<chrono::nanoseconds>(t2-t1).count();
+                allocCount++;
+                Alloc a={result.first,result.second,static_cast<unsigned int>(rand())};
+                if(a.size!=size || reinterpret_cast<unsigned int>(a.p) % size)
+                    throw runtime_error("stressTest bad block");
+                if(zero)
+                    for(unsigned int k=0;k<a.size/4;k++)
+                        if(a.p[k]!=0) throw runtime_error("stressTest not zeroed");
+                fill(a);
+                allocs.push_back(a);
+            } catch(bad_alloc&) {
+                failCount++;
+            }
+        } else {
+            int j=rand()%allocs.size();
+            check(allocs[j]);
+            auto t1=chrono::steady_clock::now();
+            pool.deallocate(allocs[j].p);
+            auto t2=chrono::steady_clock::now();
+            deallocTime+=chrono::duration_cast<chrono::nanoseconds>(t2-t1).count();
+            deallocCount++;
+            allocs[j]=allocs.back();
+            allocs.pop_back();
+        }
+        //Simulate the background zeroing thread
+        if(rand()%4==0) pool.zeroFreeBlock();
+    }
+    for(auto& a : allocs)
+    {
+        check(a);
+        pool.deallocate(a.p);
+    }
+    //All memory is free again, so it must be fully merged, and the largest
+    //block must be available
+    auto result=pool.allocate(64*1024);
+    pool.deallocate(result.first);
+    //After background zeroing completes, zeroed allocations are clean hits
+    while(pool.zeroFreeBlock()) ;
+    auto before=pool.getZeroingStats();
+    result=pool.allocate(64*1024,true);
+    for(unsigned int k=0;k<result.second/4;k++)
+        if(result.first[k]!=0) throw runtime_error("stressTest not zeroed");
+    pool.deallocate(result.first);
+    auto after=pool.getZeroingStats();
+    if(after.cleanHits!=before.cleanHits+1)
+        throw runtime_error("stressTest expected clean hit");
+    cout<<"Stress test passed: "<<allocCount<<" allocations ("<<failCount
+        <<" failed), "<<deallocCount<<" deallocations"<<endl
+        <<"Average allocate time "<<allocTime/max(allocCount,1)
+        <<"ns, deallocate time "<<deallocTime/max(deallocCount,1)<<"ns"<<endl
+        <<"Zeroed allocations: "<<after.cleanHits<<" clean, "
+        <<after.syncZeroed<<" zeroed synchronously"<<endl;
+}
+
 //g++ -m32 -o pp -DTEST_ALLOC -DWITH_PROCESSES process_pool.cpp && ./pp
-int main()
+//Run with ./pp stress for the randomized test and benchmark
+int main(int argc, char *argv[])
 {
     using namespace miosix;
+    //The free lists are stored in the pool, so it has to be backed by memory
+    if(mmap(reinterpret_cast<void*>(0x20008000),96*1024,PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED,-1,0)==MAP_FAILED)
+    {
+        cout<<"mmap failed"<<endl;
+        return 1;
+    }
     ProcessPool& pool=ProcessPool::instance();
+    if(argc>1 && string(argv[1])=="stress")
+    {
+        stressTest(pool,1000000);
+        return 0;
+    }
     while(1)
     {
         cout<<"a<size(exponent)>|d<addr>"<<endl;
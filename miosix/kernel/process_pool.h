@@ -27,7 +27,6 @@
 
 #pragma once
 
-#include <map>
 #include <utility>
 
 #ifndef TEST_ALLOC
@@ -42,9 +41,29 @@
 
 namespace miosix {
 
+/**
+ * Counters of how process pool blocks requested zeroed were zeroed
+ */
+struct ProcessPoolZeroingStats
+{
+    unsigned int cleanHits;  ///< Allocations already zeroed in background
+    unsigned int syncZeroed; ///< Allocations that had to be zeroed on the spot
+    unsigned int bgZeroed;   ///< blockSize units zeroed in background
+};
+
 /**
  * This class allows to handle a memory area reserved for the allocation of
  * processes' images. This memory area is called process pool.
+ *
+ * The allocator is a binary buddy allocator, so that allocated blocks are
+ * power of two sized and aligned to their size, as required by the memory
+ * protection unit. Free blocks are kept in per-size free lists stored inside
+ * the free blocks themselves, so allocating and deallocating take O(log n)
+ * time and do not allocate memory from the kernel heap.
+ *
+ * As process images need to be zeroed before use, a low priority thread zeroes
+ * free blocks in the background, so that allocations landing on already
+ * zeroed blocks do not have to.
  */
 class ProcessPool
 {
@@ -58,6 +77,7 @@ public:
      * Allocate memory inside the process pool.
      * \param size size in bytes (despite the returned pointer is an
      * unsigned int*) of the requested memory
+     * \param zero if true, the returned memory is zeroed
      * \return a pair with the pointer to the allocated memory and the actual
      * allocated size, which could be greater or equal than the requested size
      * to accomodate limitations in the allocator and memory protection unit.
@@ -66,7 +86,8 @@ public:
      * the returned pointer is aligned on a 16KB boundary.
      * \throws bad_alloc if out of memory
      */
-    std::pair<unsigned int *, unsigned int> allocate(unsigned int size);
+    std::pair<unsigned int *, unsigned int> allocate(unsigned int size,
+                                                     bool zero=false);
     
     /**
      * Deallocate a memory block.
@@ -74,6 +95,18 @@ public:
      * \throws runtime_error if the pointer is invalid
      */
     void deallocate(unsigned int *ptr);
+
+    /**
+     * \return counters of how allocations requested zeroed were zeroed
+     */
+    ProcessPoolZeroingStats getZeroingStats();
+
+    /**
+     * Zero one blockSize unit of a free block that was not yet zeroed.
+     * Called by the background zeroing thread, exposed for testing.
+     * \return false if there was nothing to zero
+     */
+    bool zeroFreeBlock();
     
     #ifdef TEST_ALLOC
     /**
@@ -82,28 +115,22 @@ public:
     void printAllocatedBlocks()
     {
         using namespace std;
-        map<unsigned int*, unsigned int>::iterator it;
         cout<<endl;
-        for(it=allocatedBlocks.begin();it!=allocatedBlocks.end();it++)
-            cout <<"block of size " << it->second
-                 << " allocated @ " << it->first<<endl;
-        
-        cout<<"Bitmap:"<<endl;
-        const int SHIFT = 8 * sizeof(unsigned int);
-        const unsigned int MASK = 1 << (SHIFT-1);
-        int bitarray[32];
-        for(int i=0; i<(poolSize/blockSize)/(sizeof(unsigned int)*8);i++)
-        {   
-            int value=bitmap[i];
-            for ( int j = 0; j < SHIFT; j++ ) 
-            {
-                bitarray[31-j]= ( value & MASK ? 1 : 0 );
-                value <<= 1;
-            }
-            for(int j=0;j<32;j++)
-                cout<<bitarray[j];
-            cout << endl;
-        }  
+        for(unsigned int i=0;i<poolSize/blockSize;i++)
+        {
+            if((blockInfo[i] & ~cleanFlag)==0) continue;
+            cout<<(blockInfo[i] & freeFlag ? "free" : "allocated")
+                <<" block of size "<<(blockSize<<(blockInfo[i] & orderMask))
+                <<" @ "<<poolBase+i*blockSize/sizeof(unsigned int)<<endl;
+        }
+        cout<<"Free lists:"<<endl;
+        for(int i=0;i<numOrders;i++)
+        {
+            if(freeLists[i]==nullptr) continue;
+            cout<<(blockSize<<i)<<":";
+            for(FreeBlock *b=freeLists[i];b;b=b->next) cout<<" "<<b;
+            cout<<endl;
+        }
     }
     #endif //TEST_ALLOC
     
@@ -113,8 +140,10 @@ private:
     
     /**
      * Constructor.
-     * \param poolBase address of the start of the process pool.
-     * \param poolSize size of the process pool. Must be a multiple of blockSize
+     * \param poolBase address of the start of the process pool. If it is not
+     * aligned to blockSize, the pool starts at the next aligned address
+     * \param poolSize size of the process pool. If it is not a multiple of
+     * blockSize, the remainder is not used
      */
     ProcessPool(unsigned int *poolBase, unsigned int poolSize);
     
@@ -122,42 +151,82 @@ private:
      * Destructor
      */
     ~ProcessPool();
-    
+
+    #ifndef TEST_ALLOC
     /**
-     * \param bit bit to test, from 0 to poolSize/blockSize
-     * \return true if the bit is set
+     * Entry point of the background zeroing thread
+     * \param argv the ProcessPool
      */
-    bool testBit(unsigned int bit)
-    {
-        return (bitmap[bit/(sizeof(unsigned int)*8)] &
-            1<<(bit % (sizeof(unsigned int)*8))) ? true : false;
-    }
-    
+    static void zeroingThread(void *argv);
+    #endif //TEST_ALLOC
+
     /**
-     * \param bit bit to set, from 0 to poolSize/blockSize
+     * A free block. The free lists are stored inside the free blocks
      */
-    void setBit(unsigned int bit)
+    struct FreeBlock
     {
-        bitmap[(bit/(sizeof(unsigned int)*8))] |= 
-            1<<(bit % (sizeof(unsigned int)*8));
-    }
-    
+        FreeBlock *next;
+        FreeBlock *prev;
+    };
+
     /**
-     * \param bit bit to clear, from 0 to poolSize/blockSize
+     * Add a block to a free list
+     * \param block block to add
+     * \param order block order, the block size is blockSize<<order
      */
-    void clearBit(unsigned int bit)
+    void addFree(FreeBlock *block, int order);
+
+    /**
+     * Remove a block from a free list
+     * \param block block to remove
+     * \param order block order, the block size is blockSize<<order
+     */
+    void removeFree(FreeBlock *block, int order);
+
+    /**
+     * \param ptr pointer within the pool
+     * \return index of the minimum size block at ptr
+     */
+    unsigned int blockIndex(const void *ptr) const
     {
-        bitmap[bit/(sizeof(unsigned int)*8)] &= 
-            ~(1<<(bit % (sizeof(unsigned int)*8)));
+        return (reinterpret_cast<unsigned int>(ptr)-
+                reinterpret_cast<unsigned int>(poolBase))>>blockBits;
     }
-    
-    unsigned int *bitmap;   ///< Pointer to the status of the allocator
+
+    ///Size of the minimum allocatable block, in bits. So for example 10 is 1KB
+    static const unsigned int blockBits=10;
+    ///Size of the minimum allocatable block, in bytes
+    static const unsigned int blockSize=1<<blockBits;
+    ///Number of block sizes, from blockSize to 2GB
+    static const int numOrders=32-blockBits;
+    ///blockInfo flag for free blocks
+    static const unsigned char freeFlag=0x80;
+    ///blockInfo flag for allocated blocks
+    static const unsigned char allocatedFlag=0x40;
+    ///blockInfo flag, set if the memory is zero, except for the first
+    ///sizeof(FreeBlock) bytes that may contain a free list entry. Valid for
+    ///every blockSize unit, not only where a block starts
+    static const unsigned char cleanFlag=0x20;
+    ///blockInfo mask to get the block order
+    static const unsigned char orderMask=0x1f;
+
+    ///Free lists, freeLists[i] contains free blocks of size blockSize<<i
+    FreeBlock *freeLists[numOrders];
+    unsigned int freeMask;  ///< Bit i set if freeLists[i] is not empty
+    ///One entry per minimum size block, zero if no block starts there,
+    ///otherwise the order of the block starting there and its state
+    unsigned char *blockInfo;
+    ///Number of blockSize units in free blocks without cleanFlag
+    unsigned int dirtyFree;
+    ///Index of the unit where zeroFreeBlock() resumes, no unit before it
+    ///is both free and without cleanFlag
+    unsigned int zeroCursor;
+    ProcessPoolZeroingStats zeroingStats; ///< Zeroing counters
     unsigned int *poolBase; ///< Base address of the entire pool
     unsigned int poolSize;  ///< Size of the pool, in bytes
-    ///Lists all allocated blocks, allows to retrieve their sizes
-    std::map<unsigned int*,unsigned int> allocatedBlocks;
     #ifndef TEST_ALLOC
     miosix::FastMutex mutex; ///< Mutex to guard concurrent access
+    miosix::ConditionVariable dirtyCv; ///< Signaled when dirtyFree grows
     #endif //TEST_ALLOC
 };
 
@@ -244,6 +244,8 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
 
 int pthread_mutex_lock(pthread_mutex_t *mutex)
 {
+    //Uncontended case, no need to disable interrupts
+    if(fastMutexTryLock(mutex)) return 0;
     FastInterruptDisableLock dLock;
     IRQdoMutexLock(mutex,dLock);
     return 0;
@@ -251,41 +253,12 @@ int pthread_mutex_lock(pthread_mutex_t *mutex)
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex)
 {
-    FastInterruptDisableLock dLock;
-    void *p=reinterpret_cast<void*>(Thread::IRQgetCurrentThread());
-    if(mutex->owner==0)
-    {
-        mutex->owner=p;
-        return 0;
-    }
-    if(mutex->owner==p && mutex->recursive>=0)
-    {
-        mutex->recursive++;
-        return 0;
-    }
-    return EBUSY;
+    return fastMutexTryLock(mutex) ? 0 : EBUSY;
 }
 
 int pthread_mutex_unlock(pthread_mutex_t *mutex)
 {
-    FastInterruptDisableLock dLock;
-//    Safety check removed for speed reasons
-//    if(mutex->owner!=reinterpret_cast<void*>(Thread::IRQgetCurrentThread()))
-//        return 0;
-    if(mutex->recursive>0)
-    {
-        mutex->recursive--;
-        return 0;
-    }
-    if(mutex->first!=nullptr)
-    {
-        Thread *t=reinterpret_cast<Thread*>(mutex->first->thread);
-        t->IRQwakeup();
-        mutex->owner=mutex->first->thread;
-        mutex->first=mutex->first->next;
-        return 0;
-    }
-    mutex->owner=nullptr;
+    fastMutexUnlock(mutex);
     return 0;
 }
 
@@ -34,9 +34,68 @@
 #include "kernel.h"
 #include "intrusive.h"
 #include "sync.h"
+#include "interfaces/atomic_ops.h"
 
 namespace miosix {
 
+/**
+ * \internal
+ * Lock a mutex without disabling interrupts. Succeeds only if the mutex is
+ * free or if it is a recursive mutex already locked by the current thread,
+ * otherwise the caller has to fall back to IRQdoMutexLock().
+ * Can be called with interrupts enabled.
+ * \param mutex mutex to be locked
+ * \return true if the mutex was locked
+ */
+static inline bool fastMutexTryLock(pthread_mutex_t *mutex)
+{
+    void *p=reinterpret_cast<void*>(Thread::getCurrentThread());
+    int prev=atomicCompareAndSwap(reinterpret_cast<volatile int*>(&mutex->owner),
+            0,reinterpret_cast<int>(p));
+    if(prev==0) return true;
+    //Only the owner modifies recursive, no need to disable interrupts
+    if(prev==reinterpret_cast<int>(p) && mutex->recursive>=0)
+    {
+        mutex->recursive++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * \internal
+ * Unlock a mutex without disabling interrupts if no thread is waiting on it.
+ * Can be called with interrupts enabled.
+ * \param mutex mutex to unlock
+ */
+static inline void fastMutexUnlock(pthread_mutex_t *mutex)
+{
+//    Safety check removed for speed reasons
+//    if(mutex->owner!=reinterpret_cast<void*>(Thread::getCurrentThread()))
+//        return;
+    //Only the owner modifies recursive, no need to disable interrupts
+    if(mutex->recursive>0)
+    {
+        mutex->recursive--;
+        return;
+    }
+    //Release the mutex first, and only then check for waiting threads. A thread
+    //that finds the mutex free locks it instead of queuing, while a thread that
+    //queued before the release is seen here and handed the mutex
+    mutex->owner=nullptr;
+    asm volatile("":::"memory");
+    if(mutex->first==nullptr) return;
+
+    FastInterruptDisableLock dLock;
+    //If in the meantime the mutex was locked by another thread, the waiting
+    //thread will be handed the mutex when that thread unlocks it
+    if(mutex->owner!=nullptr || mutex->first==nullptr) return;
+    Thread *t=reinterpret_cast<Thread*>(mutex->first->thread);
+    t->IRQwakeup();
+    mutex->owner=mutex->first->thread;
+    mutex->first=mutex->first->next;
+}
+
 /**
  * \internal
  * Implementation code to lock a mutex. Must be called with interrupts disabled
@@ -42,7 +42,7 @@ namespace miosix {
 extern volatile Thread *runningThread;
 extern volatile int kernelRunning;
 extern volatile bool pendingWakeup;
-extern IntrusiveList<SleepData> sleepingList;
+extern IntrusivePairingHeap<SleepData> sleepingHeap;
 
 //Internal
 static long long burstStart=0;
@@ -51,12 +51,12 @@ static long long nextPreemption=numeric_limits<long long>::max();
 // Should be called when the running thread is the idle thread
 static inline void IRQsetNextPreemptionForIdle()
 {
-    if(sleepingList.empty()) nextPreemption=numeric_limits<long long>::max();
-    else nextPreemption=sleepingList.front()->wakeupTime;
+    if(sleepingHeap.empty()) nextPreemption=numeric_limits<long long>::max();
+    else nextPreemption=sleepingHeap.front()->wakeupTime;
     #ifdef WITH_CPU_TIME_COUNTER
     burstStart=IRQgetTime();
     #endif // WITH_CPU_TIME_COUNTER
-    //We could not set an interrupt if the sleeping list is empty but there's
+    //We could not set an interrupt if the sleeping heap is empty but there's
     //no such hurry to run idle anyway, so why bother?
     IRQosTimerSetInterrupt(nextPreemption);
 }
@@ -65,8 +65,8 @@ static inline void IRQsetNextPreemptionForIdle()
 static inline void IRQsetNextPreemption(long long burst)
 {
     long long firstWakeupInList;
-    if(sleepingList.empty()) firstWakeupInList=numeric_limits<long long>::max();
-    else firstWakeupInList=sleepingList.front()->wakeupTime;
+    if(sleepingHeap.empty()) firstWakeupInList=numeric_limits<long long>::max();
+    else firstWakeupInList=sleepingHeap.front()->wakeupTime;
     burstStart=IRQgetTime();
     nextPreemption=min(firstWakeupInList,burstStart+burst);
     IRQosTimerSetInterrupt(nextPreemption);
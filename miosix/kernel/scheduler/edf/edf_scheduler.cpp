@@ -42,7 +42,7 @@ namespace miosix {
 extern volatile Thread *runningThread;
 extern volatile int kernelRunning;
 extern volatile bool pendingWakeup;
-extern IntrusiveList<SleepData> sleepingList;
+extern IntrusivePairingHeap<SleepData> sleepingHeap;
 
 //Static members
 static long long nextPreemption=numeric_limits<long long>::max();
@@ -119,10 +119,10 @@ long long EDFScheduler::IRQgetNextPreemption()
 
 static void IRQsetNextPreemption()
 {
-    if(sleepingList.empty()) nextPreemption=numeric_limits<long long>::max();
-    else nextPreemption=sleepingList.front()->wakeupTime;
+    if(sleepingHeap.empty()) nextPreemption=numeric_limits<long long>::max();
+    else nextPreemption=sleepingHeap.front()->wakeupTime;
 
-    //We could not set an interrupt if the sleeping list is empty, but then we
+    //We could not set an interrupt if the sleeping heap is empty, but then we
     //would spuriously run the scheduler at every rollover of the hardware timer
     //and this could waste more cycles than setting the interrupt
     IRQosTimerSetInterrupt(nextPreemption);
@@ -39,7 +39,7 @@ namespace miosix {
 extern volatile Thread *runningThread;
 extern volatile int kernelRunning;
 extern volatile bool pendingWakeup;
-extern IntrusiveList<SleepData> sleepingList;
+extern IntrusivePairingHeap<SleepData> sleepingHeap;
 
 //Internal data
 static long long nextPeriodicPreemption=std::numeric_limits<long long>::max();
@@ -48,10 +48,17 @@ static long long nextPeriodicPreemption=std::numeric_limits<long long>::max();
 // class PriorityScheduler
 //
 
+static_assert(PRIORITY_MAX<=32,"readyMask can't hold more than 32 priorities");
+
 bool PriorityScheduler::PKaddThread(Thread *thread,
         PrioritySchedulerPriority priority)
 {
     thread->schedData.priority=priority;
+    //Note: can't use FastInterruptDisableLock here since this code is
+    //also called *before* the kernel is started.
+    //Using FastInterruptDisableLock would enable interrupts prematurely
+    //and cause all sorts of misterious crashes
+    InterruptDisableLock dLock;
     if(threadList[priority.get()]==nullptr)
     {
         threadList[priority.get()]=thread;
@@ -60,6 +67,8 @@ bool PriorityScheduler::PKaddThread(Thread *thread,
         thread->schedData.next=threadList[priority.get()]->schedData.next;
         threadList[priority.get()]->schedData.next=thread;
     }
+    //Threads created by createUserspace() are added in the wait status
+    if(thread->flags.isReady()) IRQaddToReadyQueue(thread);
     return true;
 }
 
@@ -143,8 +152,16 @@ void PriorityScheduler::PKsetPriority(Thread *thread,
         PrioritySchedulerPriority newPriority)
 {
     PrioritySchedulerPriority oldPriority=thread->PKgetPriority();
-    //First set priority to the new value
-    thread->schedData.priority=newPriority;
+    //First set priority to the new value, moving the thread to the ready
+    //queue of the new priority. This needs to be done with interrupts disabled
+    //as ready queues are also modified by IRQwakeup()
+    {
+        FastInterruptDisableLock dLock;
+        bool ready=thread->schedData.readyNext!=nullptr;
+        if(ready) IRQremoveFromReadyQueue(thread);
+        thread->schedData.priority=newPriority;
+        if(ready) IRQaddToReadyQueue(thread);
+    }
     //Then remove the thread from its old list
     if(threadList[oldPriority.get()]==thread)
     {
@@ -200,22 +217,74 @@ void PriorityScheduler::IRQsetIdleThread(Thread *idleThread)
     idle=idleThread;
 }
 
+void PriorityScheduler::IRQwaitStatusHook(Thread* t)
+{
+    //Not yet added to the scheduler, or the idle thread
+    if(t->schedData.next==nullptr) return;
+    bool queued=t->schedData.readyNext!=nullptr;
+    if(t->flags.isReady())
+    {
+        if(queued==false) IRQaddToReadyQueue(t);
+    } else {
+        if(queued) IRQremoveFromReadyQueue(t);
+    }
+}
+
 long long PriorityScheduler::IRQgetNextPreemption()
 {
     return nextPeriodicPreemption;
 }
 
+void PriorityScheduler::IRQaddToReadyQueue(Thread *thread)
+{
+    int i=thread->schedData.priority.get();
+    Thread *head=readyQueue[i];
+    if(head==nullptr)
+    {
+        readyQueue[i]=thread;
+        thread->schedData.readyNext=thread;//Circular list
+        thread->schedData.readyPrev=thread;
+        readyMask|=1u<<i;
+    } else {
+        //Insert before head, that is at the tail of the queue
+        Thread *tail=head->schedData.readyPrev;
+        thread->schedData.readyNext=head;
+        thread->schedData.readyPrev=tail;
+        tail->schedData.readyNext=thread;
+        head->schedData.readyPrev=thread;
+    }
+}
+
+void PriorityScheduler::IRQremoveFromReadyQueue(Thread *thread)
+{
+    int i=thread->schedData.priority.get();
+    Thread *next=thread->schedData.readyNext;
+    if(next==thread)
+    {
+        //Only one element in the list
+        readyQueue[i]=nullptr;
+        readyMask&=~(1u<<i);
+    } else {
+        Thread *prev=thread->schedData.readyPrev;
+        prev->schedData.readyNext=next;
+        next->schedData.readyPrev=prev;
+        if(readyQueue[i]==thread) readyQueue[i]=next;
+    }
+    thread->schedData.readyNext=nullptr;
+    thread->schedData.readyPrev=nullptr;
+}
+
 static long long IRQsetNextPreemption(bool runningIdleThread)
 {
     long long first;
-    if(sleepingList.empty()) first=std::numeric_limits<long long>::max();
-    else first=sleepingList.front()->wakeupTime;
+    if(sleepingHeap.empty()) first=std::numeric_limits<long long>::max();
+    else first=sleepingHeap.front()->wakeupTime;
 
     long long t=IRQgetTime();
     if(runningIdleThread) nextPeriodicPreemption=first;
     else nextPeriodicPreemption=std::min(first,t+MAX_TIME_SLICE);
 
-    //We could not set an interrupt if the sleeping list is empty and runningThread
+    //We could not set an interrupt if the sleeping heap is empty and runningThread
     //is idle but there's no such hurry to run idle anyway, so why bother?
     IRQosTimerSetInterrupt(nextPeriodicPreemption);
     return t;
@@ -231,42 +300,35 @@ void PriorityScheduler::IRQrunScheduler()
     #ifdef WITH_CPU_TIME_COUNTER
     Thread *prev=const_cast<Thread*>(runningThread);
     #endif // WITH_CPU_TIME_COUNTER
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    if(readyMask!=0)
     {
-        if(threadList[i]==nullptr) continue;
-        Thread *temp=threadList[i]->schedData.next;
-        for(;;)
+        //Highest priority with at least one ready thread
+        int i=31-__builtin_clz(readyMask);
+        Thread *temp=readyQueue[i];
+        //Rotate to next thread so that next time a different thread of the
+        //same priority, if available, will be chosen first
+        readyQueue[i]=temp->schedData.readyNext;
+        runningThread=temp;
+        #ifdef WITH_PROCESSES
+        if(const_cast<Thread*>(runningThread)->flags.isInUserspace()==false)
         {
-            if(temp->flags.isReady())
-            {
-                //Found a READY thread, so run this one
-                runningThread=temp;
-                #ifdef WITH_PROCESSES
-                if(const_cast<Thread*>(runningThread)->flags.isInUserspace()==false)
-                {
-                    ctxsave=runningThread->ctxsave;
-                    MPUConfiguration::IRQdisable();
-                } else {
-                    ctxsave=runningThread->userCtxsave;
-                    //A kernel thread is never in userspace, so the cast is safe
-                    static_cast<Process*>(runningThread->proc)->mpu.IRQenable();
-                }
-                #else //WITH_PROCESSES
-                ctxsave=temp->ctxsave;
-                #endif //WITH_PROCESSES
-                //Rotate to next thread so that next time the list is walked
-                //a different thread, if available, will be chosen first
-                threadList[i]=temp;
-                #ifndef WITH_CPU_TIME_COUNTER
-                IRQsetNextPreemption(false);
-                #else //WITH_CPU_TIME_COUNTER
-                auto t=IRQsetNextPreemption(false);
-                IRQprofileContextSwitch(prev->timeCounterData,temp->timeCounterData,t);
-                #endif //WITH_CPU_TIME_COUNTER
-                return;
-            } else temp=temp->schedData.next;
-            if(temp==threadList[i]->schedData.next) break;
+            ctxsave=runningThread->ctxsave;
+            MPUConfiguration::IRQdisable();
+        } else {
+            ctxsave=runningThread->userCtxsave;
+            //A kernel thread is never in userspace, so the cast is safe
+            static_cast<Process*>(runningThread->proc)->mpu.IRQenable();
         }
+        #else //WITH_PROCESSES
+        ctxsave=temp->ctxsave;
+        #endif //WITH_PROCESSES
+        #ifndef WITH_CPU_TIME_COUNTER
+        IRQsetNextPreemption(false);
+        #else //WITH_CPU_TIME_COUNTER
+        auto t=IRQsetNextPreemption(false);
+        IRQprofileContextSwitch(prev->timeCounterData,temp->timeCounterData,t);
+        #endif //WITH_CPU_TIME_COUNTER
+        return;
     }
     //No thread found, run the idle thread
     runningThread=idle;
@@ -283,6 +345,8 @@ void PriorityScheduler::IRQrunScheduler()
 }
 
 Thread *PriorityScheduler::threadList[PRIORITY_MAX]={nullptr};
+Thread *PriorityScheduler::readyQueue[PRIORITY_MAX]={nullptr};
+unsigned int PriorityScheduler::readyMask=0;
 Thread *PriorityScheduler::idle=nullptr;
 
 } //namespace miosix
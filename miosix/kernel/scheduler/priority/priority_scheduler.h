@@ -110,8 +110,10 @@ public:
      * This member function is called by the kernel every time a thread changes
      * its running status. For example when a thread become sleeping, waiting,
      * deleted or if it exits the sleeping or waiting status
+     *
+     * Moves the thread in or out of the ready queue of its priority.
      */
-    static void IRQwaitStatusHook(Thread* t) {}
+    static void IRQwaitStatusHook(Thread* t);
 
     /**
      * \internal
@@ -131,10 +133,34 @@ public:
 
 private:
 
+    /**
+     * \internal
+     * Add a thread to the tail of the ready queue of its priority.
+     * Can only be called with interrupts disabled.
+     * \param thread thread to add, must not already be in a ready queue
+     */
+    static void IRQaddToReadyQueue(Thread *thread);
+
+    /**
+     * \internal
+     * Remove a thread from the ready queue of its priority.
+     * Can only be called with interrupts disabled.
+     * \param thread thread to remove, must be in a ready queue
+     */
+    static void IRQremoveFromReadyQueue(Thread *thread);
+
     ///\internal Vector of lists of threads, there's one list for each priority
     ///Each list s a circular list.
     static Thread *threadList[PRIORITY_MAX];
 
+    ///\internal Vector of lists of ready threads, there's one list for each
+    ///priority. Each list is a circular doubly linked list whose head is the
+    ///next thread of that priority to be run.
+    static Thread *readyQueue[PRIORITY_MAX];
+
+    ///\internal Bit i is set if readyQueue[i] is not empty
+    static unsigned int readyMask;
+
     ///\internal idle thread
     static Thread *idle;
 };
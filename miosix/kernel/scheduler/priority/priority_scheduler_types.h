@@ -130,6 +130,11 @@ public:
     ///list to the new priority list.
     PrioritySchedulerPriority priority;
     Thread *next;///<Pointer to next thread of the same priority. CIRCULAR list
+    ///Pointers to next and previous thread in the ready queue of the same
+    ///priority, which is a CIRCULAR doubly linked list. Both are nullptr if
+    ///the thread is not in a ready queue.
+    Thread *readyNext;
+    Thread *readyPrev;
 };
 
 } //namespace miosix
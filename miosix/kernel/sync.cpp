@@ -30,23 +30,11 @@
 #include "error.h"
 #include "pthread_private.h"
 #include "kernel/scheduler/scheduler.h"
-#include <algorithm>
 
 using namespace std;
 
 namespace miosix {
 
-/**
- * Helper lambda to sort threads in a min heap to implement priority inheritance
- * \param lhs first thread to compare
- * \param rhs second thread to compare
- * \return true if lhs->getPriority() < rhs->getPriority()
- */
-static auto PKlowerPriority=[](Thread *lhs, Thread *rhs)
-{
-    return lhs->PKgetPriority().mutexLessOp(rhs->PKgetPriority());
-};
-
 //
 // class FastMutex
 //
@@ -100,8 +88,7 @@ void Mutex::PKlock(PauseKernelLock& dLock)
     }
 
     //Add thread to mutex' waiting queue
-    waiting.push_back(p);
-    push_heap(waiting.begin(),waiting.end(),PKlowerPriority);
+    waiting.insert(&p->mutexWaitItem);
 
     //Handle priority inheritance
     if(p->mutexWaiting!=nullptr) errorHandler(UNEXPECTED);
@@ -111,11 +98,14 @@ void Mutex::PKlock(PauseKernelLock& dLock)
         Thread *walk=owner;
         for(;;)
         {
+            //If walk is waiting on another mutex, its position in that mutex'
+            //waiting queue depends on the priority we're about to change
+            Mutex *m=walk->mutexWaiting;
+            if(m) m->waiting.removeFast(&walk->mutexWaitItem);
             Scheduler::PKsetPriority(walk,p->PKgetPriority());
-            if(walk->mutexWaiting==nullptr) break;
-            make_heap(walk->mutexWaiting->waiting.begin(),
-                      walk->mutexWaiting->waiting.end(),PKlowerPriority);
-            walk=walk->mutexWaiting->owner;
+            if(m==nullptr) break;
+            m->waiting.insert(&walk->mutexWaitItem);
+            walk=m->owner;
         }
     }
 
@@ -152,8 +142,7 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
     }
 
     //Add thread to mutex' waiting queue
-    waiting.push_back(p);
-    push_heap(waiting.begin(),waiting.end(),PKlowerPriority);
+    waiting.insert(&p->mutexWaitItem);
 
     //Handle priority inheritance
     if(p->mutexWaiting!=nullptr) errorHandler(UNEXPECTED);
@@ -163,11 +152,14 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
         Thread *walk=owner;
         for(;;)
         {
+            //If walk is waiting on another mutex, its position in that mutex'
+            //waiting queue depends on the priority we're about to change
+            Mutex *m=walk->mutexWaiting;
+            if(m) m->waiting.removeFast(&walk->mutexWaitItem);
             Scheduler::PKsetPriority(walk,p->PKgetPriority());
-            if(walk->mutexWaiting==nullptr) break;
-            make_heap(walk->mutexWaiting->waiting.begin(),
-                      walk->mutexWaiting->waiting.end(),PKlowerPriority);
-            walk=walk->mutexWaiting->owner;
+            if(m==nullptr) break;
+            m->waiting.insert(&walk->mutexWaitItem);
+            walk=m->owner;
         }
     }
 
@@ -242,8 +234,8 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
         while(walk!=nullptr)
         {
             if(walk->waiting.empty()==false)
-                if(pr.mutexLessOp(walk->waiting.front()->PKgetPriority()))
-                    pr=walk->waiting.front()->PKgetPriority();
+                if(pr.mutexLessOp(walk->waiting.front()->thread->PKgetPriority()))
+                    pr=walk->waiting.front()->thread->PKgetPriority();
             walk=walk->next;
         }
         if(pr!=owner->PKgetPriority()) Scheduler::PKsetPriority(owner,pr);
@@ -253,9 +245,8 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
     if(waiting.empty()==false)
     {
         //There is at least another thread waiting
-        owner=waiting.front();
-        pop_heap(waiting.begin(),waiting.end(),PKlowerPriority);
-        waiting.pop_back();
+        owner=waiting.front()->thread;
+        waiting.pop_front();
         if(owner->mutexWaiting!=this) errorHandler(UNEXPECTED);
         owner->mutexWaiting=nullptr;
         owner->PKwakeup();
@@ -265,12 +256,11 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
         owner->mutexLocked=this;
         //Handle priority inheritance of new owner
         if(waiting.empty()==false &&
-                owner->PKgetPriority().mutexLessOp(waiting.front()->PKgetPriority()))
-                Scheduler::PKsetPriority(owner,waiting.front()->PKgetPriority());
+                owner->PKgetPriority().mutexLessOp(waiting.front()->thread->PKgetPriority()))
+                Scheduler::PKsetPriority(owner,waiting.front()->thread->PKgetPriority());
         return p->PKgetPriority().mutexLessOp(owner->PKgetPriority());
     } else {
         owner=nullptr; //No threads waiting
-        std::vector<Thread *>().swap(waiting); //Save some RAM
         return false;
     }
 }
@@ -313,8 +303,8 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
         while(walk!=nullptr)
         {
             if(walk->waiting.empty()==false)
-                if(pr.mutexLessOp(walk->waiting.front()->PKgetPriority()))
-                    pr=walk->waiting.front()->PKgetPriority();
+                if(pr.mutexLessOp(walk->waiting.front()->thread->PKgetPriority()))
+                    pr=walk->waiting.front()->thread->PKgetPriority();
             walk=walk->next;
         }
         if(pr!=owner->PKgetPriority()) Scheduler::PKsetPriority(owner,pr);
@@ -324,9 +314,8 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
     if(waiting.empty()==false)
     {
         //There is at least another thread waiting
-        owner=waiting.front();
-        pop_heap(waiting.begin(),waiting.end(),PKlowerPriority);
-        waiting.pop_back();
+        owner=waiting.front()->thread;
+        waiting.pop_front();
         if(owner->mutexWaiting!=this) errorHandler(UNEXPECTED);
         owner->mutexWaiting=nullptr;
         owner->PKwakeup();
@@ -336,11 +325,10 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
         owner->mutexLocked=this;
         //Handle priority inheritance of new owner
         if(waiting.empty()==false &&
-                owner->PKgetPriority().mutexLessOp(waiting.front()->PKgetPriority()))
-                Scheduler::PKsetPriority(owner,waiting.front()->PKgetPriority());
+                owner->PKgetPriority().mutexLessOp(waiting.front()->thread->PKgetPriority()))
+                Scheduler::PKsetPriority(owner,waiting.front()->thread->PKgetPriority());
     } else {
         owner=nullptr; //No threads waiting
-        std::vector<Thread *>().swap(waiting); //Save some RAM
     }
     
     if(recursiveDepth<0) return 0;
@@ -31,7 +31,6 @@
 #include "kernel.h"
 #include "interfaces/interrupts.h"
 #include "intrusive.h"
-#include <vector>
 
 namespace miosix {
 
@@ -252,8 +251,9 @@ private:
     /// thread that owns this mutex. This field is necessary to make the list.
     Mutex *next;
 
-    /// Waiting thread are stored in this min-heap, sorted by priority
-    std::vector<Thread *> waiting;
+    /// Waiting thread are stored in this heap, sorted by priority. The heap
+    /// items are embedded in the waiting threads, so no memory is allocated
+    IntrusivePairingHeap<MutexWaitItem> waiting;
 
     /// Used to hold nesting depth for recursive mutexes, -1 if not recursive
     int recursiveDepth;
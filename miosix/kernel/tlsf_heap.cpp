@@ -0,0 +1,512 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef TEST_ALGORITHM
+
+#include "tlsf_heap.h"
+
+#else //TEST_ALGORITHM
+
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+//C++ glassbox testing trick
+#define private public
+#define protected public
+#include "tlsf_heap.h"
+#undef private
+#undef protected
+
+using namespace std;
+using namespace miosix;
+
+#endif //TEST_ALGORITHM
+
+#include <cstdint>
+#include <cstring>
+
+namespace miosix {
+
+/**
+ * Header of a memory block. The size is the size of the payload, excluding the
+ * header. The two free list pointers are only valid when the block is free,
+ * and overlap with the first bytes of the payload otherwise.
+ * prevPhys is nullptr for the first block of an area.
+ */
+struct TlsfHeap::Block
+{
+    Block *prevPhys;          ///< Previous block in memory
+    unsigned int sizeAndFlags;///< Payload size, bit 0 set if the block is free
+    Block *nextFree;          ///< Next block in the same free list
+    Block *prevFree;          ///< Previous block in the same free list
+
+    unsigned int size() const { return sizeAndFlags & ~1u; }
+    bool isFree() const { return sizeAndFlags & 1; }
+    char *payload();
+    Block *nextPhys() { return reinterpret_cast<Block*>(payload()+size()); }
+    static Block *fromPayload(const void *p);
+};
+
+/// Size of the header of a block, also the alignment of all blocks
+static const unsigned int hdr=2*sizeof(void*);
+/// Minimum payload size, a free block needs to fit the free list pointers
+static const unsigned int minSize=2*sizeof(void*);
+
+inline char *TlsfHeap::Block::payload()
+{
+    return reinterpret_cast<char*>(this)+hdr;
+}
+
+inline TlsfHeap::Block *TlsfHeap::Block::fromPayload(const void *p)
+{
+    return reinterpret_cast<Block*>(const_cast<char*>(
+        reinterpret_cast<const char*>(p)-hdr));
+}
+
+/**
+ * \param x must not be zero
+ * \return the index of the most significant bit set
+ */
+static inline int fls(unsigned int x) { return 31-__builtin_clz(x); }
+
+/**
+ * \return size rounded to the block alignment, and not less than minSize
+ */
+static inline unsigned int adjustSize(unsigned int size)
+{
+    size=(size+hdr-1) & ~(hdr-1);
+    return size<minSize ? minSize : size;
+}
+
+//
+// class TlsfHeap
+//
+
+/**
+ * Compute the free list of a block
+ * \param size block size
+ * \param fl first level index
+ * \param sl second level index
+ */
+inline void TlsfHeap::mapping(unsigned int size, int& fl, int& sl)
+{
+    if(size<(1u<<flShift))
+    {
+        fl=0;
+        sl=size>>alignLog2;
+    } else {
+        int msb=fls(size);
+        fl=msb-flShift+1;
+        sl=(size>>(msb-slLog2))^slCount;
+    }
+}
+
+void *TlsfHeap::allocate(unsigned int size)
+{
+    if(lists==nullptr && init()==false) return nullptr;
+    if(size>maxSize) return nullptr;
+    size=adjustSize(size);
+    Block *b=findSuitable(size);
+    if(b==nullptr) b=grow(size);
+    if(b==nullptr) return nullptr;
+    return use(b,size);
+}
+
+void *TlsfHeap::allocateAligned(unsigned int size, unsigned int align)
+{
+    if(align<=hdr) return allocate(size);
+    if(lists==nullptr && init()==false) return nullptr;
+    if(size>maxSize || align>maxSize) return nullptr;
+    size=adjustSize(size);
+    //Leave room for a free block before the aligned payload
+    unsigned int padded=size+align+hdr+minSize;
+    Block *b=findSuitable(padded);
+    if(b==nullptr) b=grow(padded);
+    if(b==nullptr) return nullptr;
+    uintptr_t p=reinterpret_cast<uintptr_t>(b->payload());
+    uintptr_t a=(p+align-1) & ~static_cast<uintptr_t>(align-1);
+    if(a!=p)
+    {
+        while(a-p<hdr+minSize) a+=align;
+        //Split the leading part into a free block. Its previous block is not
+        //free, as blocks are either taken from a free list or merged by grow()
+        Block *aligned=reinterpret_cast<Block*>(a-hdr);
+        unsigned int leading=a-hdr-p;
+        aligned->prevPhys=b;
+        aligned->sizeAndFlags=(b->size()-leading-hdr) | 1;
+        aligned->nextPhys()->prevPhys=aligned;
+        b->sizeAndFlags=leading | 1;
+        insert(b);
+        b=aligned;
+    }
+    return use(b,size);
+}
+
+void TlsfHeap::deallocate(void *p)
+{
+    if(p==nullptr) return;
+    Block *b=Block::fromPayload(p);
+    usedSize-=hdr+b->size();
+    b->sizeAndFlags|=1;
+    insert(merge(b));
+}
+
+bool TlsfHeap::resizeInPlace(void *p, unsigned int size)
+{
+    if(size>maxSize) return false;
+    size=adjustSize(size);
+    Block *b=Block::fromPayload(p);
+    if(size>b->size())
+    {
+        Block *next=b->nextPhys();
+        if(next->isFree()==false || b->size()+hdr+next->size()<size)
+            return false;
+        remove(next);
+        usedSize+=hdr+next->size();
+        b->sizeAndFlags=b->size()+hdr+next->size();
+        b->nextPhys()->prevPhys=b;
+    }
+    split(b,size);
+    return true;
+}
+
+unsigned int TlsfHeap::usableSize(const void *p)
+{
+    return Block::fromPayload(p)->size();
+}
+
+TlsfHeapStats TlsfHeap::getStats() const
+{
+    TlsfHeapStats result;
+    result.heapSize=heapSize;
+    result.usedSize=usedSize;
+    result.freeSize=0;
+    result.largestFree=0;
+    result.freeBlocks=0;
+    for(int i=0;i<flCount*slCount;i++)
+    {
+        for(Block *b=lists[i];b!=nullptr;b=b->nextFree)
+        {
+            result.freeSize+=b->size();
+            result.freeBlocks++;
+            if(b->size()>result.largestFree) result.largestFree=b->size();
+        }
+    }
+    return result;
+}
+
+bool TlsfHeap::init()
+{
+    static_assert(offsetof(Block,nextFree)==hdr,"");
+    static_assert(hdr==1<<alignLog2,"");
+    char *start=reinterpret_cast<char*>(morecore(0));
+    if(start==reinterpret_cast<char*>(-1) || start>=heapEnd) return false;
+    maxSize=heapEnd-start;
+    flCount=fls(maxSize)-flShift+2;
+    if(flCount<1) flCount=1;
+    if(flCount>32) flCount=32;
+    unsigned int pad=-reinterpret_cast<uintptr_t>(start) & (hdr-1);
+    unsigned int listSize=flCount*slCount*sizeof(Block*);
+    unsigned int ctlSize=adjustSize(listSize+flCount*sizeof(unsigned int));
+    //The control structure is followed by the sentinel, a zero sized used
+    //block that is turned into a free block when the heap grows
+    start=reinterpret_cast<char*>(morecore(pad+ctlSize+hdr));
+    if(start==reinterpret_cast<char*>(-1)) return false;
+    start+=pad;
+    memset(start,0,ctlSize);
+    lists=reinterpret_cast<Block**>(start);
+    slBitmap=reinterpret_cast<unsigned int*>(start+listSize);
+    sentinel=reinterpret_cast<Block*>(start+ctlSize);
+    sentinel->prevPhys=nullptr;
+    sentinel->sizeAndFlags=0;
+    heapSize=usedSize=pad+ctlSize+hdr;
+    return true;
+}
+
+TlsfHeap::Block *TlsfHeap::grow(unsigned int size)
+{
+    //Memory from morecore is appended after the last block, so only the
+    //missing part needs to be requested if the last block is free
+    Block *last=sentinel->prevPhys;
+    unsigned int incr=size+hdr;
+    if(last!=nullptr && last->isFree())
+    {
+        //The last block may be large enough, but not found by findSuitable()
+        //that rounds up the size to the next free list
+        if(last->size()>=size)
+        {
+            remove(last);
+            return last;
+        }
+        incr=size-last->size();
+    }
+    char *start=reinterpret_cast<char*>(morecore(incr));
+    if(start==reinterpret_cast<char*>(-1)) return nullptr;
+    heapSize+=incr;
+    if(start!=sentinel->payload())
+    {
+        //Someone else called sbrk, so start a new area with its own sentinel.
+        //This is never the case unless the application calls sbrk directly
+        if(incr<2*hdr+minSize) return nullptr; //Memory is lost
+        Block *b=reinterpret_cast<Block*>(start);
+        b->prevPhys=nullptr;
+        b->sizeAndFlags=(incr-2*hdr) | 1;
+        sentinel=b->nextPhys();
+        sentinel->prevPhys=b;
+        sentinel->sizeAndFlags=0;
+        insert(b);
+        return grow(size);
+    }
+    //Turn the old sentinel into a free block and add a new sentinel
+    Block *b=sentinel;
+    b->sizeAndFlags=(incr-hdr) | 1;
+    sentinel=b->nextPhys();
+    sentinel->prevPhys=b;
+    sentinel->sizeAndFlags=0;
+    return merge(b);
+}
+
+TlsfHeap::Block *TlsfHeap::findSuitable(unsigned int size)
+{
+    //Round up the size to the next list so that any block there fits
+    if(size>=(1u<<flShift)) size+=(1u<<(fls(size)-slLog2))-1;
+    int fl,sl;
+    mapping(size,fl,sl);
+    if(fl>=flCount) return nullptr;
+    unsigned int slMap=slBitmap[fl] & (~0u<<sl);
+    if(slMap==0)
+    {
+        unsigned int flMap=fl+1<32 ? flBitmap & (~0u<<(fl+1)) : 0;
+        if(flMap==0) return nullptr;
+        fl=__builtin_ctz(flMap);
+        slMap=slBitmap[fl];
+    }
+    sl=__builtin_ctz(slMap);
+    Block *result=*list(fl,sl);
+    remove(result);
+    return result;
+}
+
+void *TlsfHeap::use(Block *b, unsigned int size)
+{
+    b->sizeAndFlags=b->size();
+    usedSize+=hdr+b->size();
+    split(b,size);
+    return b->payload();
+}
+
+void TlsfHeap::split(Block *b, unsigned int size)
+{
+    if(b->size()<size+hdr+minSize) return;
+    Block *remainder=reinterpret_cast<Block*>(b->payload()+size);
+    remainder->prevPhys=b;
+    remainder->sizeAndFlags=(b->size()-size-hdr) | 1;
+    remainder->nextPhys()->prevPhys=remainder;
+    b->sizeAndFlags=size;
+    usedSize-=hdr+remainder->size();
+    insert(merge(remainder));
+}
+
+void TlsfHeap::insert(Block *b)
+{
+    int fl,sl;
+    mapping(b->size(),fl,sl);
+    Block **head=list(fl,sl);
+    b->prevFree=nullptr;
+    b->nextFree=*head;
+    if(*head) (*head)->prevFree=b;
+    *head=b;
+    slBitmap[fl]|=1u<<sl;
+    flBitmap|=1u<<fl;
+}
+
+void TlsfHeap::remove(Block *b)
+{
+    int fl,sl;
+    mapping(b->size(),fl,sl);
+    if(b->nextFree) b->nextFree->prevFree=b->prevFree;
+    if(b->prevFree) b->prevFree->nextFree=b->nextFree;
+    else {
+        Block **head=list(fl,sl);
+        *head=b->nextFree;
+        if(*head==nullptr)
+        {
+            slBitmap[fl]&=~(1u<<sl);
+            if(slBitmap[fl]==0) flBitmap&=~(1u<<fl);
+        }
+    }
+}
+
+TlsfHeap::Block *TlsfHeap::merge(Block *b)
+{
+    Block *next=b->nextPhys();
+    if(next->isFree())
+    {
+        remove(next);
+        b->sizeAndFlags+=hdr+next->size();
+        b->nextPhys()->prevPhys=b;
+    }
+    Block *prev=b->prevPhys;
+    if(prev!=nullptr && prev->isFree())
+    {
+        remove(prev);
+        prev->sizeAndFlags+=hdr+b->size();
+        prev->nextPhys()->prevPhys=prev;
+        b=prev;
+    }
+    return b;
+}
+
+} //namespace miosix
+
+//Testsuite for TlsfHeap. Compile with:
+//g++ -DTEST_ALGORITHM -fsanitize=address -O2 -o test tlsf_heap.cpp; ./test
+#ifdef TEST_ALGORITHM
+
+static char testArea[1024*1024];
+static char *testBrk=testArea;
+
+static void *testMorecore(ptrdiff_t incr)
+{
+    if(testBrk+incr>testArea+sizeof(testArea)) return reinterpret_cast<void*>(-1);
+    char *result=testBrk;
+    testBrk+=incr;
+    return result;
+}
+
+/**
+ * Check the heap invariants: physical links are consistent, no two adjacent
+ * free blocks exist, every free block is in the right list and the byte count
+ * matches
+ */
+static void check(TlsfHeap& heap)
+{
+    unsigned int freeCount=0, freeSize=0;
+    //Walk backwards from the sentinel
+    for(TlsfHeap::Block *b=heap.sentinel;b->prevPhys;b=b->prevPhys)
+    {
+        TlsfHeap::Block *prev=b->prevPhys;
+        assert(prev->nextPhys()==b);
+        assert(!(prev->isFree() && b->isFree()));
+        if(prev->isFree())
+        {
+            freeCount++;
+            freeSize+=hdr+prev->size();
+            int fl,sl;
+            TlsfHeap::mapping(prev->size(),fl,sl);
+            TlsfHeap::Block *walk=*heap.list(fl,sl);
+            while(walk!=nullptr && walk!=prev) walk=walk->nextFree;
+            assert(walk==prev);
+            assert(heap.slBitmap[fl] & (1u<<sl));
+            assert(heap.flBitmap & (1u<<fl));
+        }
+    }
+    TlsfHeapStats stats=heap.getStats();
+    assert(stats.freeBlocks==freeCount);
+    assert(heap.heapSize-heap.usedSize==freeSize);
+    for(int i=0;i<heap.flCount;i++)
+        for(int j=0;j<TlsfHeap::slCount;j++)
+            assert(((heap.slBitmap[i]>>j) & 1)==(*heap.list(i,j)!=nullptr));
+}
+
+int main()
+{
+    TlsfHeap heap(testMorecore,testArea+sizeof(testArea));
+    struct Alloc { unsigned char *p; unsigned int size; unsigned char fill; };
+    vector<Alloc> allocs;
+    srand(0);
+    for(int i=0;i<200000;i++)
+    {
+        int op=rand()%8;
+        if(op<4 || allocs.empty())
+        {
+            unsigned int size=rand()%8==0 ? rand()%8192 : rand()%128;
+            unsigned int align=rand()%8==0 ? 1<<(rand()%10) : 0;
+            auto p=reinterpret_cast<unsigned char*>(align ?
+                heap.allocateAligned(size,align) : heap.allocate(size));
+            if(p==nullptr) continue;
+            if(align) assert(reinterpret_cast<uintptr_t>(p)%align==0);
+            assert(reinterpret_cast<uintptr_t>(p)%hdr==0);
+            assert(TlsfHeap::usableSize(p)>=size);
+            unsigned char fill=rand();
+            memset(p,fill,size);
+            allocs.push_back({p,size,fill});
+        } else if(op<7) {
+            int j=rand()%allocs.size();
+            for(unsigned int k=0;k<allocs[j].size;k++)
+                assert(allocs[j].p[k]==allocs[j].fill);
+            heap.deallocate(allocs[j].p);
+            allocs[j]=allocs.back();
+            allocs.pop_back();
+        } else {
+            int j=rand()%allocs.size();
+            unsigned int size=rand()%256;
+            if(heap.resizeInPlace(allocs[j].p,size))
+            {
+                assert(TlsfHeap::usableSize(allocs[j].p)>=size);
+                allocs[j].size=min(allocs[j].size,size);
+            }
+        }
+        if(i%1000==0) check(heap);
+    }
+    for(auto& a : allocs) heap.deallocate(a.p);
+    check(heap);
+    //Everything freed, only the control structure and sentinel remain used
+    TlsfHeapStats stats=heap.getStats();
+    assert(stats.freeBlocks==1);
+    assert(stats.largestFree==stats.freeSize);
+
+    //Benchmark, worst case time matters more than average time
+    allocs.clear();
+    long long worst=0;
+    for(int i=0;i<100000;i++)
+    {
+        auto t1=chrono::steady_clock::now();
+        if(allocs.size()<500 && rand()%2)
+        {
+            unsigned int size=rand()%1024;
+            auto p=reinterpret_cast<unsigned char*>(heap.allocate(size));
+            if(p) allocs.push_back({p,size,0});
+        } else if(!allocs.empty()) {
+            int j=rand()%allocs.size();
+            heap.deallocate(allocs[j].p);
+            allocs[j]=allocs.back();
+            allocs.pop_back();
+        }
+        auto t2=chrono::steady_clock::now();
+        worst=max<long long>(worst,chrono::duration_cast<chrono::nanoseconds>(t2-t1).count());
+    }
+    stats=heap.getStats();
+    cout<<"Worst case time "<<worst<<"ns, "<<stats.freeBlocks<<" free blocks, "
+        <<"largest "<<stats.largestFree<<" of "<<stats.freeSize<<endl;
+    cout<<"Test passed"<<endl;
+}
+
+#endif //TEST_ALGORITHM
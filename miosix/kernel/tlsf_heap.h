@@ -0,0 +1,160 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+
+namespace miosix {
+
+/**
+ * \internal
+ * Statistics about a TlsfHeap, as returned by TlsfHeap::getStats()
+ */
+struct TlsfHeapStats
+{
+    unsigned int heapSize;     ///< Memory obtained from morecore, in bytes
+    unsigned int usedSize;     ///< Allocated memory, including block headers
+    unsigned int freeSize;     ///< Free memory, excluding block headers
+    unsigned int largestFree;  ///< Size of the largest free block
+    unsigned int freeBlocks;   ///< Number of free blocks
+};
+
+/**
+ * \internal
+ * Two-Level Segregated Fit memory allocator.
+ * Free blocks are kept in a two-level array of free lists indexed by the
+ * position of the most significant bit of the block size (first level) and by
+ * the next few bits (second level). A bitmap per level allows to find a free
+ * list that can satisfy a request with a couple of count leading/trailing zero
+ * instructions, so allocate() and deallocate() run in bounded time regardless
+ * of the number of free blocks. Adjacent free blocks are always coalesced.
+ *
+ * The heap grows on demand by calling a sbrk-like morecore function, so that
+ * the heap high watermark remains meaningful.
+ *
+ * This class does no locking, concurrent access needs to be prevented by the
+ * caller.
+ */
+class TlsfHeap
+{
+public:
+    /**
+     * Constructor
+     * \param morecore sbrk-like function, called to grow the heap. Must return
+     * the start of the added memory, or (void*)-1 on failure
+     * \param heapEnd end of the memory area morecore allocates from, used to
+     * size the free list array, which is placed at the start of the heap
+     */
+    constexpr TlsfHeap(void *(*morecore)(ptrdiff_t), const char *heapEnd)
+        : morecore(morecore), heapEnd(heapEnd) {}
+
+    /**
+     * Allocate memory
+     * \param size size of the memory to allocate
+     * \return a pointer aligned to 8 bytes (two pointers), or nullptr on failure
+     */
+    void *allocate(unsigned int size);
+
+    /**
+     * Allocate memory with an alignment constraint
+     * \param size size of the memory to allocate
+     * \param align alignment, must be a power of two
+     * \return an aligned pointer, or nullptr on failure
+     */
+    void *allocateAligned(unsigned int size, unsigned int align);
+
+    /**
+     * Deallocate memory
+     * \param p pointer returned by allocate(), or nullptr
+     */
+    void deallocate(void *p);
+
+    /**
+     * Try to resize an allocation without moving it, by shrinking it or by
+     * merging it with the following block if free.
+     * \param p pointer returned by allocate(), must not be nullptr
+     * \param size new size
+     * \return true on success
+     */
+    bool resizeInPlace(void *p, unsigned int size);
+
+    /**
+     * \param p pointer returned by allocate(), must not be nullptr
+     * \return the number of bytes that can be used starting from p
+     */
+    static unsigned int usableSize(const void *p);
+
+    /**
+     * \return the number of bytes currently allocated, including block headers
+     * and the heap control structure. Runs in constant time
+     */
+    unsigned int getUsedSize() const { return usedSize; }
+
+    /**
+     * \return heap statistics. Takes time linear in the number of free blocks,
+     * do not use in time critical code
+     */
+    TlsfHeapStats getStats() const;
+
+private:
+    TlsfHeap(const TlsfHeap&)=delete;
+    TlsfHeap& operator=(const TlsfHeap&)=delete;
+
+    struct Block;
+
+    bool init();
+    Block *grow(unsigned int size);
+    Block *findSuitable(unsigned int size);
+    void *use(Block *b, unsigned int size);
+    void split(Block *b, unsigned int size);
+    void insert(Block *b);
+    void remove(Block *b);
+    Block *merge(Block *b);
+    Block **list(int fl, int sl) const { return lists+fl*slCount+sl; }
+    static void mapping(unsigned int size, int& fl, int& sl);
+
+    ///log2 of the block alignment, which is the size of two pointers
+    static const int alignLog2=sizeof(void*)==4 ? 3 : 4;
+    static const int slLog2=4;           ///< log2 of second level lists count
+    static const int slCount=1<<slLog2;  ///< Number of second level lists
+    ///Blocks smaller than 1<<flShift go in the linearly spaced lists of fl 0
+    static const int flShift=slLog2+alignLog2;
+
+    void *(*morecore)(ptrdiff_t);  ///< sbrk-like function to grow the heap
+    const char *heapEnd;           ///< End of the memory morecore can give
+    unsigned int maxSize=0;        ///< Maximum heap size
+    Block **lists=nullptr;         ///< flCount*slCount free list heads
+    unsigned int *slBitmap=nullptr;///< Nonempty second level lists, per fl
+    unsigned int flBitmap=0;       ///< Nonempty first level lists
+    int flCount=0;                 ///< Number of first level lists
+    Block *sentinel=nullptr;       ///< Zero sized used block at heap end
+    unsigned int heapSize=0;       ///< Memory obtained from morecore
+    unsigned int usedSize=0;       ///< Memory in use, including headers
+};
+
+} //namespace miosix
@@ -182,6 +182,95 @@ write:
 	blt  syscallfailed32
 	bx   lr
 
+/**
+ * readv, read from file into multiple buffers
+ * \param fd file descriptor
+ * \param iov array of buffers
+ * \param iovcnt number of buffers
+ * \return number of read bytes or -1 if errors
+ */
+.section .text.readv
+.global	readv
+.type	readv, %function
+readv:
+	movs r3, #34
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
+/**
+ * writev, write to file from multiple buffers
+ * \param fd file descriptor
+ * \param iov array of buffers
+ * \param iovcnt number of buffers
+ * \return number of written bytes or -1 if errors
+ */
+.section .text.writev
+.global	writev
+.type	writev, %function
+writev:
+	movs r3, #35
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
+/**
+ * pread, read from file at a given offset
+ * \param fd file descriptor
+ * \param buf data to be read
+ * \param size buffer length
+ * \param offset file offset, passed in the stack as it is a long long
+ * \return number of read bytes or -1 if errors
+ */
+.section .text.pread
+.global	pread
+.type	pread, %function
+pread:
+	mov  r12, sp   /* Pointer to offset moved to 4th syscall parameter (r12) */
+	movs r3, #36
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
+/**
+ * pwrite, write to file at a given offset
+ * \param fd file descriptor
+ * \param buf data to be written
+ * \param size buffer length
+ * \param offset file offset, passed in the stack as it is a long long
+ * \return number of written bytes or -1 if errors
+ */
+.section .text.pwrite
+.global	pwrite
+.type	pwrite, %function
+pwrite:
+	mov  r12, sp   /* Pointer to offset moved to 4th syscall parameter (r12) */
+	movs r3, #37
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
+/**
+ * poll, wait for one or more file descriptors to become ready for I/O
+ * \param fds array of file descriptors and requested events
+ * \param nfds number of entries in fds
+ * \param timeout timeout in milliseconds, or -1 to wait forever
+ * \return number of ready file descriptors, 0 on timeout or -1 if errors
+ */
+.section .text.poll
+.global	poll
+.type	poll, %function
+poll:
+	movs r3, #61
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
 /**
  * lseek
  * \param fd file descriptor, passed in r0
@@ -481,6 +570,63 @@ ftruncate:
 	blt  syscallfailed32
 	bx   lr
 
+/**
+ * fallocate
+ * \param fd file descriptor
+ * \param mode 0 or FALLOC_FL_KEEP_SIZE
+ * \param offset start of the range, passed in r3,r2 as it is a long long
+ * \param len length of the range, passed in the stack
+ * \return 0 on success, -1 on failure
+ */
+.section .text.fallocate
+.global fallocate
+.type fallocate, %function
+fallocate:
+	push {r2, r3}  /* Now offset and len are contiguous in the stack */
+	mov  r2, sp    /* Pointer to them moved to 3rd syscall parameter (r2) */
+	movs r3, #62
+	svc  0
+	add  sp, sp, #8
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
+/**
+ * posix_fallocate
+ * \param fd file descriptor
+ * \param offset start of the range, passed in r3,r2 as it is a long long
+ * \param len length of the range, passed in the stack
+ * \return 0 on success, the error code on failure
+ */
+.section .text.posix_fallocate
+.global posix_fallocate
+.type posix_fallocate, %function
+posix_fallocate:
+	push {r2, r3}  /* Now offset and len are contiguous in the stack */
+	mov  r2, sp    /* Pointer to them moved to 3rd syscall parameter (r2) */
+	movs r1, #0    /* mode */
+	movs r3, #62
+	svc  0
+	add  sp, sp, #8
+	negs r0, r0    /* Return the error code instead of setting errno */
+	bx   lr
+
+/**
+ * statfs
+ * \param path path of any file or directory in the filesystem
+ * \param buf pointer to struct statfs
+ * \return 0 on success, -1 on failure
+ */
+.section .text.statfs
+.global statfs
+.type statfs, %function
+statfs:
+	movs r3, #63
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
 /**
  * rename
  * \param oldpath existing file path
@@ -794,6 +940,22 @@ sysconf:
 	blt  syscallfailed32
 	bx   lr
 
+/**
+ * __syscallring, execute the operations queued in a syscall ring, used to
+ * implement miosix::SyscallRing::submit()
+ * \param ring pointer to the SyscallRingHeader
+ * \return number of completed operations on success, -1 on failure
+ */
+.section .text.__syscallring
+.global __syscallring
+.type __syscallring, %function
+__syscallring:
+	movs r3, #60
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed32
+	bx   lr
+
 /* common jump target for all failing syscalls with 32 bit return value */
 .section .text.__seterrno32
 syscallfailed32:
@@ -0,0 +1,55 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+/*
+ * This file declares statfs(), shared between the kernel and processes.
+ */
+
+#if __has_include(<sys/statfs.h>)
+#include <sys/statfs.h>
+#else //__has_include(<sys/statfs.h>)
+/**
+ * Filesystem information returned by statfs(), not all C libraries provide
+ * sys/statfs.h
+ */
+struct statfs
+{
+    long f_type;                 ///< Filesystem type, 0 if unknown
+    long f_bsize;                ///< Block size, the allocation unit
+    unsigned long long f_blocks; ///< Total number of blocks
+    unsigned long long f_bfree;  ///< Number of free blocks
+    unsigned long long f_bavail; ///< Number of free blocks available to users
+    unsigned long long f_files;  ///< Total number of inodes, 0 if unknown
+    unsigned long long f_ffree;  ///< Number of free inodes, 0 if unknown
+    long f_namelen;              ///< Maximum file name length
+    long f_frsize;               ///< Fragment size, equal to f_bsize
+    long f_flags;                ///< Mount flags
+};
+extern "C" int statfs(const char *path, struct statfs *buf);
+#endif //__has_include(<sys/statfs.h>)
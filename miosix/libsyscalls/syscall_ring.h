@@ -0,0 +1,181 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*
+ * This file defines the layout of the syscall ring, which is shared between
+ * processes and the kernel, and the userspace API to use it.
+ * Processes queue operations in the ring, and then a single syscall executes
+ * all of them, avoiding the cost of one syscall per operation.
+ */
+
+namespace miosix {
+
+/**
+ * Operations that can be queued in a syscall ring
+ */
+enum SyscallRingOp : unsigned short
+{
+    RING_NOP     = 0, ///< Does nothing, result is 0
+    RING_READ    = 1, ///< read(fd,ptr,size)
+    RING_WRITE   = 2, ///< write(fd,ptr,size)
+    RING_LSEEK   = 3, ///< lseek(fd,offset,size), size is whence
+    RING_FSTAT   = 4, ///< fstat(fd,ptr)
+    RING_GETTIME = 5  ///< getTime(), result is the time in nanoseconds
+};
+
+/**
+ * An entry in the syscall ring. The process fills in all the fields except
+ * result, which is written by the kernel when the operation completes.
+ */
+struct SyscallRingEntry
+{
+    unsigned short op;    ///< Operation, one of SyscallRingOp
+    unsigned short flags; ///< Unused, must be zero
+    int fd;               ///< File descriptor
+    void *ptr;            ///< Buffer for read/write, struct stat for fstat
+    unsigned int size;    ///< Buffer size for read/write, whence for lseek
+    long long offset;     ///< Offset for lseek
+    long long result;     ///< Operation result, or a negative error code
+};
+
+/**
+ * The control block of a syscall ring.
+ * The head and tail counters are free running, entries are at position
+ * counter & (size-1) in the entries array.
+ */
+struct SyscallRingHeader
+{
+    SyscallRingEntry *entries; ///< Array of entries
+    unsigned int size;         ///< Number of entries, must be a power of two
+    unsigned int tail;         ///< Written by the process when queuing
+    unsigned int head;         ///< Written by the kernel when completing
+};
+
+/// Maximum number of entries in a syscall ring
+const unsigned int maxSyscallRingSize=256;
+
+/**
+ * This class allows processes to batch system calls.
+ * Operations are queued with the queue*() member functions, and executed when
+ * submit() is called. After submit() returns, the result field of the
+ * entries returned by the queue*() functions contains the operation result.
+ * Entries are reused by the following operations queued after submit(), so
+ * results should be read before queuing again.
+ *
+ * This class is not thread safe, each thread should use its own ring.
+ */
+class SyscallRing
+{
+public:
+    /**
+     * Constructor
+     * \param entries storage for the ring entries, must remain valid for the
+     * lifetime of the SyscallRing
+     * \param size number of entries, must be a power of two no greater than
+     * maxSyscallRingSize
+     */
+    SyscallRing(SyscallRingEntry *entries, unsigned int size)
+    {
+        header.entries=entries;
+        header.size=size;
+        header.tail=header.head=0;
+    }
+
+    /**
+     * Queue a read operation
+     * \return the queued entry, or nullptr if the ring is full
+     */
+    SyscallRingEntry *queueRead(int fd, void *buf, size_t size)
+    {
+        return queue(RING_READ,fd,buf,size,0);
+    }
+
+    /**
+     * Queue a write operation
+     * \return the queued entry, or nullptr if the ring is full
+     */
+    SyscallRingEntry *queueWrite(int fd, const void *buf, size_t size)
+    {
+        return queue(RING_WRITE,fd,const_cast<void*>(buf),size,0);
+    }
+
+    /**
+     * Queue a lseek operation
+     * \return the queued entry, or nullptr if the ring is full
+     */
+    SyscallRingEntry *queueLseek(int fd, off_t pos, int whence)
+    {
+        return queue(RING_LSEEK,fd,nullptr,whence,pos);
+    }
+
+    /**
+     * Queue a fstat operation
+     * \return the queued entry, or nullptr if the ring is full
+     */
+    SyscallRingEntry *queueFstat(int fd, struct stat *pstat)
+    {
+        return queue(RING_FSTAT,fd,pstat,sizeof(struct stat),0);
+    }
+
+    /**
+     * Queue a getTime operation
+     * \return the queued entry, or nullptr if the ring is full
+     */
+    SyscallRingEntry *queueGetTime()
+    {
+        return queue(RING_GETTIME,-1,nullptr,0,0);
+    }
+
+    /**
+     * \return the number of operations queued and not yet submitted
+     */
+    unsigned int pending() const { return header.tail-header.head; }
+
+    /**
+     * Execute all the queued operations with a single syscall
+     * \return the number of completed operations, or -1 on error, with errno
+     * set to EFAULT if the ring is not in process memory or EINVAL if its
+     * size is not valid
+     */
+    int submit();
+
+private:
+    SyscallRing(const SyscallRing&)=delete;
+    SyscallRing& operator=(const SyscallRing&)=delete;
+
+    SyscallRingEntry *queue(unsigned short op, int fd, void *ptr,
+                            unsigned int size, long long offset);
+
+    SyscallRingHeader header;
+};
+
+} //namespace miosix
@@ -27,6 +27,7 @@
 
 #include "libc_integration.h"
 #include <stdexcept>
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
@@ -37,15 +38,18 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <sys/times.h>
+#include <malloc.h>
 //// Settings
 #include "config/miosix_settings.h"
 //// Filesystem
 #include "filesystem/file_access.h"
+#include "filesystem/pipe/pipe.h"
 //// Console
 #include "kernel/logging.h"
 //// kernel interface
 #include "kernel/kernel.h"
 #include "kernel/process.h"
+#include "kernel/tlsf_heap.h"
 #include "interfaces/bsp.h"
 #include "interfaces/poweroff.h"
 #include "interfaces_private/os_timer.h"
@@ -88,6 +92,41 @@ static struct _reent *(*getReent)()=kernelNotStartedGetReent;
 
 void setCReentrancyCallback(struct _reent *(*callback)()) { getReent=callback; }
 
+#ifdef WITH_TLSF_HEAP
+
+/**
+ * \internal
+ * Used by the TLSF heap to grow the heap
+ */
+static void *tlsfMorecore(ptrdiff_t incr)
+{
+    return _sbrk_r(getReent(),incr);
+}
+
+//This is the absolute end of the heap
+extern char _heap_end asm("_heap_end"); //defined in the linker script
+
+/**
+ * \internal
+ * The TLSF heap. Like newlib's malloc, it is protected by pausing the kernel,
+ * but for a short and bounded time. The same warnings of __malloc_lock apply,
+ * so NEVER use malloc inside an interrupt!
+ */
+static TlsfHeap tlsfHeap(tlsfMorecore,&_heap_end);
+
+TlsfHeapStats getHeapStats()
+{
+    PauseKernelLock dLock;
+    return tlsfHeap.getStats();
+}
+
+unsigned int getHeapUsedSize()
+{
+    return tlsfHeap.getUsedSize();
+}
+
+#endif //WITH_TLSF_HEAP
+
 } //namespace miosix
 
 #ifdef __cplusplus
@@ -237,6 +276,213 @@ struct _reent *__getreent()
     return miosix::getReent();
 }
 
+#ifdef WITH_TLSF_HEAP
+
+//
+// TLSF heap, replacing the malloc implementation of the C standard library
+// ========================================================================
+
+void *_malloc_r(struct _reent *ptr, size_t size)
+{
+    void *result;
+    {
+        miosix::PauseKernelLock dLock;
+        result=miosix::tlsfHeap.allocate(size);
+    }
+    if(result==nullptr) ptr->_errno=ENOMEM;
+    return result;
+}
+
+void *malloc(size_t size)
+{
+    return _malloc_r(miosix::getReent(),size);
+}
+
+void _free_r(struct _reent *ptr, void *p)
+{
+    miosix::PauseKernelLock dLock;
+    miosix::tlsfHeap.deallocate(p);
+}
+
+void free(void *p)
+{
+    _free_r(miosix::getReent(),p);
+}
+
+void *_calloc_r(struct _reent *ptr, size_t nmemb, size_t size)
+{
+    if(size!=0 && nmemb>static_cast<size_t>(-1)/size)
+    {
+        ptr->_errno=ENOMEM;
+        return nullptr;
+    }
+    void *result=_malloc_r(ptr,nmemb*size);
+    //Zero the memory with the kernel running
+    if(result) memset(result,0,nmemb*size);
+    return result;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    return _calloc_r(miosix::getReent(),nmemb,size);
+}
+
+void *_realloc_r(struct _reent *ptr, void *p, size_t size)
+{
+    if(p==nullptr) return _malloc_r(ptr,size);
+    if(size==0)
+    {
+        _free_r(ptr,p);
+        return nullptr;
+    }
+    void *result;
+    {
+        miosix::PauseKernelLock dLock;
+        if(miosix::tlsfHeap.resizeInPlace(p,size)) return p;
+        result=miosix::tlsfHeap.allocate(size);
+    }
+    if(result==nullptr)
+    {
+        ptr->_errno=ENOMEM;
+        return nullptr;
+    }
+    //Copy with the kernel running, both blocks belong to the caller
+    memcpy(result,p,min<size_t>(miosix::TlsfHeap::usableSize(p),size));
+    _free_r(ptr,p);
+    return result;
+}
+
+void *realloc(void *p, size_t size)
+{
+    return _realloc_r(miosix::getReent(),p,size);
+}
+
+void *_memalign_r(struct _reent *ptr, size_t align, size_t size)
+{
+    void *result;
+    {
+        miosix::PauseKernelLock dLock;
+        result=miosix::tlsfHeap.allocateAligned(size,align);
+    }
+    if(result==nullptr) ptr->_errno=ENOMEM;
+    return result;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    return _memalign_r(miosix::getReent(),align,size);
+}
+
+size_t _malloc_usable_size_r(struct _reent *ptr, void *p)
+{
+    if(p==nullptr) return 0;
+    return miosix::TlsfHeap::usableSize(p);
+}
+
+size_t malloc_usable_size(void *p)
+{
+    return _malloc_usable_size_r(miosix::getReent(),p);
+}
+
+struct mallinfo _mallinfo_r(struct _reent *ptr)
+{
+    miosix::TlsfHeapStats stats=miosix::getHeapStats();
+    struct mallinfo result;
+    memset(&result,0,sizeof(result));
+    result.arena=stats.heapSize;
+    result.ordblks=stats.freeBlocks;
+    result.uordblks=stats.usedSize;
+    result.fordblks=stats.heapSize-stats.usedSize;
+    return result;
+}
+
+struct mallinfo mallinfo()
+{
+    return _mallinfo_r(miosix::getReent());
+}
+
+//The remaining functions of newlib's malloc are reimplemented as well, as
+//calling any of them would otherwise link newlib's allocator with its own
+//_malloc_r, conflicting with the one above
+
+void *_reallocf_r(struct _reent *ptr, void *p, size_t size)
+{
+    void *result=_realloc_r(ptr,p,size);
+    if(result==nullptr && p!=nullptr && size!=0) _free_r(ptr,p);
+    return result;
+}
+
+void *reallocf(void *p, size_t size)
+{
+    return _reallocf_r(miosix::getReent(),p,size);
+}
+
+/// Page size used by valloc and pvalloc, the same as newlib's malloc
+static const size_t mallocPageSize=4096;
+
+void *_valloc_r(struct _reent *ptr, size_t size)
+{
+    return _memalign_r(ptr,mallocPageSize,size);
+}
+
+void *valloc(size_t size)
+{
+    return _valloc_r(miosix::getReent(),size);
+}
+
+void *_pvalloc_r(struct _reent *ptr, size_t size)
+{
+    if(size>static_cast<size_t>(-1)-(mallocPageSize-1))
+    {
+        ptr->_errno=ENOMEM;
+        return nullptr;
+    }
+    size=(size+mallocPageSize-1) & ~(mallocPageSize-1);
+    return _memalign_r(ptr,mallocPageSize,size);
+}
+
+void *pvalloc(size_t size)
+{
+    return _pvalloc_r(miosix::getReent(),size);
+}
+
+int _malloc_trim_r(struct _reent *ptr, size_t pad)
+{
+    //The TLSF heap never gives memory back to sbrk, so nothing is released
+    return 0;
+}
+
+int malloc_trim(size_t pad)
+{
+    return _malloc_trim_r(miosix::getReent(),pad);
+}
+
+int _mallopt_r(struct _reent *ptr, int param, int value)
+{
+    //The TLSF heap has no tunable parameters, so report failure
+    return 0;
+}
+
+int mallopt(int param, int value)
+{
+    return _mallopt_r(miosix::getReent(),param,value);
+}
+
+void _malloc_stats_r(struct _reent *ptr)
+{
+    miosix::TlsfHeapStats stats=miosix::getHeapStats();
+    fiprintf(stderr,"max system bytes = %10u\n",stats.heapSize);
+    fiprintf(stderr,"system bytes     = %10u\n",stats.heapSize);
+    fiprintf(stderr,"in use bytes     = %10u\n",stats.usedSize);
+}
+
+void malloc_stats()
+{
+    _malloc_stats_r(miosix::getReent());
+}
+
+#endif //WITH_TLSF_HEAP
+
 
 
 
@@ -429,6 +675,146 @@ off_t lseek(int fd, off_t pos, int whence)
     return _lseek_r(miosix::getReent(),fd,pos,whence);
 }
 
+/**
+ * \internal
+ * pwrite, write to a file at a given offset
+ */
+ssize_t pwrite(int fd, const void *buf, size_t size, off_t offset)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pwrite(fd,buf,size,offset);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * pread, read from a file at a given offset
+ */
+ssize_t pread(int fd, void *buf, size_t size, off_t offset)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pread(fd,buf,size,offset);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * writev, write to a file from multiple buffers
+ */
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().writev(fd,iov,iovcnt);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * readv, read from a file into multiple buffers
+ */
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().readv(fd,iov,iovcnt);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * poll, wait for one or more file descriptors to become ready for I/O
+ */
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().poll(fds,nfds,timeout);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
 /**
  * \internal
  * _fstat_r, return file info
@@ -619,9 +1005,11 @@ int fcntl(int fd, int cmd, ...)
         case F_DUPFD:
         case F_SETFD:
         case F_SETFL:
+        case F_SETPIPE_SZ:
             va_start(arg,cmd);
             result=_fcntl_r(r,fd,cmd,va_arg(arg,int));
             va_end(arg);
+            break;
         default:
             result=_fcntl_r(r,fd,cmd,0);
     }
@@ -953,6 +1341,86 @@ int ftruncate(int fd, off_t size)
     #endif //WITH_FILESYSTEM
 }
 
+/**
+ * \internal
+ * fallocate, allocate storage for a range of a file
+ */
+int fallocate(int fd, int mode, off_t offset, off_t len)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().fallocate(fd,mode,offset,len);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * posix_fallocate, allocate storage for a range of a file. Unlike most other
+ * functions it returns the error code instead of setting errno
+ */
+int posix_fallocate(int fd, off_t offset, off_t len)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        return -miosix::getFileDescriptorTable().fallocate(fd,0,offset,len);
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        return ENOMEM;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    return EBADF;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * statfs, return information about a mounted filesystem
+ */
+int statfs(const char *path, struct statfs *buf)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().statfs(path,buf);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOENT;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
 /**
  * \internal
  * _rename_r, rename a file or directory
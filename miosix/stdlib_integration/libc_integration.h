@@ -32,6 +32,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <sys/time.h>
+#include "config/miosix_settings.h"
+#include "kernel/tlsf_heap.h"
 
 #ifndef COMPILING_MIOSIX
 #error "This is header is private, it can't be used outside Miosix itself."
@@ -57,6 +59,23 @@ unsigned int getMaxHeap();
  */
 void setCReentrancyCallback(struct _reent *(*callback)());
 
+#ifdef WITH_TLSF_HEAP
+
+/**
+ * \internal
+ * \return statistics about the heap. Takes time linear in the number of free
+ * heap blocks
+ */
+TlsfHeapStats getHeapStats();
+
+/**
+ * \internal
+ * \return the number of bytes allocated in the heap, including overhead
+ */
+unsigned int getHeapUsedSize();
+
+#endif //WITH_TLSF_HEAP
+
 static constexpr int nsPerSec = 1000000000;
 
 /**
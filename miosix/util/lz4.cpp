@@ -0,0 +1,94 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "lz4.h"
+#include <cstring>
+
+namespace miosix {
+
+/**
+ * Read an LZ4 length, which is the 4 bit value in the token, followed by
+ * additional bytes if it is 15
+ * \param in pointer to the next input byte, updated
+ * \param inEnd one past the last input byte
+ * \param length value of the 4 bit field in the token
+ * \return the length, or -1 if the input ends before the length
+ */
+static inline int readLength(const unsigned char *& in,
+                             const unsigned char *inEnd, unsigned int length)
+{
+    if(length!=15) return length;
+    for(;;)
+    {
+        if(in>=inEnd) return -1;
+        unsigned char b=*in++;
+        length+=b;
+        if(b!=255) return length;
+    }
+}
+
+int lz4Decompress(const void *src, unsigned int srcSize, void *dst,
+                  unsigned int dstSize)
+{
+    auto in=reinterpret_cast<const unsigned char*>(src);
+    auto inEnd=in+srcSize;
+    auto out=reinterpret_cast<unsigned char*>(dst);
+    auto outStart=out;
+    auto outEnd=out+dstSize;
+    while(in<inEnd)
+    {
+        unsigned char token=*in++;
+
+        //Literals
+        int literals=readLength(in,inEnd,token>>4);
+        if(literals<0) return -1;
+        if(literals>inEnd-in || literals>outEnd-out) return -1;
+        memcpy(out,in,literals);
+        in+=literals;
+        out+=literals;
+        if(in==inEnd) break; //The last sequence has only literals
+
+        //Match
+        if(inEnd-in<2) return -1;
+        unsigned int offset=in[0] | in[1]<<8;
+        in+=2;
+        if(offset==0 || offset>static_cast<unsigned int>(out-outStart)) return -1;
+        int match=readLength(in,inEnd,token & 0xf);
+        if(match<0) return -1;
+        match+=4; //Minimum match length
+        if(match>outEnd-out) return -1;
+        const unsigned char *from=out-offset;
+        //The match can overlap with the bytes it produces, so it can be copied
+        //with memcpy only if it does not
+        if(offset>=static_cast<unsigned int>(match)) memcpy(out,from,match);
+        else for(int i=0;i<match;i++) out[i]=from[i];
+        out+=match;
+    }
+    return out-outStart;
+}
+
+} //namespace miosix
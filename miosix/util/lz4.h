@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+namespace miosix {
+
+/**
+ * Decompress an LZ4 block, as defined by the LZ4 block format specification.
+ * Only the raw block format is supported, not the LZ4 frame format.
+ * The input is validated, so a corrupted block can't cause out of bounds
+ * memory accesses.
+ * \param src compressed data
+ * \param srcSize size of the compressed data
+ * \param dst buffer where the decompressed data is written
+ * \param dstSize size of the dst buffer
+ * \return the number of decompressed bytes, or -1 if the compressed data is
+ * malformed or does not fit in the dst buffer
+ */
+int lz4Decompress(const void *src, unsigned int srcSize, void *dst,
+                  unsigned int dstSize);
+
+} //namespace miosix
@@ -45,6 +45,19 @@ namespace miosix {
 // MemoryProfiling class
 //
 
+#ifdef WITH_TLSF_HEAP
+/**
+ * \internal
+ * \return heap fragmentation in percent
+ */
+static unsigned int fragmentation(const TlsfHeapStats& stats)
+{
+    //Only consider the memory the heap already obtained through _sbrk_r
+    if(stats.freeSize==0) return 0;
+    return 100-static_cast<unsigned long long>(stats.largestFree)*100/stats.freeSize;
+}
+#endif //WITH_TLSF_HEAP
+
 void MemoryProfiling::print()
 {
     unsigned int curFreeStack=getCurrentFreeStack();
@@ -66,6 +79,13 @@ void MemoryProfiling::print()
             curFreeStack,absFreeStack,
             heapSize,heapSize-curFreeHeap,heapSize-absFreeHeap,
             curFreeHeap,absFreeHeap);
+    #ifdef WITH_TLSF_HEAP
+    TlsfHeapStats stats=getHeapStats();
+    iprintf("Free blocks: %u\n"
+            "Largest free block: %u\n"
+            "Fragmentation: %u%%\n",
+            stats.freeBlocks,stats.largestFree,fragmentation(stats));
+    #endif //WITH_TLSF_HEAP
 }
 
 unsigned int MemoryProfiling::getStackSize()
@@ -128,9 +148,25 @@ unsigned int MemoryProfiling::getAbsoluteFreeHeap()
 
 unsigned int MemoryProfiling::getCurrentFreeHeap()
 {
+    #ifndef WITH_TLSF_HEAP
     struct mallinfo mallocData=_mallinfo_r(__getreent());
     return getHeapSize()-mallocData.uordblks;
+    #else //WITH_TLSF_HEAP
+    return getHeapSize()-getHeapUsedSize();
+    #endif //WITH_TLSF_HEAP
+}
+
+#ifdef WITH_TLSF_HEAP
+unsigned int MemoryProfiling::getLargestFreeHeapBlock()
+{
+    return getHeapStats().largestFree;
+}
+
+unsigned int MemoryProfiling::getHeapFragmentation()
+{
+    return fragmentation(getHeapStats());
 }
+#endif //WITH_TLSF_HEAP
 
 char *formatHex(char *out, unsigned long n, unsigned int len)
 {
@@ -98,6 +98,24 @@ public:
      */
     static unsigned int getCurrentFreeHeap();
 
+    #ifdef WITH_TLSF_HEAP
+    /**
+     * \return the size of the largest free heap block, that is the size of the
+     * largest memory block that can be allocated without growing the heap
+     * past the current free heap.<br>
+     * Takes time linear in the number of free heap blocks.
+     */
+    static unsigned int getLargestFreeHeapBlock();
+
+    /**
+     * \return heap fragmentation in percent, computed as the fraction of the
+     * free memory that is not part of the largest free block. 0 means all the
+     * free memory can be allocated in a single block.<br>
+     * Takes time linear in the number of free heap blocks.
+     */
+    static unsigned int getHeapFragmentation();
+    #endif //WITH_TLSF_HEAP
+
 private:
     //All member functions static, disallow creating instances
     MemoryProfiling();